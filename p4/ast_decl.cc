@@ -261,6 +261,7 @@ Location* FnDecl::Emit(CodeGenerator* codeGen) {
         if (!inClass) codeGen->GenLabel(id->GetName());
         BeginFunc *beginFunc = codeGen->GenBeginFunc();
         body->Emit(codeGen);
+        codeGen->GenErrorStubs();
         beginFunc->SetFrameSize(CodeGenerator::OffsetToFirstLocal - fn_offset);
         codeGen->GenEndFunc();
     }
@@ -197,30 +197,17 @@ Type* ArrayAccess::GetType() {
 }
 
 Location* ArrayAccess::GetOffsetLocation(CodeGenerator* codeGen) {
-    Location *varSize = codeGen->GenLoadConstant(CodeGenerator::VarSize);
-    Location *offset = codeGen->GenBinaryOp("*", subscript->Emit(codeGen), varSize);
+    Location *index = subscript->Emit(codeGen);
     Location *b = base->Emit(codeGen);
 
-    // Check that index is >= 0 
-    char *label0 = codeGen->NewLabel();
-    char *label1 = codeGen->NewLabel();
-
-    Location *test = codeGen->GenBinaryOp("<", offset, codeGen->GenLoadConstant(0));
-    codeGen->GenIfZ(test, label0);
-    codeGen->GenBuiltInCall(PrintString, codeGen->GenLoadConstant(err_arr_out_of_bounds));
-    codeGen->GenBuiltInCall(Halt);
-    
-    // Check that index is below max bound
-    codeGen->GenLabel(label0);
-    Location *size = codeGen->GenBinaryOp("*", codeGen->GenLoad(b), varSize);
-    test = codeGen->GenBinaryOp("||", codeGen->GenBinaryOp("<", size, offset), codeGen->GenBinaryOp("==", size, offset));
-    codeGen->GenIfZ(test, label1);
-
-    codeGen->GenBuiltInCall(PrintString, codeGen->GenLoadConstant(err_arr_out_of_bounds));
-    codeGen->GenBuiltInCall(Halt);
-    codeGen->GenLabel(label1);
+    // Check that 0 <= index < length: a negative index is a huge
+    // unsigned one, so a single unsigned compare does both
+    Location *test = codeGen->GenBinaryOp("<u", index, codeGen->GenLoad(b));
+    codeGen->GenCheck(test, err_arr_out_of_bounds);
 
-    Location *location = codeGen->GenBinaryOp("+", base->Emit(codeGen), offset);
+    Location *varSize = codeGen->GenLoadConstant(CodeGenerator::VarSize);
+    Location *offset = codeGen->GenBinaryOp("*", index, varSize);
+    Location *location = codeGen->GenBinaryOp("+", b, offset);
 
     //add varSize to the offset for the array header
     return codeGen->GenBinaryOp("+", location, varSize);
@@ -515,13 +502,8 @@ Location* NewArrayExpr::Emit(CodeGenerator *codeGen) {
     Location *s = size->Emit(codeGen);
     
     // Check that size is > 0
-    char *label = codeGen->NewLabel();
-
-    Location *test = codeGen->GenBinaryOp("<", s, codeGen->GenLoadConstant(1));
-    codeGen->GenIfZ(test, label);
-    codeGen->GenBuiltInCall(PrintString, codeGen->GenLoadConstant(err_arr_bad_size));
-    codeGen->GenBuiltInCall(Halt);
-    codeGen->GenLabel(label);
+    Location *test = codeGen->GenBinaryOp("<", codeGen->GenLoadConstant(0), s);
+    codeGen->GenCheck(test, err_arr_bad_size);
 
     //multiply size times varsize for alloc
     Location * c = codeGen->GenLoadConstant(CodeGenerator::VarSize);
@@ -0,0 +1,50 @@
+/* File: backend.h
+ * ---------------
+ * The Backend class is the abstract interface through which Tac
+ * instructions are lowered. Each Instruction subclass responds to
+ * EmitSpecific by calling the one method below that matches its
+ * opcode, handing over its operands. The Mips class is the original
+ * implementation and translates each call into MIPS assembly. Other
+ * consumers of the Tac list (the interpreter, for one) implement the
+ * same interface so they can walk the instructions without needing
+ * access to their private fields.
+ */
+
+#ifndef _H_backend
+#define _H_backend
+
+#include "tac.h"
+#include "list.h"
+
+class Backend {
+  public:
+    virtual ~Backend() {}
+
+    virtual void EmitLoadConstant(Location *dst, int val) = 0;
+    virtual void EmitLoadStringConstant(Location *dst, const char *str) = 0;
+    virtual void EmitLoadLabel(Location *dst, const char *label) = 0;
+
+    virtual void EmitLoad(Location *dst, Location *reference, int offset) = 0;
+    virtual void EmitStore(Location *reference, Location *value, int offset) = 0;
+    virtual void EmitCopy(Location *dst, Location *src) = 0;
+
+    virtual void EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                              Location *op1, Location *op2) = 0;
+
+    virtual void EmitLabel(const char *label) = 0;
+    virtual void EmitGoto(const char *label) = 0;
+    virtual void EmitIfZ(Location *test, const char *label) = 0;
+    virtual void EmitReturn(Location *returnVal) = 0;
+
+    virtual void EmitBeginFunction(int frameSize) = 0;
+    virtual void EmitEndFunction() = 0;
+
+    virtual void EmitParam(Location *arg) = 0;
+    virtual void EmitLCall(Location *result, const char *label) = 0;
+    virtual void EmitACall(Location *result, Location *fnAddr) = 0;
+    virtual void EmitPopParams(int bytes) = 0;
+
+    virtual void EmitVTable(const char *label, List<const char*> *methodLabels) = 0;
+};
+
+#endif
@@ -0,0 +1,145 @@
+/* File: blocklayout.cc
+ * --------------------
+ * Reading the edge profile, and laying out the blocks of a function by
+ * it.
+ */
+
+#include "blocklayout.h"
+#include "codegen.h"
+#include "utility.h"
+#include <stdlib.h>
+#include <algorithm>
+
+
+const EdgeProfile *EdgeProfile::Get()
+{
+  static EdgeProfile *profile = NULL;
+  static bool read = false;
+  if (!read && GetProfile()) {
+    profile = new EdgeProfile;
+    if (!profile->Read(GetProfile())) {
+      fprintf(stderr, "dcc: cannot read profile '%s'\n", GetProfile());
+      exit(2);
+    }
+  }
+  read = true;
+  return profile;
+}
+
+  // One line per label, "label reached taken"; # starts a comment.
+bool EdgeProfile::Read(const char *file)
+{
+  FILE *in = fopen(file, "r");
+  if (!in) return false;
+  char line[1024], label[1024];
+  Counts c;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), in)) {
+    if (line[0] == '#' || line[0] == '\n') continue;
+    ok = sscanf(line, "%1023s %lld %lld", label, &c.reached, &c.taken) == 3;
+    if (ok) counts[label] = c;
+  }
+  fclose(in);
+  return ok;
+}
+
+const EdgeProfile::Counts *EdgeProfile::Lookup(const char *label) const
+{
+  map<string, Counts>::const_iterator c = counts.find(label);
+  return c == counts.end() ? NULL : &c->second;
+}
+
+
+struct FlowEdge {
+    long long weight;
+    int from, to;
+};
+
+static bool Heavier(const FlowEdge &a, const FlowEdge &b)
+{
+  return a.weight > b.weight;
+}
+
+  // The label of block, which is given a fresh one if it has none.
+static const char *LabelOf(MBlock *block)
+{
+  if (!block->label) block->label = CodeGenerator::NewLabel();
+  return block->label;
+}
+
+/* Function: LayoutBlocks
+ * ----------------------
+ * Works out the counts, builds the chains (next and prev link the
+ * blocks of a chain), orders them, and then patches the ends of the
+ * blocks whose fall-through successor is no longer the next block.
+ */
+void LayoutBlocks(MFunction *fn, MTarget *target, const EdgeProfile *profile)
+{
+  const EdgeProfile::Counts *entry = profile->Lookup(fn->name);
+  int n = fn->blocks.size();
+  if (!entry || entry->reached == 0 || n < 3) return;
+
+  vector<long long> count(n, 0);
+  vector<FlowEdge> edges;
+  long long fall = entry->reached;       // into the next block
+  for (int b = 0; b < n; b++) {
+    MBlock *block = fn->blocks[b];
+    const EdgeProfile::Counts *c = block->label ? profile->Lookup(block->label) : NULL;
+    count[b] = b == 0 || !block->label ? fall : (c ? c->reached : 0);
+    fall = count[b];
+    MInstr *last = block->code.empty() ? NULL : block->code.back();
+    if (last && last->Is(MIsBranch | MIsJump)) {
+      c = profile->Lookup(last->BranchTarget());
+      long long taken = last->Is(MIsJump) ? count[b] : std::min(count[b], c ? c->taken : 0);
+      FlowEdge e = { taken, b, block->succs[0] };
+      edges.push_back(e);
+      fall -= taken;
+    } else if (last && last->Is(MIsReturn))
+      fall = 0;
+    if (fall > 0 && b + 1 < n) {
+      FlowEdge e = { fall, b, b + 1 };
+      edges.push_back(e);
+    }
+  }
+
+  vector<int> next(n, -1), prev(n, -1);
+  std::stable_sort(edges.begin(), edges.end(), Heavier);
+  for (size_t i = 0; i < edges.size(); i++) {
+    int from = edges[i].from, to = edges[i].to, head = from;
+    if (next[from] >= 0 || prev[to] >= 0 || to == 0) continue;
+    while (prev[head] >= 0) head = prev[head];
+    if (head == to) continue;            // would close a loop
+    next[from] = to;
+    prev[to] = from;
+  }
+
+  vector<int> order;
+  for (int pass = 0; pass < 2; pass++)   // the chains that ran, then the rest
+    for (int head = 0; head < n; head++) {
+      if (prev[head] >= 0) continue;
+      bool ran = false;
+      for (int b = head; b >= 0; b = next[b]) ran |= count[b] > 0;
+      if (ran != (pass == 0)) continue;
+      for (int b = head; b >= 0; b = next[b]) order.push_back(b);
+    }
+
+  vector<MBlock *> placed;
+  for (int k = 0; k < n; k++) {
+    int b = order[k], follows = k + 1 < n ? order[k + 1] : -1;
+    MBlock *block = fn->blocks[b];
+    placed.push_back(block);
+    MInstr *last = block->code.empty() ? NULL : block->code.back();
+    if (b + 1 == n || follows == b + 1 || (last && last->Is(MIsJump | MIsReturn)))
+      continue;
+    const char *fallTo = LabelOf(fn->blocks[b + 1]);
+    if (!last || !last->Is(MIsBranch))
+      block->code.push_back(target->CreateJump(fallTo));
+    else if (follows != block->succs[0] || !target->ReverseBranch(last, fallTo)) {
+      MBlock *jump = new MBlock(NULL);
+      jump->code.push_back(target->CreateJump(fallTo));
+      placed.push_back(jump);
+    }
+  }
+  fn->blocks = placed;
+  fn->ComputeSuccessors();
+}
@@ -0,0 +1,60 @@
+/* File: blocklayout.h
+ * -------------------
+ * Profile-guided block layout for the machine IR (see mir.h). With an
+ * edge profile (dcc -profile, written by dsim -profile from a run of
+ * the program compiled without one), the blocks of each function are
+ * reordered so that the way execution usually goes falls through:
+ *
+ *   - the profile gives, for each label, how many times it was reached
+ *     and how many times a branch to it was taken. From those come the
+ *     count of every block (one without a label is reached only from
+ *     the block before it) and of every edge: a conditional branch is
+ *     taken as often as its target was branched to, and falls through
+ *     the rest of the time;
+ *   - blocks are chained greedily along the heaviest edges first (an
+ *     edge joins two chains when it leaves the tail of one and enters
+ *     the head of the other), so a hot then-part, loop body or
+ *     successful bounds check becomes the fall-through;
+ *   - the chain holding the entry goes first, then the other chains
+ *     that ran, in their original order, then those that never ran;
+ *   - a branch whose target now comes next is reversed to go to the
+ *     block it used to fall through to, and jumps are added where a
+ *     block no longer falls through to its successor. Blocks that
+ *     become branch targets are given fresh labels.
+ *
+ * The branches to a label share its taken count, which is exact for
+ * the code dcc generates, since each label is the target of at most
+ * one conditional branch. A function the profile does not know, or
+ * that never ran, is left as it was selected.
+ */
+
+#ifndef _H_blocklayout
+#define _H_blocklayout
+
+#include "mir.h"
+#include <string>
+using std::string;
+
+class EdgeProfile {
+  public:
+    struct Counts {
+        long long reached, taken;
+    };
+
+      // The profile named by dcc -profile, read on first use; NULL if
+      // none was given.
+    static const EdgeProfile *Get();
+
+    const Counts *Lookup(const char *label) const;
+
+  private:
+    map<string, Counts> counts;
+
+    bool Read(const char *file);
+};
+
+  // Reorders the blocks of fn (whose successors must be computed) by
+  // the profile, then recomputes the successors.
+void LayoutBlocks(MFunction *fn, MTarget *target, const EdgeProfile *profile);
+
+#endif
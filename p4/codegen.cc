@@ -9,15 +9,25 @@
 #include <string.h>
 #include "tac.h"
 #include "mips.h"
+#include "mipsmir.h"
+#include "interp.h"
+#include "x86.h"
+#include "ctarget.h"
+#include "jit.h"
 #include "ast_decl.h"
 #include "errors.h"
   
 extern SymbolTable *symbols;
 extern int fn_offset;
+extern int gp_offset;
 
 CodeGenerator::CodeGenerator()
 {
   code = new List<Instruction*>();
+  stubMessages = new List<const char*>();
+  stubLabels = new List<const char*>();
+  for (int i = 0; i < NumBuiltIns; i++)
+    builtInUsed[i] = false;
 }
 
 char *CodeGenerator::NewLabel()
@@ -126,6 +136,31 @@ BeginFunc *CodeGenerator::GenBeginFunc()
   return result;
 }
 
+void CodeGenerator::GenCheck(Location *test, const char *message)
+{
+  int i = 0;
+  while (i < stubMessages->NumElements() && strcmp(stubMessages->Nth(i), message)) i++;
+  if (i == stubMessages->NumElements()) {
+    stubMessages->Append(message);
+    stubLabels->Append(NewLabel());
+  }
+  GenIfZ(test, stubLabels->Nth(i));
+}
+
+void CodeGenerator::GenErrorStubs()
+{
+  if (stubLabels->NumElements() > 0) GenReturn();
+  for (int i = 0; i < stubLabels->NumElements(); i++) {
+    GenLabel(stubLabels->Nth(i));
+    GenBuiltInCall(PrintString, GenLoadConstant(stubMessages->Nth(i)));
+    GenBuiltInCall(Halt);
+  }
+  while (stubLabels->NumElements() > 0) {
+    stubMessages->RemoveAt(0);
+    stubLabels->RemoveAt(0);
+  }
+}
+
 void CodeGenerator::GenEndFunc()
 {
   code->Append(new EndFunc());
@@ -146,6 +181,8 @@ void CodeGenerator::GenPopParams(int numBytesOfParams)
 Location *CodeGenerator::GenLCall(const char *label, bool fnHasReturnValue)
 {
   Location *result = fnHasReturnValue ? GenTempVar() : NULL;
+  BuiltIn b = BuiltInForLabel(label);
+  if (b != NumBuiltIns) builtInUsed[b] = true;
   code->Append(new LCall(label, result));
   return result;
 }
@@ -183,6 +220,7 @@ Location *CodeGenerator::GenBuiltInCall(BuiltIn bn,Location *arg1, Location *arg
   Assert((b->numArgs == 0 && !arg1 && !arg2)
 	|| (b->numArgs == 1 && arg1 && !arg2)
 	|| (b->numArgs == 2 && arg1 && arg2));
+  builtInUsed[bn] = true;
   if (arg2) code->Append(new PushParam(arg2));
   if (arg1) code->Append(new PushParam(arg1));
   code->Append(new LCall(b->label, result));
@@ -190,6 +228,26 @@ Location *CodeGenerator::GenBuiltInCall(BuiltIn bn,Location *arg1, Location *arg
   return result;
 }
 
+const char *CodeGenerator::LabelForBuiltIn(BuiltIn bn)
+{
+  Assert(bn >= 0 && bn < NumBuiltIns);
+  return builtins[bn].label;
+}
+
+int CodeGenerator::NumArgsForBuiltIn(BuiltIn bn)
+{
+  Assert(bn >= 0 && bn < NumBuiltIns);
+  return builtins[bn].numArgs;
+}
+
+BuiltIn CodeGenerator::BuiltInForLabel(const char *label)
+{
+  for (int i = 0; i < NumBuiltIns; i++)
+    if (!strcmp(builtins[i].label, label))
+      return (BuiltIn)i;
+  return NumBuiltIns;
+}
+
 
 void CodeGenerator::GenVTable(const char *className, List<const char *> *methodLabels)
 {
@@ -203,22 +261,54 @@ void CodeGenerator::DoFinalCodeGen()
   if (IsDebugOn("tac")) { // if debug don't translate to mips, just print Tac
     for (int i = 0; i < code->NumElements(); i++)
       code->Nth(i)->Print();
+   } else if (IsDebugOn("interp")) { // run the Tac directly and profile it
+     if (!symbols->Search((char*)"main")) {
+       ReportError::NoMainFound();
+       return;
+     }
+     Interpreter interp;
+     interp.Load(code);
+     interp.Run();
+   } else if (!strcmp(GetTarget(), "run")) { // compile in memory and run, see jit.h
+     if (!symbols->Search((char*)"main")) {
+       ReportError::NoMainFound();
+       return;
+     }
+     if (!Jit::HostSupported())
+       Failure("dcc --run needs an x86-64 host");
+     Jit jit;
+     jit.Load(code);
+     jit.Run();
+   } else if (!strcmp(GetTarget(), "x86")) { // native code, see x86.h
+     X86 x86;
+     x86.EmitPreamble();
+     for (int i = 0; i < code->NumElements(); i++)
+       x86.EmitInstruction(code->Nth(i));
+     x86.EmitGlobals();
+     if (!symbols->Search((char*)"main"))
+       ReportError::NoMainFound();
+   } else if (!strcmp(GetTarget(), "c")) { // C for the host compiler, see ctarget.h
+     CTarget c;
+     for (int i = 0; i < code->NumElements(); i++)
+       code->Nth(i)->EmitSpecific(&c);
+     c.EmitProgram();
+     if (!symbols->Search((char*)"main"))
+       ReportError::NoMainFound();
    }  else {
      Mips mips;
-     mips.EmitPreamble();
-     //TODO optimize this
-     mips.EmitPrintInt();
-     mips.EmitPrintString();
-     mips.EmitPrintBool();
-     mips.EmitAlloc();
-     mips.EmitStringEqual();
-     mips.EmitHalt();
-     mips.EmitReadInteger();
-     mips.EmitReadLine();
-
-     for (int i = 0; i < code->NumElements(); i++) {
-      code->Nth(i)->Emit(&mips);
+     mips.EmitPreamble(builtInUsed, gp_offset);    // only the runtime routines called
+     mips.EmitRuntime();
+
+     if (IsDebugOn("direct")) { // the original one-instruction-at-a-time translation
+       for (int i = 0; i < code->NumElements(); i++)
+         code->Nth(i)->Emit(&mips);
+     } else {                   // through the machine IR, see mipsmir.h
+       MipsISel isel;
+       for (int i = 0; i < code->NumElements(); i++)
+         code->Nth(i)->EmitSpecific(&isel);
+       isel.EmitProgram();
      }
+     mips.EmitStringPool();
 
     //is main defined?
     FnDecl* main = dynamic_cast<FnDecl*>(symbols->Search((char*)"main"));
@@ -26,6 +26,8 @@ typedef enum { Alloc, ReadLine, ReadInteger, StringEqual,
 class CodeGenerator {
   private:
     List<Instruction*> *code;
+    List<const char*> *stubMessages, *stubLabels;   // this function's error stubs
+    bool builtInUsed[NumBuiltIns];                  // called anywhere in the program
 
   public:
            // Here are some class constants to remind you of the offsets
@@ -47,7 +49,7 @@ class CodeGenerator {
     
          // Assigns a new unique label name and returns it. Does not
          // generate any Tac instructions (see GenLabel below if needed)
-    char *NewLabel();
+    static char *NewLabel();
 
     
          // Creates and returns a Location for a new uniquely named
@@ -132,6 +134,13 @@ class CodeGenerator {
          // is created and NULL is returned.
     Location *GenBuiltInCall(BuiltIn b, Location *arg1 = NULL, Location *arg2 = NULL);
 
+         // Maps between built-in codes and the labels used to call
+         // them (_Alloc, _PrintInt, ...). BuiltInForLabel returns
+         // NumBuiltIns if the label does not name a built-in.
+    static const char *LabelForBuiltIn(BuiltIn b);
+    static BuiltIn BuiltInForLabel(const char *label);
+    static int NumArgsForBuiltIn(BuiltIn b);
+
     
          // These methods generate the Tac instructions for various
          // control flow (branches, jumps, returns, labels)
@@ -143,6 +152,16 @@ class CodeGenerator {
     void GenReturn(Location *val = NULL);
     void GenLabel(const char *label);
 
+         // Generates an IfZ on test to the current function's error
+         // stub for message, a block that prints the message and
+         // halts. The runtime checks of a function share one stub per
+         // message, so each check is just its test and a branch.
+         // GenErrorStubs emits the stubs asked for so far, behind a
+         // return so that the body cannot run into them; it is called
+         // at the end of the function body.
+    void GenCheck(Location *test, const char *message);
+    void GenErrorStubs();
+
 
          // These methods generate the Tac instructions that mark the start
          // and end of a function/method definition. 
@@ -164,6 +183,12 @@ class CodeGenerator {
          // flag tac is on (-d tac), it will not translate to MIPS,
          // but instead just print the untranslated Tac. It may be
          // useful in debugging to first make sure your Tac is correct.
+         // With -d interp the Tac is executed by the interpreter
+         // instead (see interp.h), which prints a profile on stderr.
+         // MIPS code goes through the machine IR (see mipsmir.h);
+         // -d direct translates each Tac instruction on its own as
+         // before, and -d mir dumps the machine code of each function.
+         // With -profile, its blocks are laid out by a dsim profile.
     void DoFinalCodeGen();
 };
 
@@ -0,0 +1,141 @@
+/* File: cruntime.h
+ * ----------------
+ * The runtime included by the C that dcc -target c produces (see
+ * ctarget.h). Everything is static so the C compiler can inline the
+ * built-ins into the program.
+ *
+ * Decaf memory is one growable byte arena and a Decaf pointer is an
+ * offset into it (0 stays null: the arena starts with an unused word).
+ * Since nothing keeps host pointers into the arena, it can simply be
+ * reallocated when it fills up. Like sbrk memory, new space is zeroed.
+ *
+ * The built-ins behave as the MIPS versions in mips.cc do, including
+ * _PrintBool printing "false" for anything <= 0 and _ReadLine returning
+ * the line without its newline, however long.
+ * Arithmetic wraps around instead of being undefined, and dividing by
+ * zero stops the program with an error.
+ */
+
+#ifndef _H_cruntime
+#define _H_cruntime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+static unsigned char *rt_mem;
+static uint32_t rt_used = 4, rt_size;
+
+  /* The word at Decaf address ref + off. */
+#define WORD(ref, off) (*(int32_t *)(rt_mem + (uint32_t)(ref) + (off)))
+
+static void rt_Fatal(const char *message)
+{
+  fflush(stdout);
+  fprintf(stderr, "Decaf runtime error: %s\n", message);
+  exit(1);
+}
+
+static int32_t rt_Halt(void)
+{
+  fflush(stdout);
+  exit(0);
+}
+
+static int32_t rt_Alloc(int32_t size)
+{
+  uint32_t bytes = ((uint32_t)size + 3) & ~3u;
+  if (size < 0 || bytes > 0x7fffffff - rt_used) rt_Fatal("out of memory");
+  if (rt_used + bytes > rt_size) {
+    uint32_t grown = rt_size ? rt_size : 1 << 20;
+    while (grown < rt_used + bytes && grown < 0x40000000) grown *= 2;
+    if (grown < rt_used + bytes) grown = rt_used + bytes;
+    unsigned char *mem = realloc(rt_mem, grown);
+    if (!mem) rt_Fatal("out of memory");
+    memset(mem + rt_size, 0, grown - rt_size);
+    rt_mem = mem;
+    rt_size = grown;
+  }
+  int32_t result = (int32_t)rt_used;
+  rt_used += bytes;
+  return result;
+}
+
+  /* Copies a string constant or vtable into the arena at startup. */
+static int32_t rt_String(const char *s)
+{
+  int32_t at = rt_Alloc(strlen(s) + 1);
+  strcpy((char *)rt_mem + at, s);
+  return at;
+}
+
+static int32_t rt_Table(int n, const int32_t *entries)
+{
+  int32_t at = rt_Alloc(4 * n);
+  if (n) memcpy(rt_mem + at, entries, 4 * n);
+  return at;
+}
+
+static int32_t rt_Div(int32_t a, int32_t b)
+{
+  if (b == 0) rt_Fatal("division by zero");
+  return b == -1 ? (int32_t)(0u - (uint32_t)a) : a / b;
+}
+
+static int32_t rt_Mod(int32_t a, int32_t b)
+{
+  if (b == 0) rt_Fatal("division by zero");
+  return b == -1 ? 0 : a % b;
+}
+
+static int32_t rt_PrintInt(int32_t value)
+{
+  printf("%d", value);
+  return 0;
+}
+
+static int32_t rt_PrintString(int32_t s)
+{
+  fputs((char *)rt_mem + s, stdout);
+  return 0;
+}
+
+static int32_t rt_PrintBool(int32_t value)
+{
+  fputs(value > 0 ? "true" : "false", stdout);
+  return 0;
+}
+
+static int32_t rt_StringEqual(int32_t a, int32_t b)
+{
+  return strcmp((char *)rt_mem + a, (char *)rt_mem + b) == 0;
+}
+
+static int32_t rt_ReadInteger(void)
+{
+  char line[256];
+  fflush(stdout);
+  return fgets(line, sizeof(line), stdin) ? (int32_t)strtol(line, NULL, 10) : 0;
+}
+
+  /* The line, without its newline, in a block that doubles when the
+     line outgrows it (rt_mem may move when it does). */
+static int32_t rt_ReadLine(void)
+{
+  int size = 32, len = 0, c;
+  int32_t result = rt_Alloc(size);
+  fflush(stdout);
+  while ((c = getchar()) != EOF && c != '\n') {
+    if (len + 1 == size) {
+      int32_t bigger = rt_Alloc(size *= 2);
+      memcpy(rt_mem + bigger, rt_mem + result, len);
+      result = bigger;
+    }
+    rt_mem[result + len++] = c;
+  }
+  rt_mem[result + len] = '\0';
+  return result;
+}
+
+#endif
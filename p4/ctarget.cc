@@ -0,0 +1,373 @@
+/* File: ctarget.cc
+ * ----------------
+ * Implementation of the CTarget class, which translates Tac to C. See
+ * ctarget.h for how Decaf data is represented.
+ *
+ * Generated names: aN are parameters, lN locals and temps, gN globals
+ * (N is the word index of the frame or global offset), pN outgoing
+ * arguments (see EmitParam), sN the string
+ * constants and vN the addresses of data labels. Functions are FN_name,
+ * numbered so that two Decaf labels never map to the same C name;
+ * FN+1 is also the value a vtable stores for them.
+ */
+
+#include "ctarget.h"
+#include "codegen.h"
+#include <stdarg.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+
+  // Stands in for the argument list of a call in a function body until
+  // the final parameter count is known (see Expand).
+static const char CallMark = '\1';
+
+
+CTarget::CTarget()
+  : numParams(0), globalWords(0), current(-1), depth(0), inFunction(false) {}
+
+string CTarget::Var(Location *var)
+{
+  char buf[32];
+  int offset = var->GetOffset();
+  Assert(offset % 4 == 0); // all variables are 4 bytes
+  if (var->GetSegment() == gpRelative) {
+    if (offset / 4 + 1 > globalWords) globalWords = offset / 4 + 1;
+    sprintf(buf, "g%d", offset / 4);
+  } else if (offset > 0) {
+    if (offset / 4 > numParams) numParams = offset / 4;
+    sprintf(buf, "a%d", offset / 4 - 1);
+  } else {
+    sprintf(buf, "l%d", (-offset - 8) / 4);
+  }
+  return buf;
+}
+
+/* Method: FunctionFor
+ * -------------------
+ * Returns the entry for the function with the given label, creating
+ * it on first reference (calls and vtables may come before the body).
+ */
+int CTarget::FunctionFor(const char *label)
+{
+  map<string, int>::iterator it = functionIndex.find(label);
+  if (it != functionIndex.end()) return it->second;
+
+  Function f;
+  char buf[32];
+  sprintf(buf, "F%d_", (int)functions.size());
+  f.name = buf;
+  for (const char *p = label; *p; p++)
+    f.name += (isalnum(*p) || *p == '_') ? *p : '_';
+  f.frameSize = f.argSlots = 0;
+  f.defined = false;
+  functions.push_back(f);
+  return functionIndex[label] = functions.size() - 1;
+}
+
+void CTarget::Line(const char *fmt, ...)
+{
+  va_list args;
+  char buf[1024];
+
+  va_start(args, fmt);
+  vsprintf(buf, fmt, args);
+  va_end(args);
+  Assert(inFunction);
+  char last = buf[strlen(buf) - 1];
+  string &body = functions[current].body;
+  if (last != ':') body += "\t";
+  body += buf;
+  body += (last == ':') ? " ;\n" : "\n";
+}
+
+
+void CTarget::EmitLoadConstant(Location *dst, int val)
+{
+  Line("%s = %d;", Var(dst).c_str(), val);
+}
+
+void CTarget::EmitLoadStringConstant(Location *dst, const char *str)
+{
+  map<string, int>::iterator it = stringIndex.find(str);
+  if (it == stringIndex.end()) {
+    it = stringIndex.insert(make_pair(string(str), (int)strings.size())).first;
+    strings.push_back(str);
+  }
+  Line("%s = s%d;", Var(dst).c_str(), it->second);
+}
+
+void CTarget::EmitLoadLabel(Location *dst, const char *label)
+{
+  string &var = dataLabels[label];
+  if (var.empty()) {
+    char buf[32];
+    sprintf(buf, "v%d", (int)dataLabels.size() - 1);
+    var = buf;
+  }
+  Line("%s = %s;", Var(dst).c_str(), var.c_str());
+}
+
+void CTarget::EmitCopy(Location *dst, Location *src)
+{
+  Line("%s = %s;", Var(dst).c_str(), Var(src).c_str());
+}
+
+void CTarget::EmitLoad(Location *dst, Location *reference, int offset)
+{
+  Line("%s = WORD(%s, %d);", Var(dst).c_str(), Var(reference).c_str(), offset);
+}
+
+void CTarget::EmitStore(Location *reference, Location *value, int offset)
+{
+  Line("WORD(%s, %d) = %s;", Var(reference).c_str(), offset, Var(value).c_str());
+}
+
+/* Method: EmitBinaryOp
+ * --------------------
+ * Add, Sub and Mul are done on unsigned values so overflow wraps as it
+ * does on the machine instead of being undefined in C.
+ */
+void CTarget::EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                           Location *op1, Location *op2)
+{
+  string d = Var(dst), a = Var(op1), b = Var(op2);
+  const char *wrapped = NULL, *op = NULL;
+  switch (code) {
+    case BinaryOp::Add:  wrapped = "+"; break;
+    case BinaryOp::Sub:  wrapped = "-"; break;
+    case BinaryOp::Mul:  wrapped = "*"; break;
+    case BinaryOp::Eq:   op = "=="; break;
+    case BinaryOp::Less: op = "<"; break;
+    case BinaryOp::And:  op = "&"; break;
+    case BinaryOp::Or:   op = "|"; break;
+    case BinaryOp::ULess:
+      Line("%s = (uint32_t)%s < (uint32_t)%s;", d.c_str(), a.c_str(), b.c_str());
+      return;
+    case BinaryOp::Div:
+    case BinaryOp::Mod:
+      Line("%s = rt_%s(%s, %s);", d.c_str(), code == BinaryOp::Div ? "Div" : "Mod",
+           a.c_str(), b.c_str());
+      return;
+    default:
+      Assert(0);
+  }
+  if (wrapped)
+    Line("%s = (int32_t)((uint32_t)%s %s (uint32_t)%s);", d.c_str(), a.c_str(),
+         wrapped, b.c_str());
+  else
+    Line("%s = %s %s %s;", d.c_str(), a.c_str(), op, b.c_str());
+}
+
+
+/* Method: EmitLabel
+ * -----------------
+ * A label outside a function names the function that follows; inside
+ * one it is a branch target.
+ */
+void CTarget::EmitLabel(const char *label)
+{
+  if (inFunction) Line("%s:", label);
+  else functionLabel = label;
+}
+
+void CTarget::EmitGoto(const char *label)
+{
+  Line("goto %s;", label);
+}
+
+void CTarget::EmitIfZ(Location *test, const char *label)
+{
+  Line("if (!%s) goto %s;", Var(test).c_str(), label);
+}
+
+void CTarget::EmitReturn(Location *returnVal)
+{
+  Line("return %s;", returnVal ? Var(returnVal).c_str() : "0");
+}
+
+void CTarget::EmitBeginFunction(int frameSize)
+{
+  Assert(frameSize >= 0);
+  current = FunctionFor(functionLabel.c_str());
+  functions[current].defined = true;
+  functions[current].frameSize = frameSize;
+  depth = 0;
+  inFunction = true;
+}
+
+void CTarget::EmitEndFunction()
+{
+  Line("return 0;");
+  inFunction = false;
+}
+
+
+/* Method: EmitParam
+ * -----------------
+ * Arguments are copied into pN, N being the number of params pushed
+ * and not yet popped. A call knows how many of them are its own only
+ * at the PopParams that follows it, since the arguments of a nested
+ * call may be pushed in between.
+ */
+void CTarget::EmitParam(Location *arg)
+{
+  Function &f = functions[current];
+  Line("p%d = %s;", depth++, Var(arg).c_str());
+  if (depth > f.argSlots) f.argSlots = depth;
+}
+
+void CTarget::EmitCall(Location *result, const string &callee, bool builtIn)
+{
+  Call call;
+  call.callee = callee;
+  call.builtIn = builtIn;
+  char mark[32];
+  sprintf(mark, "%c%d%c", CallMark, (int)calls.size(), CallMark);
+  calls.push_back(call);
+  if (result) Line("%s = %s;", Var(result).c_str(), mark);
+  else Line("%s;", mark);
+}
+
+void CTarget::EmitLCall(Location *result, const char *label)
+{
+  if (CodeGenerator::BuiltInForLabel(label) != NumBuiltIns)
+    EmitCall(result, string("rt") + label, true);
+  else
+    EmitCall(result, functions[FunctionFor(label)].name, false);
+}
+
+void CTarget::EmitACall(Location *result, Location *fnAddr)
+{
+  EmitCall(result, "functionTable[" + Var(fnAddr) + "]", false);
+}
+
+  // Params are pushed last to first, so the last one pushed is the
+  // first argument.
+void CTarget::EmitPopParams(int bytes)
+{
+  Call &call = calls.back();
+  char buf[32];
+  for (int i = 0; i < bytes / 4; i++) {
+    sprintf(buf, "p%d", depth - 1 - i);
+    call.args.push_back(buf);
+  }
+  depth -= bytes / 4;
+  if (!call.builtIn && (int)call.args.size() > numParams) numParams = call.args.size();
+}
+
+
+void CTarget::EmitVTable(const char *label, List<const char*> *methodLabels)
+{
+  char buf[32];
+  int n = methodLabels->NumElements();
+  string init = "rt_Table(";
+  sprintf(buf, "%d, ", n);
+  init += buf;
+  if (n == 0) {
+    init += "NULL)";
+  } else {
+    init += "(const int32_t[]){ ";
+    for (int i = 0; i < n; i++) {
+      sprintf(buf, "%d%s", FunctionFor(methodLabels->Nth(i)) + 1, i + 1 < n ? ", " : " })");
+      init += buf;
+    }
+  }
+  vtables[label] = init;
+}
+
+
+string CTarget::ParamList(const vector<string> &args)
+{
+  string list;
+  for (int i = 0; i < numParams; i++) {
+    if (i) list += ", ";
+    list += i < (int)args.size() ? args[i] : "0";
+  }
+  return list;
+}
+
+  // Replaces the call placeholders in a function body.
+string CTarget::Expand(const string &body)
+{
+  string out;
+  for (size_t i = 0; i < body.size(); i++) {
+    if (body[i] != CallMark) {
+      out += body[i];
+      continue;
+    }
+    size_t end = body.find(CallMark, i + 1);
+    const Call &call = calls[atoi(body.c_str() + i + 1)];
+    string args;
+    if (call.builtIn) {
+      for (size_t a = 0; a < call.args.size(); a++)
+        args += (a ? ", " : "") + call.args[a];
+    } else {
+      args = ParamList(call.args);
+    }
+    out += call.callee + "(" + args + ")";
+    i = end;
+  }
+  return out;
+}
+
+/* Method: EmitProgram
+ * -------------------
+ * Writes out the translation unit: declarations, the startup code that
+ * places strings and vtables in the arena, the functions and main.
+ */
+void CTarget::EmitProgram()
+{
+  string params = numParams ? "" : "void";
+  for (int i = 0; i < numParams; i++) {
+    char buf[32];
+    sprintf(buf, "%sint32_t a%d", i ? ", " : "", i);
+    params += buf;
+  }
+
+  printf("/* Generated by dcc -target c; build with gcc -O2 */\n");
+  printf("#include \"cruntime.h\"\n\n");
+  printf("typedef int32_t (*DecafFunction)(%s);\n\n", params.c_str());
+  for (size_t i = 0; i < functions.size(); i++)
+    printf("static int32_t %s(%s);\n", functions[i].name.c_str(), params.c_str());
+  printf("\nstatic const DecafFunction functionTable[] = {\n\t0,\n");
+  for (size_t i = 0; i < functions.size(); i++)
+    printf("\t%s,\n", functions[i].name.c_str());
+  printf("};\n\n");
+
+  for (int i = 0; i < globalWords; i++)
+    printf("static int32_t g%d;\n", i);
+  for (size_t i = 0; i < strings.size(); i++)
+    printf("static int32_t s%d;\n", (int)i);
+  for (map<string, string>::iterator it = dataLabels.begin(); it != dataLabels.end(); ++it)
+    printf("static int32_t %s;\t/* %s */\n", it->second.c_str(), it->first.c_str());
+
+  printf("\nstatic void Init(void)\n{\n");
+  for (size_t i = 0; i < strings.size(); i++)
+    printf("\ts%d = rt_String(%s);\n", (int)i, strings[i].c_str());
+  for (map<string, string>::iterator it = dataLabels.begin(); it != dataLabels.end(); ++it) {
+    if (vtables.count(it->first))
+      printf("\t%s = %s;\n", it->second.c_str(), vtables[it->first].c_str());
+    else if (functionIndex.count(it->first))
+      printf("\t%s = %d;\n", it->second.c_str(), functionIndex[it->first] + 1);
+  }
+  printf("}\n");
+
+  for (size_t i = 0; i < functions.size(); i++) {
+    const Function &f = functions[i];
+    if (!f.defined) continue;
+    printf("\nstatic int32_t %s(%s)\n{\n", f.name.c_str(), params.c_str());
+    for (int n = 0; n < f.frameSize / 4; n++)
+      printf("%sl%d = 0%s", n ? ", " : "\tint32_t ", n, n + 1 < f.frameSize / 4 ? "" : ";\n");
+    for (int n = 0; n < f.argSlots; n++)
+      printf("%sp%d%s", n ? ", " : "\tint32_t ", n, n + 1 < f.argSlots ? "" : ";\n");
+    printf("%s}\n", Expand(f.body).c_str());
+  }
+
+  map<string, int>::iterator main = functionIndex.find("main");
+  if (main != functionIndex.end() && functions[main->second].defined) {
+    vector<string> none;
+    printf("\nint main(void)\n{\n\tInit();\n\t%s(%s);\n\tfflush(stdout);\n\treturn 0;\n}\n",
+           functions[main->second].name.c_str(), ParamList(none).c_str());
+  }
+}
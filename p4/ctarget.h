@@ -0,0 +1,108 @@
+/* File: ctarget.h
+ * ---------------
+ * The CTarget class translates the Tac list into one C translation
+ * unit (dcc -target c), leaving the machine-specific work to the host
+ * C compiler:
+ *
+ *     dcc -target c < prog.decaf > prog.c
+ *     gcc -O2 -I<dir with cruntime.h> -o prog prog.c
+ *
+ * Each Decaf function becomes a static C function; its locals, temps
+ * and parameters become C locals and parameters (named by their frame
+ * offset) and the globals become static variables, so the C compiler
+ * is free to keep all of them in registers.
+ *
+ * Memory keeps the Tac layout: objects and arrays live in the byte
+ * arena of the runtime (cruntime.h) and a Decaf pointer is a 32-bit
+ * offset into it. String constants and vtables are copied into the
+ * arena on startup. A vtable entry is an index into the table of
+ * function pointers the output defines, so method calls go through
+ * that table. All functions take the same number of int32_t
+ * parameters (the most any call or function uses), and calls pass
+ * zeros for the ones they don't need, which makes every function
+ * callable through one pointer type.
+ *
+ * Since that count is known only at the end, the translation is
+ * collected as it comes in and written out by EmitProgram.
+ */
+
+#ifndef _H_ctarget
+#define _H_ctarget
+
+#include "tac.h"
+#include "list.h"
+#include "backend.h"
+#include <map>
+#include <string>
+#include <vector>
+using std::map;
+using std::string;
+using std::vector;
+class Location;
+
+
+class CTarget : public Backend {
+  private:
+    struct Function {
+        string name, body;
+        int frameSize, argSlots;
+        bool defined;
+    };
+    struct Call {                  // completed once the parameter count is known
+        string callee;
+        vector<string> args;
+        bool builtIn;              // passed exactly its own args
+    };
+
+    vector<Function> functions;
+    map<string, int> functionIndex;   // label -> entry in functions
+    map<string, string> dataLabels;   // label -> variable holding its address
+    map<string, string> vtables;      // label -> initializer run at startup
+    vector<string> strings;
+    map<string, int> stringIndex;     // literal -> its entry in strings
+    vector<Call> calls;
+    int numParams, globalWords;
+    int current;                      // function being translated
+    int depth;                        // params pushed and not yet popped
+    bool inFunction;
+    string functionLabel;
+
+    string Var(Location *var);
+    int FunctionFor(const char *label);
+    void Line(const char *fmt, ...);
+    void EmitCall(Location *result, const string &callee, bool builtIn);
+    string ParamList(const vector<string> &args);
+    string Expand(const string &body);
+
+ public:
+    CTarget();
+
+    void EmitLoadConstant(Location *dst, int val);
+    void EmitLoadStringConstant(Location *dst, const char *str);
+    void EmitLoadLabel(Location *dst, const char *label);
+
+    void EmitLoad(Location *dst, Location *reference, int offset);
+    void EmitStore(Location *reference, Location *value, int offset);
+    void EmitCopy(Location *dst, Location *src);
+
+    void EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+			    Location *op1, Location *op2);
+
+    void EmitLabel(const char *label);
+    void EmitGoto(const char *label);
+    void EmitIfZ(Location *test, const char*label);
+    void EmitReturn(Location *returnVal);
+
+    void EmitBeginFunction(int frameSize);
+    void EmitEndFunction();
+
+    void EmitParam(Location *arg);
+    void EmitLCall(Location *result, const char* label);
+    void EmitACall(Location *result, Location *fnAddr);
+    void EmitPopParams(int bytes);
+
+    void EmitVTable(const char *label, List<const char*> *methodLabels);
+
+    void EmitProgram();
+};
+#endif
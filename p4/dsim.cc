@@ -0,0 +1,135 @@
+/* File: dsim.cc
+ * -------------
+ * This file defines the main() routine for dsim, the MIPS simulator
+ * used to run the assembly dcc produces. It takes the same -file
+ * argument as spim, so it can be swapped in for it in the scripts:
+ *
+ *     dsim [-stats] [-translate | -timing [options]] [-profile file] [-file] program.s
+ *
+ * With -stats, the number of instructions executed is reported on
+ * stderr when the program stops. -timing runs the program under the
+ * pipeline and cache model (see mipstiming.h) and reports estimated
+ * cycles, CPI and miss rates per function on stderr. The model is
+ * configured with
+ *
+ *     -icache size:assoc:line    -dcache size:assoc:line
+ *     -miss-penalty cycles       -branch-penalty cycles
+ *     -syscall-penalty cycles
+ *
+ * (for example -dcache 16k:4:32), each of which implies -timing.
+ * -profile file also implies it, and writes the counts the model keeps
+ * to file when the program stops: the edge profile dcc -profile uses
+ * to lay out its blocks.
+ * -translate runs hot code as translated x86-64 instead (see
+ * mipsdbt.h); it gives the same results, only faster, and cannot be
+ * combined with -timing.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "mipsasm.h"
+#include "mipssim.h"
+#include "mipstiming.h"
+#include "mipsdbt.h"
+
+
+static int Usage()
+{
+    fprintf(stderr, "Usage:   dsim [-stats] [-translate | -timing] [-icache size:assoc:line] "
+            "[-dcache size:assoc:line]\n"
+            "              [-miss-penalty n] [-branch-penalty n]\n"
+            "              [-syscall-penalty n] [-profile file] [-file] program.s\n");
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *file = NULL, *profile = NULL;
+    bool stats = false, timed = false, translate = false;
+    TimingConfig config;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i], *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(arg, "-stats") == 0) {
+            stats = true;
+        } else if (strcmp(arg, "-timing") == 0) {
+            timed = true;
+        } else if (strcmp(arg, "-translate") == 0) {
+            translate = true;
+        } else if (strcmp(arg, "-icache") == 0 || strcmp(arg, "-dcache") == 0) {
+            bool ok = value && (arg[1] == 'i' ?
+                TimingConfig::ParseCache(value, config.icacheSize, config.icacheAssoc,
+                                         config.icacheLine) :
+                TimingConfig::ParseCache(value, config.dcacheSize, config.dcacheAssoc,
+                                         config.dcacheLine));
+            if (!ok) {
+                fprintf(stderr, "dsim: bad cache description for %s (expected "
+                        "size:assoc:line, powers of two)\n", arg);
+                return 2;
+            }
+            timed = true;
+            i++;
+        } else if (strcmp(arg, "-miss-penalty") == 0 || strcmp(arg, "-branch-penalty") == 0 ||
+                   strcmp(arg, "-syscall-penalty") == 0) {
+            if (!value || atoi(value) < 0) return Usage();
+            if (arg[1] == 'm') config.missPenalty = atoi(value);
+            else if (arg[1] == 'b') config.branchPenalty = atoi(value);
+            else config.syscallPenalty = atoi(value);
+            timed = true;
+            i++;
+        } else if (strcmp(arg, "-profile") == 0) {
+            if (!value) return Usage();
+            profile = value;
+            timed = true;
+            i++;
+        } else if (strcmp(arg, "-file") == 0) {
+            continue;
+        } else if (arg[0] != '-' && !file) {
+            file = arg;
+        } else {
+            return Usage();
+        }
+    }
+    if (!file || (timed && translate)) return Usage();
+    if (translate && !Translator::HostSupported()) {
+        fprintf(stderr, "dsim: -translate needs an x86-64 host, interpreting instead\n");
+        translate = false;
+    }
+    FILE *in = fopen(file, "r");
+    if (!in) {
+        fprintf(stderr, "dsim: cannot open '%s'\n", file);
+        return 2;
+    }
+
+    MipsProgram program;
+    Assembler assembler;
+    bool ok = assembler.Assemble(in, &program);
+    fclose(in);
+    if (!ok) return 1;
+
+    Simulator sim(&program);
+    TimingModel *timing = timed ? new TimingModel(config, &program) : NULL;
+    sim.SetTiming(timing);
+    if (translate) sim.EnableTranslation();
+    ok = sim.Run();
+    if (stats)
+        fprintf(stderr, "dsim: %lld instructions executed\n", sim.InstructionsExecuted());
+    if (stats && translate)
+        fprintf(stderr, "dsim: %lld blocks translated, %lld cache flushes\n",
+                sim.GetTranslator()->BlocksTranslated(), sim.GetTranslator()->CacheFlushes());
+    if (profile) {
+        FILE *out = fopen(profile, "w");
+        if (!out) {
+            fprintf(stderr, "dsim: cannot write profile '%s'\n", profile);
+            return 2;
+        }
+        timing->WriteProfile(out);
+        fclose(out);
+    }
+    if (timing) {
+        timing->Report(stderr);
+        delete timing;
+    }
+    return ok ? 0 : 1;
+}
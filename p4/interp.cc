@@ -0,0 +1,593 @@
+/* File: interp.cc
+ * ---------------
+ * Implementation of the Tac interpreter. See interp.h for an overview
+ * of how a program is loaded, laid out in memory and profiled.
+ */
+
+#include "interp.h"
+#include <stdarg.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+using std::string;
+
+  // Memory map for the interpreted program. Address 0 up to DataBase
+  // is left unmapped so null dereferences are caught. The data image
+  // (strings, vtables) is followed by the globals, then the heap which
+  // grows up toward the stack coming down from MemorySize.
+static const int MemorySize = 32 << 20;
+static const int DataBase = 0x1000;
+
+  // Code addresses (stored in vtables) are op indices tagged with a
+  // bit above MemorySize so they can never be mistaken for data.
+static const int CodeTag = 0x40000000;
+
+  // Return address stored by the startup code; returning to it ends the run.
+static const int ExitAddress = -1;
+
+const char * const Interpreter::kindName[NumOpKinds] = {
+  "LoadConstant", "LoadStringConstant", "LoadLabel", "Assign", "Load",
+  "Store", "BinaryOp", "Goto", "IfZ", "BeginFunc", "EndFunc", "Return",
+  "PushParam", "PopParams", "LCall", "ACall" };
+
+
+Interpreter::Interpreter()
+{
+  pendingLabel = NULL;
+  globalBytes = 0;
+  memory = NULL;
+  fp = sp = gp = heap = retVal = 0;
+  halted = failed = false;
+  memset(builtinCalls, 0, sizeof(builtinCalls));
+}
+
+Interpreter::~Interpreter()
+{
+  delete[] memory;
+}
+
+
+/* Method: Resolve
+ * ---------------
+ * Turns a Location into an Operand. Globals also bump the size of
+ * the global segment, since nothing else records how big it is.
+ */
+Interpreter::Operand Interpreter::Resolve(Location *loc)
+{
+  Operand o = { false, false, 0 };
+  if (loc) {
+    o.isValid = true;
+    o.isGlobal = (loc->GetSegment() == gpRelative);
+    o.offset = loc->GetOffset();
+    Assert(o.offset % 4 == 0);
+    if (o.isGlobal && o.offset + 4 > globalBytes)
+      globalBytes = o.offset + 4;
+  }
+  return o;
+}
+
+Interpreter::Op &Interpreter::Append(OpKind kind)
+{
+  Op op;
+  memset(&op, 0, sizeof(op));
+  op.kind = kind;
+  op.target = -1;
+  op.function = (int)functions.size() - 1;
+  ops.push_back(op);
+  return ops.back();
+}
+
+
+void Interpreter::EmitLoadConstant(Location *dst, int val)
+{
+  Op &op = Append(OpLoadConstant);
+  op.dst = Resolve(dst);
+  op.imm = val;
+}
+
+/* Method: EmitLoadStringConstant
+ * ------------------------------
+ * Copies the string into the data image, interpreting the same
+ * backslash escapes the assembler would for an .asciiz directive.
+ * The op then just loads the address of that copy, which identical
+ * literals share.
+ */
+void Interpreter::EmitLoadStringConstant(Location *dst, const char *str)
+{
+  Op &op = Append(OpLoadStringConstant);
+  op.dst = Resolve(dst);
+  int &addr = strings[str];
+  if (addr) {
+    op.imm = addr;
+    return;
+  }
+  addr = op.imm = DataBase + data.size();
+  const char *s = (*str == '"') ? str + 1 : str;
+  const char *end = str + strlen(str);
+  if (end > s && end[-1] == '"') end--;
+  for (; s < end; s++) {
+    char ch = *s;
+    if (ch == '\\' && s + 1 < end) {
+      switch (*++s) {
+        case 'n': ch = '\n'; break;
+        case 't': ch = '\t'; break;
+        default:  ch = *s;   break;
+      }
+    }
+    data.push_back(ch);
+  }
+  data.push_back('\0');
+  while (data.size() % 4) data.push_back('\0');
+}
+
+void Interpreter::EmitLoadLabel(Location *dst, const char *label)
+{
+  Op &op = Append(OpLoadLabel);
+  op.dst = Resolve(dst);
+  op.label = label;
+}
+
+void Interpreter::EmitLoad(Location *dst, Location *reference, int offset)
+{
+  Op &op = Append(OpLoad);
+  op.dst = Resolve(dst);
+  op.src1 = Resolve(reference);
+  op.imm = offset;
+}
+
+void Interpreter::EmitStore(Location *reference, Location *value, int offset)
+{
+  Op &op = Append(OpStore);
+  op.src1 = Resolve(reference);
+  op.src2 = Resolve(value);
+  op.imm = offset;
+}
+
+void Interpreter::EmitCopy(Location *dst, Location *src)
+{
+  Op &op = Append(OpAssign);
+  op.dst = Resolve(dst);
+  op.src1 = Resolve(src);
+}
+
+void Interpreter::EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                               Location *op1, Location *op2)
+{
+  Op &op = Append(OpBinaryOp);
+  op.code = code;
+  op.dst = Resolve(dst);
+  op.src1 = Resolve(op1);
+  op.src2 = Resolve(op2);
+}
+
+/* Method: EmitLabel
+ * -----------------
+ * Labels produce no op, they are bound to the index of whatever op
+ * comes next. A label directly followed by BeginFunc names a function.
+ */
+void Interpreter::EmitLabel(const char *label)
+{
+  codeLabels[label] = ops.size();
+  pendingLabel = label;
+}
+
+void Interpreter::EmitGoto(const char *label)
+{
+  Op &op = Append(OpGoto);
+  op.label = label;
+}
+
+void Interpreter::EmitIfZ(Location *test, const char *label)
+{
+  Op &op = Append(OpIfZ);
+  op.src1 = Resolve(test);
+  op.label = label;
+}
+
+void Interpreter::EmitReturn(Location *returnVal)
+{
+  Op &op = Append(OpReturn);
+  op.src1 = Resolve(returnVal);
+}
+
+void Interpreter::EmitBeginFunction(int frameSize)
+{
+  Assert(frameSize >= 0);
+  Function f = { pendingLabel ? pendingLabel : "(anonymous)", 0 };
+  functions.push_back(f);
+  Op &op = Append(OpBeginFunc);
+  op.imm = frameSize;
+}
+
+void Interpreter::EmitEndFunction()
+{
+  Append(OpEndFunc);
+}
+
+void Interpreter::EmitParam(Location *arg)
+{
+  Op &op = Append(OpPushParam);
+  op.src1 = Resolve(arg);
+}
+
+void Interpreter::EmitLCall(Location *result, const char *label)
+{
+  Op &op = Append(OpLCall);
+  op.dst = Resolve(result);
+  op.label = label;
+  op.code = CodeGenerator::BuiltInForLabel(label);
+}
+
+void Interpreter::EmitACall(Location *result, Location *fnAddr)
+{
+  Op &op = Append(OpACall);
+  op.dst = Resolve(result);
+  op.src1 = Resolve(fnAddr);
+}
+
+void Interpreter::EmitPopParams(int bytes)
+{
+  Op &op = Append(OpPopParams);
+  op.imm = bytes;
+}
+
+/* Method: EmitVTable
+ * ------------------
+ * Lays out one word per method in the data image. The method labels
+ * may not have been seen yet, so the slots are patched in Link.
+ */
+void Interpreter::EmitVTable(const char *label, List<const char*> *methodLabels)
+{
+  dataLabels[label] = data.size();
+  for (int i = 0; i < methodLabels->NumElements(); i++) {
+    dataFixups.push_back(make_pair((int)data.size(), methodLabels->Nth(i)));
+    data.resize(data.size() + 4, 0);
+  }
+}
+
+
+int Interpreter::CodeAddress(int opIndex)
+{
+  return CodeTag | opIndex;
+}
+
+int Interpreter::AddressForLabel(const char *label)
+{
+  map<string, int>::iterator d = dataLabels.find(label);
+  if (d != dataLabels.end()) return DataBase + d->second;
+  map<string, int>::iterator c = codeLabels.find(label);
+  if (c == codeLabels.end())
+    Failure("Interpreter: reference to undefined label '%s'", label);
+  return CodeAddress(c->second);
+}
+
+/* Method: Link
+ * ------------
+ * Resolves every label reference now that the whole program is
+ * loaded: branch and call targets become op indices, LoadLabel
+ * becomes a constant address, and vtable slots get code addresses.
+ */
+void Interpreter::Link()
+{
+  for (size_t i = 0; i < ops.size(); i++) {
+    Op &op = ops[i];
+    switch (op.kind) {
+      case OpGoto: case OpIfZ:
+        op.target = codeLabels.count(op.label) ? codeLabels[op.label] : -1;
+        if (op.target < 0)
+          Failure("Interpreter: branch to undefined label '%s'", op.label);
+        break;
+      case OpLCall:
+        if (op.code != NumBuiltIns) break;
+        op.target = codeLabels.count(op.label) ? codeLabels[op.label] : -1;
+        if (op.target < 0)
+          Failure("Interpreter: call to undefined function '%s'", op.label);
+        break;
+      case OpLoadLabel:
+        op.imm = AddressForLabel(op.label);
+        break;
+      default:
+        break;
+    }
+  }
+  for (size_t i = 0; i < dataFixups.size(); i++) {
+    int addr = AddressForLabel(dataFixups[i].second);
+    memcpy(&data[dataFixups[i].first], &addr, 4);
+  }
+}
+
+void Interpreter::Load(List<Instruction*> *code)
+{
+  for (int i = 0; i < code->NumElements(); i++) {
+    code->Nth(i)->EmitSpecific(this);
+    if (!dynamic_cast<Label*>(code->Nth(i))) pendingLabel = NULL;
+  }
+  Link();
+  counts.assign(ops.size(), 0);
+}
+
+
+void Interpreter::RuntimeError(const char *fmt, ...)
+{
+  va_list args;
+  fflush(stdout);
+  fprintf(stderr, "*** Interpreter: ");
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+  fprintf(stderr, "\n");
+  halted = failed = true;
+}
+
+/* Method: Word
+ * ------------
+ * Returns a reference to the word at addr, reporting bad or misaligned
+ * accesses. On error a scratch word is returned so the caller can carry
+ * on; the run loop stops as soon as it sees halted.
+ */
+int &Interpreter::Word(int addr)
+{
+  static int scratch;
+  if (addr < DataBase || addr > MemorySize - 4 || (addr & 3)) {
+    RuntimeError("invalid memory access at address 0x%08x", addr);
+    return scratch = 0;
+  }
+  return *(int *)(memory + addr);
+}
+
+const char *Interpreter::String(int addr)
+{
+  if (addr < DataBase || addr >= MemorySize ||
+      !memchr(memory + addr, '\0', MemorySize - addr)) {
+    RuntimeError("invalid string address 0x%08x", addr);
+    return "";
+  }
+  return (const char *)memory + addr;
+}
+
+int Interpreter::HeapAlloc(int bytes)
+{
+  int addr = heap;
+  if (bytes < 0 || heap + ((bytes + 3) & ~3) > sp - (1 << 20)) {
+    RuntimeError("out of heap memory allocating %d bytes", bytes);
+    return 0;
+  }
+  heap += (bytes + 3) & ~3;
+  return addr;
+}
+
+/* Method: CallBuiltIn
+ * -------------------
+ * Executes one of the runtime routines. Arguments were pushed just
+ * like for any other call, so the first is at sp+4 and the second at
+ * sp+8. The behavior matches the MIPS versions emitted by Mips.
+ */
+void Interpreter::CallBuiltIn(BuiltIn b, Op &call)
+{
+  char line[256];
+  int result = 0;
+  builtinCalls[b]++;
+  switch (b) {
+    case Alloc:
+      result = HeapAlloc(Word(sp + 4));
+      break;
+    case ReadLine: {         // any length, without its newline, as _ReadLine
+      string text;
+      fflush(stdout);
+      for (int c; (c = getchar()) != EOF && c != '\n'; ) text += (char)c;
+      result = HeapAlloc(text.size() + 1);
+      if (halted) return;
+      memcpy(memory + result, text.c_str(), text.size() + 1);
+      break;
+    }
+    case ReadInteger:
+      fflush(stdout);
+      result = fgets(line, sizeof(line), stdin) ? strtol(line, NULL, 10) : 0;
+      break;
+    case StringEqual:
+      result = !strcmp(String(Word(sp + 4)), String(Word(sp + 8)));
+      break;
+    case PrintInt:
+      printf("%d", Word(sp + 4));
+      break;
+    case PrintString:
+      fputs(String(Word(sp + 4)), stdout);
+      break;
+    case PrintBool:
+      fputs(Word(sp + 4) > 0 ? "true" : "false", stdout);
+      break;
+    case Halt:
+      halted = true;
+      break;
+    default:
+      Assert(0);
+  }
+  if (call.dst.isValid) Var(call.dst) = result;
+}
+
+/* Method: Run
+ * -----------
+ * The main execution loop. Calls save the op index of the call in ra;
+ * BeginFunc stores it in the frame exactly where the MIPS prologue
+ * saves $ra, and a return resumes after that call, first copying the
+ * return value into the call's result if it has one.
+ */
+bool Interpreter::Run()
+{
+  map<string, int>::iterator m = codeLabels.find("main");
+  if (m == codeLabels.end()) return false;
+
+  memory = new unsigned char[MemorySize]();
+  memcpy(memory + DataBase, &data[0], data.size());
+  gp = (DataBase + data.size() + 7) & ~7;
+  heap = gp + ((globalBytes + 7) & ~7);
+  sp = fp = MemorySize - 8;
+
+  int ra = ExitAddress;
+  int pc = m->second;
+  while (!halted) {
+    Op &op = ops[pc];
+    counts[pc]++;
+    pc++;
+    switch (op.kind) {
+      case OpLoadConstant:
+      case OpLoadStringConstant:
+      case OpLoadLabel:
+        Var(op.dst) = op.imm;
+        break;
+      case OpAssign:
+        Var(op.dst) = Var(op.src1);
+        break;
+      case OpLoad:
+        Var(op.dst) = Word(Var(op.src1) + op.imm);
+        break;
+      case OpStore:
+        Word(Var(op.src1) + op.imm) = Var(op.src2);
+        break;
+      case OpBinaryOp: {
+        unsigned a = Var(op.src1), b = Var(op.src2);
+        int r = 0;
+        switch (op.code) {
+          case BinaryOp::Add:  r = a + b; break;
+          case BinaryOp::Sub:  r = a - b; break;
+          case BinaryOp::Mul:  r = a * b; break;
+          case BinaryOp::Div:
+          case BinaryOp::Mod:
+            if (b == 0) { RuntimeError("division by zero"); break; }
+            if ((int)a == (int)0x80000000 && (int)b == -1)
+              r = (op.code == BinaryOp::Div) ? (int)a : 0;
+            else
+              r = (op.code == BinaryOp::Div) ? (int)a / (int)b : (int)a % (int)b;
+            break;
+          case BinaryOp::Eq:   r = (a == b); break;
+          case BinaryOp::Less: r = ((int)a < (int)b); break;
+          case BinaryOp::ULess: r = (a < b); break;
+          case BinaryOp::And:  r = a & b; break;
+          case BinaryOp::Or:   r = a | b; break;
+          default: Assert(0);
+        }
+        Var(op.dst) = r;
+        break;
+      }
+      case OpGoto:
+        pc = op.target;
+        break;
+      case OpIfZ:
+        if (Var(op.src1) == 0) pc = op.target;
+        break;
+      case OpBeginFunc:
+        functions[op.function].calls++;
+        sp -= 8;
+        Word(sp + 8) = fp;
+        Word(sp + 4) = ra;
+        fp = sp + 8;
+        sp -= op.imm;
+        if (sp <= heap) RuntimeError("stack overflow");
+        break;
+      case OpReturn:
+      case OpEndFunc:
+        if (op.src1.isValid) retVal = Var(op.src1);
+        sp = fp;
+        ra = Word(fp - 4);
+        fp = Word(fp);
+        if (ra == ExitAddress) { halted = true; break; }
+        if (ops[ra].dst.isValid) Var(ops[ra].dst) = retVal;
+        pc = ra + 1;
+        break;
+      case OpPushParam:
+        sp -= 4;
+        Word(sp + 4) = Var(op.src1);
+        break;
+      case OpPopParams:
+        sp += op.imm;
+        break;
+      case OpLCall:
+        if (op.code != NumBuiltIns) {
+          CallBuiltIn((BuiltIn)op.code, op);
+        } else {
+          ra = pc - 1;
+          pc = op.target;
+        }
+        break;
+      case OpACall: {
+        int addr = Var(op.src1);
+        int target = addr & ~CodeTag;
+        if (!(addr & CodeTag) || target < 0 || target >= (int)ops.size() ||
+            ops[target].kind != OpBeginFunc) {
+          RuntimeError("call through invalid function address 0x%08x", addr);
+          break;
+        }
+        ra = pc - 1;
+        pc = target;
+        break;
+      }
+      default:
+        Assert(0);
+    }
+  }
+  fflush(stdout);
+  if (!IsDebugOn("noprofile")) PrintProfile();
+  return !failed;
+}
+
+
+static bool ByCountDescending(const pair<long long, string> &a,
+                              const pair<long long, string> &b)
+{
+  return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+/* Method: PrintProfile
+ * --------------------
+ * Aggregates the per-op counters by function and by opcode (binary
+ * ops are broken down by operator) and writes the report to stderr.
+ */
+void Interpreter::PrintProfile()
+{
+  vector<long long> perFunction(functions.size(), 0);
+  map<string, long long> perOpcode;
+  long long total = 0, calls = 0;
+
+  for (size_t i = 0; i < ops.size(); i++) {
+    if (!counts[i]) continue;
+    total += counts[i];
+    if (ops[i].function >= 0) perFunction[ops[i].function] += counts[i];
+    string name = kindName[ops[i].kind];
+    if (ops[i].kind == OpBinaryOp)
+      name = name + " " + BinaryOp::opName[ops[i].code];
+    perOpcode[name] += counts[i];
+  }
+
+  for (size_t i = 0; i < functions.size(); i++) calls += functions[i].calls;
+  for (int b = 0; b < NumBuiltIns; b++) calls += builtinCalls[b];
+
+  vector<pair<long long, string> > rows;
+  map<string, long long> callsByName;
+  for (size_t i = 0; i < functions.size(); i++) {
+    rows.push_back(make_pair(perFunction[i], string(functions[i].name)));
+    callsByName[functions[i].name] = functions[i].calls;
+  }
+  sort(rows.begin(), rows.end(), ByCountDescending);
+
+  fprintf(stderr, "\n*** Tac profile: %lld instructions, %lld calls\n", total, calls);
+  fprintf(stderr, "%-32s %10s %14s %7s\n", "function", "calls", "instructions", "%");
+  for (size_t i = 0; i < rows.size(); i++) {
+    long long fnCalls = callsByName[rows[i].second];
+    if (!fnCalls) continue;
+    fprintf(stderr, "%-32s %10lld %14lld %6.1f%%\n", rows[i].second.c_str(),
+            fnCalls, rows[i].first, total ? 100.0 * rows[i].first / total : 0.0);
+  }
+  for (int b = 0; b < NumBuiltIns; b++)
+    if (builtinCalls[b])
+      fprintf(stderr, "%-32s %10lld %14s\n",
+              CodeGenerator::LabelForBuiltIn((BuiltIn)b), builtinCalls[b], "(builtin)");
+
+  rows.clear();
+  for (map<string, long long>::iterator i = perOpcode.begin(); i != perOpcode.end(); i++)
+    rows.push_back(make_pair(i->second, i->first));
+  sort(rows.begin(), rows.end(), ByCountDescending);
+  fprintf(stderr, "%-32s %10s %14s %7s\n", "opcode", "", "count", "%");
+  for (size_t i = 0; i < rows.size(); i++)
+    fprintf(stderr, "%-32s %10s %14lld %6.1f%%\n", rows[i].second.c_str(), "",
+            rows[i].first, total ? 100.0 * rows[i].first / total : 0.0);
+}
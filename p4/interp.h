@@ -0,0 +1,139 @@
+/* File: interp.h
+ * --------------
+ * The Interpreter class executes the Tac instruction list directly,
+ * without translating to MIPS and handing the result to a simulator.
+ * It is selected with -d interp and is meant as a quick oracle for
+ * testing the Tac produced by the code generator.
+ *
+ * Loading: the interpreter is a Backend, so the instruction list is
+ * walked once via EmitSpecific and each instruction is turned into a
+ * compact Op with its operands already resolved to segment/offset
+ * pairs. Labels are bound to op indices, vtables and string constants
+ * are laid out in a data image, and branch/call targets are patched
+ * once the whole list has been seen.
+ *
+ * Execution: memory is a flat byte array addressed with 32-bit
+ * values. Frames follow the same layout the MIPS code uses (saved fp
+ * at fp+0, saved ra at fp-4, params from fp+4 up, locals from fp-8
+ * down), so Locations can be used unchanged. The built-in functions
+ * (_Alloc, _PrintInt, _ReadLine, ...) are implemented natively.
+ *
+ * Profiling: every executed op is counted. When the program stops, a
+ * report with the dynamic instruction count per function and per Tac
+ * opcode is written to stderr, so it does not mix with program output.
+ * -d noprofile leaves it out, for check.sh, which compares stdout and
+ * stderr together against the samples.
+ */
+
+#ifndef _H_interp
+#define _H_interp
+
+#include "backend.h"
+#include "codegen.h"
+#include "list.h"
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+class Interpreter : public Backend {
+  private:
+    typedef enum { OpLoadConstant, OpLoadStringConstant, OpLoadLabel,
+                   OpAssign, OpLoad, OpStore, OpBinaryOp, OpGoto, OpIfZ,
+                   OpBeginFunc, OpEndFunc, OpReturn, OpPushParam,
+                   OpPopParams, OpLCall, OpACall, NumOpKinds } OpKind;
+
+    static const char * const kindName[NumOpKinds];
+
+      // An operand is a Location resolved to base register and offset.
+      // Absent operands (a Return without a value, a call whose result
+      // is discarded) have isValid false.
+    struct Operand {
+        bool isValid, isGlobal;
+        int offset;
+    };
+
+    struct Op {
+        OpKind kind;
+        int code;               // BinaryOp opcode or BuiltIn for LCall
+        Operand dst, src1, src2;
+        int imm;                // constant, offset, frame size, bytes
+        int target;             // resolved op index for branches/calls
+        const char *label;      // unresolved label name, if any
+        int function;           // index into functions, for profiling
+    };
+
+    struct Function {
+        const char *name;
+        long long calls;
+    };
+
+    vector<Op> ops;
+    vector<Function> functions;
+    map<string, int> codeLabels;   // label -> op index
+    map<string, int> dataLabels;   // label -> offset into data image
+    map<string, int> strings;      // literal -> its address
+    vector<unsigned char> data;
+    vector<pair<int, const char*> > dataFixups; // vtable slots to patch
+    const char *pendingLabel;      // last label seen, names next function
+    int globalBytes;
+
+    unsigned char *memory;
+    int fp, sp, gp, heap, retVal;
+    bool halted, failed;
+    vector<long long> counts;
+    long long builtinCalls[NumBuiltIns];
+
+    Operand Resolve(Location *loc);
+    Op &Append(OpKind kind);
+    int CodeAddress(int opIndex);
+    int AddressForLabel(const char *label);
+    void Link();
+
+    int &Word(int addr);
+    int &Var(const Operand &o) { return Word((o.isGlobal? gp : fp) + o.offset); }
+    const char *String(int addr);
+    int HeapAlloc(int bytes);
+    void CallBuiltIn(BuiltIn b, Op &call);
+    void RuntimeError(const char *fmt, ...);
+    void PrintProfile();
+
+  public:
+    Interpreter();
+    ~Interpreter();
+
+      // Walks the instruction list and builds the executable form.
+    void Load(List<Instruction*> *code);
+
+      // Runs the loaded program starting at main. Returns false if the
+      // program stopped on a runtime error.
+    bool Run();
+
+    void EmitLoadConstant(Location *dst, int val);
+    void EmitLoadStringConstant(Location *dst, const char *str);
+    void EmitLoadLabel(Location *dst, const char *label);
+
+    void EmitLoad(Location *dst, Location *reference, int offset);
+    void EmitStore(Location *reference, Location *value, int offset);
+    void EmitCopy(Location *dst, Location *src);
+
+    void EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                      Location *op1, Location *op2);
+
+    void EmitLabel(const char *label);
+    void EmitGoto(const char *label);
+    void EmitIfZ(Location *test, const char *label);
+    void EmitReturn(Location *returnVal);
+
+    void EmitBeginFunction(int frameSize);
+    void EmitEndFunction();
+
+    void EmitParam(Location *arg);
+    void EmitLCall(Location *result, const char *label);
+    void EmitACall(Location *result, Location *fnAddr);
+    void EmitPopParams(int bytes);
+
+    void EmitVTable(const char *label, List<const char*> *methodLabels);
+};
+
+#endif
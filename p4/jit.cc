@@ -0,0 +1,405 @@
+/* File: jit.cc
+ * ------------
+ * Implementation of the Jit class. See jit.h for the overall design
+ * and x86.cc for the assembly the encoded instructions correspond to.
+ */
+
+#include "jit.h"
+#include "utility.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#if defined(__x86_64__) && defined(MAP_32BIT)
+#define JIT_HOST 1
+#else
+#define JIT_HOST 0
+#define MAP_32BIT 0
+#endif
+
+
+/* The built-ins
+ * -------------
+ * Host versions of the runtime functions, with the semantics of the
+ * MIPS ones (see x86rt.c, which these mirror). Decaf pointers are
+ * 32-bit, so memory is handed out from chunks mapped below 4G; the
+ * Jit's own strings, vtables and globals come from the same place.
+ */
+static const size_t HeapChunk = 1 << 20;
+static char *heapNext, *heapEnd;
+
+static void Fatal(const char *message)
+{
+  fflush(stdout);
+  fprintf(stderr, "Decaf runtime error: %s\n", message);
+  exit(1);
+}
+
+static void *Map(size_t bytes, int prot)
+{
+  void *p = mmap(NULL, bytes, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+static unsigned HostAlloc(int size)
+{
+  size = (size + 3) & ~3;
+  if (size < 0) Fatal("negative allocation");
+  if (size > heapEnd - heapNext) {
+    size_t chunk = (size_t)size > HeapChunk ? (size_t)size : HeapChunk;
+    heapNext = (char *)Map(chunk, PROT_READ | PROT_WRITE);
+    if (!heapNext) Fatal("out of memory");
+    heapEnd = heapNext + chunk;
+  }
+  char *result = heapNext;
+  heapNext += size;
+  return (unsigned)(uintptr_t)result;
+}
+
+static const char *String(unsigned address)
+{
+  return (const char *)(uintptr_t)address;
+}
+
+static void HostPrintInt(int value)          { printf("%d", value); }
+static void HostPrintString(unsigned s)      { fputs(String(s), stdout); }
+static void HostPrintBool(int value)         { fputs(value > 0 ? "true" : "false", stdout); }
+static int HostStringEqual(unsigned a, unsigned b) { return !strcmp(String(a), String(b)); }
+
+static void HostHalt()
+{
+  fflush(stdout);
+  exit(0);
+}
+
+static int HostReadInteger()
+{
+  char line[256];
+  fflush(stdout);
+  return fgets(line, sizeof(line), stdin) ? (int)strtol(line, NULL, 10) : 0;
+}
+
+  // The line, without its newline, in a block that doubles when the
+  // line outgrows it, as the MIPS _ReadLine does.
+static unsigned HostReadLine()
+{
+  int size = 32, len = 0, c;
+  char *buf = (char *)(uintptr_t)HostAlloc(size);
+  fflush(stdout);
+  while ((c = getchar()) != EOF && c != '\n') {
+    if (len + 1 == size) {
+      char *bigger = (char *)(uintptr_t)HostAlloc(size *= 2);
+      memcpy(bigger, buf, len);
+      buf = bigger;
+    }
+    buf[len++] = c;
+  }
+  buf[len] = '\0';
+  return (unsigned)(uintptr_t)buf;
+}
+
+static const void *HostFunction(BuiltIn b)
+{
+  switch (b) {
+    case Alloc:       return (const void *)HostAlloc;
+    case ReadLine:    return (const void *)HostReadLine;
+    case ReadInteger: return (const void *)HostReadInteger;
+    case StringEqual: return (const void *)HostStringEqual;
+    case PrintInt:    return (const void *)HostPrintInt;
+    case PrintString: return (const void *)HostPrintString;
+    case PrintBool:   return (const void *)HostPrintBool;
+    case Halt:        return (const void *)HostHalt;
+    default:          Assert(0); return NULL;
+  }
+}
+
+
+Jit::Jit() : buffer(NULL), e(NULL), paramsPushed(0), globalBytes(0)
+{
+  if (HostSupported())
+    buffer = (unsigned char *)Map(CodeSize, PROT_READ | PROT_WRITE | PROT_EXEC);
+  if (!buffer)
+    Failure("dcc --run: cannot map memory for generated code");
+  e = new X86Encoder(buffer, CodeSize);
+}
+
+Jit::~Jit()
+{
+  delete e;
+  munmap(buffer, CodeSize);
+}
+
+bool Jit::HostSupported()
+{
+  return JIT_HOST;
+}
+
+void Jit::Load(List<Instruction*> *code)
+{
+  for (int i = 0; i < code->NumElements(); i++)
+    code->Nth(i)->EmitSpecific(this);
+}
+
+
+/* Method: Slot
+ * ------------
+ * The memory operand for a variable, as in X86::Slot: frame slots are
+ * off rbp (parameters take 8 bytes each), globals off rbx.
+ */
+X86Mem Jit::Slot(Location *var)
+{
+  int offset = var->GetOffset();
+  Assert(offset % 4 == 0); // all variables are 4 bytes
+  if (var->GetSegment() == gpRelative) {
+    if (offset + 4 > globalBytes) globalBytes = offset + 4;
+    return Mem(RBX, offset);
+  }
+  return Mem(RBP, offset > 0 ? 2 * offset + 8 : offset);
+}
+
+void Jit::Load(X86Reg reg, Location *var)  { e->Mov(reg, Slot(var)); }
+void Jit::Store(Location *var, X86Reg reg) { e->Mov(Slot(var), reg); }
+
+  // Records that the 4-byte field at offset field refers to label: as
+  // a rel32 displacement (jumps, calls) or an absolute address.
+void Jit::Refer(size_t field, const char *label, bool absolute)
+{
+  Fixup f = { field, label, absolute };
+  fixups.push_back(f);
+}
+
+
+void Jit::EmitLoadConstant(Location *dst, int val)
+{
+  e->MovImm(Slot(dst), val);
+}
+
+  // The string is copied out with the escapes an .asciiz directive
+  // would interpret (see Interpreter::EmitLoadStringConstant).
+void Jit::EmitLoadStringConstant(Location *dst, const char *str)
+{
+  unsigned &address = strings[str];     // identical literals share a copy
+  if (address) {
+    e->MovImm(Slot(dst), address);
+    return;
+  }
+  string copy;
+  const char *s = (*str == '"') ? str + 1 : str;
+  const char *end = str + strlen(str);
+  if (end > s && end[-1] == '"') end--;
+  for (; s < end; s++) {
+    char ch = *s;
+    if (ch == '\\' && s + 1 < end) {
+      switch (*++s) {
+        case 'n': ch = '\n'; break;
+        case 't': ch = '\t'; break;
+        default:  ch = *s;   break;
+      }
+    }
+    copy += ch;
+  }
+  address = HostAlloc(copy.size() + 1);
+  memcpy((char *)(uintptr_t)address, copy.c_str(), copy.size() + 1);
+  e->MovImm(Slot(dst), address);
+}
+
+void Jit::EmitLoadLabel(Location *dst, const char *label)
+{
+  e->MovImm(Slot(dst), 0);
+  Refer(e->Here() - 4, label, true);
+}
+
+void Jit::EmitCopy(Location *dst, Location *src)
+{
+  Load(RAX, src);
+  Store(dst, RAX);
+}
+
+void Jit::EmitLoad(Location *dst, Location *reference, int offset)
+{
+  Load(RAX, reference);
+  e->Mov(RAX, Mem(RAX, offset));
+  Store(dst, RAX);
+}
+
+void Jit::EmitStore(Location *reference, Location *value, int offset)
+{
+  Load(RAX, reference);
+  Load(RCX, value);
+  e->Mov(Mem(RAX, offset), RCX);
+}
+
+void Jit::EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                       Location *op1, Location *op2)
+{
+  Load(RAX, op1);
+  X86Mem right = Slot(op2);
+  switch (code) {
+    case BinaryOp::Add: e->Alu(AluAdd, RAX, right); break;
+    case BinaryOp::Sub: e->Alu(AluSub, RAX, right); break;
+    case BinaryOp::Mul: e->Imul(RAX, right); break;
+    case BinaryOp::And: e->Alu(AluAnd, RAX, right); break;
+    case BinaryOp::Or:  e->Alu(AluOr, RAX, right); break;
+    case BinaryOp::Eq:
+    case BinaryOp::Less:
+    case BinaryOp::ULess:
+      e->Alu(AluCmp, RAX, right);
+      e->Setcc(code == BinaryOp::Eq ? CondE : code == BinaryOp::Less ? CondL : CondB, RAX);
+      e->Movzx8(RAX, RAX);
+      break;
+    case BinaryOp::Div:
+    case BinaryOp::Mod: {
+      e->Mov(RCX, right);
+      e->AluImm(AluCmp, RCX, -1);
+      size_t notMinusOne = e->Jcc(CondNE);
+      if (code == BinaryOp::Div) e->Neg(RAX);
+      else e->Alu(AluXor, RAX, RAX);
+      size_t done = e->Jmp();
+      e->Patch(notMinusOne, e->Here());
+      e->Cdq();
+      e->Div(RCX, true);
+      if (code == BinaryOp::Mod) e->Mov(RAX, RDX);
+      e->Patch(done, e->Here());
+      break;
+    }
+    default:
+      Assert(0);
+  }
+  Store(dst, RAX);
+}
+
+
+void Jit::EmitLabel(const char *label)
+{
+  labels[label] = e->Here();
+}
+
+void Jit::EmitGoto(const char *label)
+{
+  Refer(e->Jmp(), label, false);
+}
+
+void Jit::EmitIfZ(Location *test, const char *label)
+{
+  e->AluImm(AluCmp, Slot(test), 0);
+  Refer(e->Jcc(CondE), label, false);
+}
+
+void Jit::EmitReturn(Location *returnVal)
+{
+  if (returnVal) Load(RAX, returnVal);
+  e->Mov(RSP, RBP, true);
+  e->Pop(RBP);
+  e->Ret();
+}
+
+void Jit::EmitBeginFunction(int frameSize)
+{
+  Assert(frameSize >= 0);
+  e->Push(RBP);
+  e->Mov(RBP, RSP, true);
+  int bytes = (frameSize + 4 + 15) & ~15;
+  if (bytes != 0) e->AluImm(AluSub, RSP, bytes, true);
+  e->AluImm(AluAnd, RSP, -16, true);
+  paramsPushed = 0;
+}
+
+void Jit::EmitEndFunction()
+{
+  EmitReturn(NULL);
+}
+
+
+void Jit::EmitParam(Location *arg)
+{
+  Load(RAX, arg);
+  e->Push(RAX);
+  paramsPushed++;
+}
+
+  // Built-ins are called as in X86::EmitLCall: arguments in edi/esi,
+  // stack aligned for the host ABI.
+void Jit::EmitLCall(Location *result, const char *label)
+{
+  BuiltIn b = CodeGenerator::BuiltInForLabel(label);
+  if (b != NumBuiltIns) {
+    X86Reg argRegs[] = { RDI, RSI };
+    for (int i = 0; i < CodeGenerator::NumArgsForBuiltIn(b); i++)
+      e->Mov(argRegs[i], Mem(RSP, 8 * i));
+    bool pad = (paramsPushed % 2 != 0);
+    if (pad) e->AluImm(AluSub, RSP, 8, true);
+    e->MovImm64(RAX, (long long)(uintptr_t)HostFunction(b));
+    e->CallReg(RAX);
+    if (pad) e->AluImm(AluAdd, RSP, 8, true);
+  } else {
+    Refer(e->Call(), label, false);
+  }
+  if (result) Store(result, RAX);
+}
+
+void Jit::EmitACall(Location *result, Location *fnAddr)
+{
+  Load(RAX, fnAddr);
+  e->CallReg(RAX);
+  if (result) Store(result, RAX);
+}
+
+void Jit::EmitPopParams(int bytes)
+{
+  if (bytes != 0) e->AluImm(AluAdd, RSP, 2 * bytes, true);
+  paramsPushed -= bytes / 4;
+}
+
+  // The table itself is placed now; its entries are filled in by Run,
+  // when the methods have their addresses.
+void Jit::EmitVTable(const char *label, List<const char*> *methodLabels)
+{
+  int n = methodLabels->NumElements();
+  unsigned address = HostAlloc(4 * n);
+  vtables[label] = address;
+  for (int i = 0; i < n; i++)
+    vtableEntries.push_back(make_pair(address + 4 * i, string(methodLabels->Nth(i))));
+}
+
+
+unsigned Jit::Address(const string &label)
+{
+  if (vtables.count(label)) return vtables[label];
+  if (!labels.count(label)) Failure("dcc --run: undefined label %s", label.c_str());
+  return (unsigned)(uintptr_t)(buffer + labels[label]);
+}
+
+/* Method: Run
+ * -----------
+ * Resolves the fixups, then adds the entry stub, which points rbx at
+ * a zeroed globals area and calls main, and runs it.
+ */
+void Jit::Run()
+{
+  unsigned globals = HostAlloc(globalBytes);
+  size_t entry = e->Here();
+  e->Push(RBX);
+  e->MovImm(RBX, globals);
+  e->Call(labels.count("main") ? labels["main"] : 0);
+  e->Pop(RBX);
+  e->Ret();
+  if (e->Full()) Failure("dcc --run: program too large for the code buffer");
+
+  for (size_t i = 0; i < fixups.size(); i++) {
+    Fixup &f = fixups[i];
+    if (f.absolute) {
+      unsigned address = Address(f.label);
+      memcpy(buffer + f.field, &address, 4);
+    } else {
+      if (!labels.count(f.label)) Failure("dcc --run: undefined label %s", f.label.c_str());
+      e->Patch(f.field, labels[f.label]);
+    }
+  }
+  for (size_t i = 0; i < vtableEntries.size(); i++)
+    *(unsigned *)(uintptr_t)vtableEntries[i].first = Address(vtableEntries[i].second);
+
+  ((void (*)())(buffer + entry))();
+  fflush(stdout);
+}
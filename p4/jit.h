@@ -0,0 +1,101 @@
+/* File: jit.h
+ * -----------
+ * The Jit class compiles the Tac list to x86-64 machine code in memory
+ * and runs it in the compiler's own process (dcc --run), so a program
+ * runs without an assembler, linker or simulator being started:
+ *
+ *     dcc prog.decaf --run
+ *
+ * Loading: like the interpreter, the Jit is a Backend and the list is
+ * walked once via EmitSpecific. Each instruction is encoded (through
+ * X86Encoder, the encoder the simulator's translator uses) straight
+ * into one executable buffer. Branches, calls and label addresses are
+ * recorded as fixups and patched once the whole list has been seen,
+ * when every label has a place; vtables are then filled in with the
+ * addresses of their methods.
+ *
+ * The generated code is that of the x86 target (see x86.h): the same
+ * frame layout, 4-byte slots and 32-bit pointers, which hold because
+ * the code buffer, the strings, vtables and globals and the heap are
+ * all mapped below 4G. Globals are addressed from rbx, which the entry
+ * stub sets up. The built-ins are host functions in the compiler,
+ * called the same way the x86 target calls its C runtime.
+ */
+
+#ifndef _H_jit
+#define _H_jit
+
+#include "backend.h"
+#include "codegen.h"
+#include "list.h"
+#include "x86enc.h"
+#include <map>
+#include <string>
+#include <vector>
+using std::map;
+using std::string;
+using std::vector;
+
+class Jit : public Backend {
+  public:
+    static const size_t CodeSize = 64 << 20;
+
+    Jit();
+    ~Jit();
+
+      // In-memory code needs an x86-64 host that can map memory below 4G.
+    static bool HostSupported();
+
+    void Load(List<Instruction*> *code);
+    void Run();
+
+    void EmitLoadConstant(Location *dst, int val);
+    void EmitLoadStringConstant(Location *dst, const char *str);
+    void EmitLoadLabel(Location *dst, const char *label);
+
+    void EmitLoad(Location *dst, Location *reference, int offset);
+    void EmitStore(Location *reference, Location *value, int offset);
+    void EmitCopy(Location *dst, Location *src);
+
+    void EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                      Location *op1, Location *op2);
+
+    void EmitLabel(const char *label);
+    void EmitGoto(const char *label);
+    void EmitIfZ(Location *test, const char *label);
+    void EmitReturn(Location *returnVal);
+
+    void EmitBeginFunction(int frameSize);
+    void EmitEndFunction();
+
+    void EmitParam(Location *arg);
+    void EmitLCall(Location *result, const char *label);
+    void EmitACall(Location *result, Location *fnAddr);
+    void EmitPopParams(int bytes);
+
+    void EmitVTable(const char *label, List<const char*> *methodLabels);
+
+  private:
+    struct Fixup {
+        size_t field;          // rel32 field, or imm32 field if absolute
+        string label;
+        bool absolute;
+    };
+
+    unsigned char *buffer;
+    X86Encoder *e;
+    map<string, size_t> labels;           // label -> code offset
+    map<string, unsigned> vtables;        // label -> address
+    map<string, unsigned> strings;        // literal -> address of its copy
+    vector<pair<unsigned, string> > vtableEntries;  // word address, method
+    vector<Fixup> fixups;
+    int paramsPushed, globalBytes;
+
+    X86Mem Slot(Location *var);
+    void Load(X86Reg reg, Location *var);
+    void Store(Location *var, X86Reg reg);
+    void Refer(size_t field, const char *label, bool absolute);
+    unsigned Address(const string &label);
+};
+
+#endif
@@ -0,0 +1,199 @@
+/* File: listsched.cc
+ * ------------------
+ * List scheduling of the basic blocks of the machine IR.
+ */
+
+#include "listsched.h"
+#include "utility.h"
+#include <algorithm>
+
+
+ListScheduler::ListScheduler(MFunction *f, MTarget *t) : fn(f), target(t), limit(0), numLive(0) {}
+
+void ListScheduler::Run(bool virtualRegs)
+{
+  limit = virtualRegs ? target->AllocatableRegs().size() : 0;
+  if (limit) ComputeLiveness(fn, liveIn, liveOut);
+  for (size_t b = 0; b < fn->blocks.size(); b++)
+    Schedule(b);
+}
+
+
+  // How many times in reads register reg.
+static int Reads(MInstr *in, int reg)
+{
+  int n = 0;
+  for (size_t o = in->numDefs; o < in->ops.size(); o++)
+    if (in->ops[o].IsReg() && in->ops[o].value == reg) n++;
+  return n;
+}
+
+static bool Writes(MInstr *in, int reg)
+{
+  for (int o = 0; o < in->numDefs; o++)
+    if (in->ops[o].value == reg) return true;
+  return false;
+}
+
+bool ListScheduler::MayAlias(MInstr *a, MInstr *b)
+{
+  const MOperand &x = a->ops[1], &y = b->ops[1];
+  if (x.kind == MOpFrame || y.kind == MOpFrame)
+    return x == y && a->ops[2] == b->ops[2];
+  return x.value != y.value || a->ops[2] == b->ops[2];
+}
+
+/* Method: Dependence
+ * ------------------
+ * a comes before b in the block. Returns how many cycles after a b can
+ * issue, or -1 if b does not depend on a and may go before it.
+ */
+int ListScheduler::Dependence(MInstr *a, MInstr *b)
+{
+  int latency = -1;
+  for (int o = 0; o < a->numDefs; o++) {
+    if (Reads(b, a->ops[o].value)) latency = std::max(latency, target->Latency(a));
+    if (Writes(b, a->ops[o].value)) latency = std::max(latency, 1);
+  }
+  for (size_t o = a->numDefs; o < a->ops.size(); o++)
+    if (a->ops[o].IsReg() && Writes(b, a->ops[o].value)) latency = std::max(latency, 1);
+  if (a->Is(MIsCall) || b->Is(MIsCall) || b->IsTerminator())
+    latency = std::max(latency, 1);
+  if (a->Is(MMayLoad | MMayStore) && b->Is(MMayLoad | MMayStore) &&
+      (a->Is(MMayStore) || b->Is(MMayStore)) && MayAlias(a, b))
+    latency = std::max(latency, 1);
+  return latency;
+}
+
+  // The edges of the DAG and the height of each node: its latency, or
+  // more if one of its successors is further from the end.
+void ListScheduler::BuildDAG(vector<MInstr *> &code)
+{
+  int n = code.size();
+  succs.assign(n, vector<Edge>());
+  height.assign(n, 0);
+  for (int i = n - 1; i >= 0; i--) {
+    height[i] = target->Latency(code[i]);
+    for (int j = i + 1; j < n; j++) {
+      int latency = Dependence(code[i], code[j]);
+      if (latency < 0) continue;
+      Edge e = { j, latency };
+      succs[i].push_back(e);
+      height[i] = std::max(height[i], latency + height[j]);
+    }
+  }
+}
+
+
+/* Method: Pressure
+ * ----------------
+ * How many more values would be live if in were placed next: one less
+ * for each register it reads for the last time, one more for a result
+ * that something reads later.
+ */
+int ListScheduler::Pressure(MInstr *in, int block)
+{
+  int delta = 0;
+  vector<MOperand>::iterator uses = in->ops.begin() + in->numDefs;
+  for (size_t o = 0; o < in->ops.size(); o++) {
+    if (!in->ops[o].IsVirtual()) continue;
+    int v = in->ops[o].value - FirstVirtualReg, reads = Reads(in, in->ops[o].value);
+    bool dies = live[v] && reads > 0 && remaining[v] == reads && !liveOut[block].Has(v);
+    if ((int)o < in->numDefs)
+      delta += (!live[v] || dies) && (remaining[v] > reads || liveOut[block].Has(v));
+    else if (dies && std::find(uses, in->ops.begin() + o, in->ops[o]) == in->ops.begin() + o)
+      delta--;                           // once, however often it is read
+  }
+  return delta;
+}
+
+void ListScheduler::Place(MInstr *in, int block)
+{
+  for (size_t o = in->numDefs; o < in->ops.size(); o++)
+    if (in->ops[o].IsVirtual()) remaining[in->ops[o].value - FirstVirtualReg]--;
+  for (size_t o = 0; o < in->ops.size(); o++) {
+    if (!in->ops[o].IsVirtual()) continue;
+    int v = in->ops[o].value - FirstVirtualReg;
+    bool now = remaining[v] > 0 || liveOut[block].Has(v);
+    if ((int)o >= in->numDefs) now = now && live[v];
+    if (now != live[v]) {
+      live[v] = now;
+      numLive += now ? 1 : -1;
+    }
+  }
+}
+
+
+/* Method: Schedule
+ * ----------------
+ * The list scheduler proper. ready holds the instructions whose
+ * predecessors are all placed; earliest is the cycle at which each
+ * one's operands will be ready. Placing an instruction takes a cycle,
+ * or more if it has to wait for its operands.
+ *
+ * Before allocation, of the instructions that can go without waiting
+ * the one that came first goes first, rather than the highest: the
+ * selector puts a value right before its use, which keeps intervals
+ * short and, for a value that gets spilled, lets the peephole pass
+ * drop the reload.
+ */
+void ListScheduler::Schedule(int block)
+{
+  vector<MInstr *> &code = fn->blocks[block]->code;
+  int n = code.size();
+  if (n < 3) return;
+  BuildDAG(code);
+
+  vector<int> preds(n, 0), earliest(n, 0), ready;
+  for (int i = 0; i < n; i++)
+    for (size_t e = 0; e < succs[i].size(); e++) preds[succs[i][e].to]++;
+  for (int i = 0; i < n; i++)
+    if (preds[i] == 0) ready.push_back(i);
+  if (limit) {
+    live.assign(fn->numVRegs, false);
+    remaining.assign(fn->numVRegs, 0);
+    numLive = 0;
+    for (int v = 0; v < fn->numVRegs; v++)
+      if (liveIn[block].Has(v)) {
+        live[v] = true;
+        numLive++;
+      }
+    for (int i = 0; i < n; i++)
+      for (size_t o = code[i]->numDefs; o < code[i]->ops.size(); o++)
+        if (code[i]->ops[o].IsVirtual()) remaining[code[i]->ops[o].value - FirstVirtualReg]++;
+  }
+
+  vector<MInstr *> out;
+  int cycle = 0;
+  while (!ready.empty()) {
+    size_t best = 0;
+    bool bestOver = false, bestStalls = false;
+    for (size_t r = 0; r < ready.size(); r++) {
+      int i = ready[r];
+      int delta = limit ? Pressure(code[i], block) : 0;
+      bool over = delta > 0 && numLive + delta > limit;
+      bool stalls = earliest[i] > cycle;
+      int j = ready[best];
+      bool first = limit || height[i] == height[j] ? i < j : height[i] > height[j];
+      if (r == 0 || over < bestOver ||
+          (over == bestOver && (stalls < bestStalls || (stalls == bestStalls && first)))) {
+        best = r;
+        bestOver = over;
+        bestStalls = stalls;
+      }
+    }
+    int i = ready[best];
+    ready.erase(ready.begin() + best);
+    out.push_back(code[i]);
+    if (limit) Place(code[i], block);
+    cycle = std::max(cycle, earliest[i]);
+    for (size_t e = 0; e < succs[i].size(); e++) {
+      Edge &edge = succs[i][e];
+      earliest[edge.to] = std::max(earliest[edge.to], cycle + edge.latency);
+      if (--preds[edge.to] == 0) ready.push_back(edge.to);
+    }
+    cycle++;
+  }
+  Assert((int)out.size() == n);
+  code = out;
+}
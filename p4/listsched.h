@@ -0,0 +1,69 @@
+/* File: listsched.h
+ * -----------------
+ * The list scheduler of the machine IR (see mir.h). It reorders the
+ * instructions of each basic block so that one waiting for the result
+ * of a load, a multiply or a divide does not come right behind it when
+ * something independent can go in between, on an in-order pipeline
+ * whose latencies the target gives (MTarget::Latency).
+ *
+ * Each block becomes a dependence DAG: an instruction comes after the
+ * ones writing the registers it reads (by their latency), after the
+ * ones reading or writing the registers it writes, and after the
+ * memory accesses it may conflict with: a store and another access,
+ * unless they are to different frame slots, a frame slot and memory
+ * reached through a register (nothing points into the frame), or at
+ * different offsets from the same register (all accesses are words,
+ * and a write to the register in between orders them anyway). Calls
+ * and the terminator stay where they are relative to everything else.
+ *
+ * The DAG is scheduled top-down, cycle by cycle. Of the instructions
+ * whose predecessors are all placed, one whose operands are ready goes
+ * first, then the one with the longest path to the end of the block,
+ * then the one that came first.
+ *
+ * The blocks are scheduled twice. Before register allocation the
+ * schedule watches the register pressure: an instruction that would
+ * leave more values live than the target has registers to allocate
+ * waits while another one can go, so hiding a latency does not cost a
+ * spill, and it otherwise keeps to the order it was given (see
+ * Schedule). After allocation the registers are fixed, so pressure
+ * cannot grow, and the reloads of spilled values are scheduled too.
+ */
+
+#ifndef _H_listsched
+#define _H_listsched
+
+#include "mir.h"
+
+class ListScheduler {
+  public:
+    ListScheduler(MFunction *fn, MTarget *target);
+
+      // Schedules every block; virtualRegs says whether registers are
+      // still to be allocated (so pressure matters).
+    void Run(bool virtualRegs);
+
+  private:
+    struct Edge {
+        int to, latency;
+    };
+
+    MFunction *fn;
+    MTarget *target;
+    int limit;                       // registers to allocate, 0 after allocation
+    vector<vector<Edge> > succs;     // of each instruction of the block
+    vector<int> height;              // longest path to the end of the block
+    vector<RegSet> liveIn, liveOut;
+    vector<int> remaining;           // reads of a vreg not yet placed
+    vector<bool> live;
+    int numLive;
+
+    void Schedule(int block);
+    void BuildDAG(vector<MInstr *> &code);
+    int Dependence(MInstr *a, MInstr *b);
+    static bool MayAlias(MInstr *a, MInstr *b);
+    int Pressure(MInstr *in, int block);
+    void Place(MInstr *in, int block);
+};
+
+#endif
@@ -21,7 +21,11 @@
  */
 int main(int argc, char *argv[])
 {
-    ParseCommandLine(argc, argv);
+    const char *source = ParseCommandLine(argc, argv);
+    if (source && (yyin = fopen(source, "r")) == NULL) {
+        fprintf(stderr, "dcc: cannot open source file '%s'\n", source);
+        return 2;
+    }
     InitScanner();
     InitParser();
     yyparse();
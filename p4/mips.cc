@@ -16,6 +16,23 @@
 #include <stdarg.h>
 #include <string.h>
 
+  // The heap (see EmitAlloc and EmitCollector).
+static const int HeapChunk = 64 * 1024;       // bytes got from sbrk at a time
+static const int GCMinTrigger = 1024 * 1024;  // bytes handed out between collections
+static const int MarkStackBytes = 16 * 1024;
+static const int HeaderMark = 1, HeaderFree = 2;
+static const int HeapNext = 0, HeapEnd = 4, HeapStart = 8, HeapTop = 12,
+                 HeapFreeList = 16, HeapHanded = 20, HeapTrigger = 24,
+                 HeapBitmap = 28, HeapCovered = 32, HeapCollections = 36,
+                 HeapFreed = 40, HeapGlobals = 44;
+
+  // Console I/O (see EmitOutput and EmitInput).
+static const int OutBufSize = 4096, OutFlushAt = 3072;
+static const int InBufSize = 4096;
+static const int ReadLineFirst = 32;          // bytes _ReadLine allocates first
+
+bool Mips::finishMain = false;
+
 /* Method: GetRegister
  * -------------------
  * Given a location for a current var, a reason (ForRead or ForWrite)
@@ -229,20 +246,13 @@ void Mips::EmitLoadConstant(Location *dst, int val)
 
 /* Method: EmitLoadStringConstant
  * ------------------------------
- * Used to assign a variable a pointer to string constant. Emits
- * assembly directives to create a new null-terminated string in the
- * data segment and assigns it a unique label. Slaves dst into a register
- * and loads that label address into the register.
+ * Used to assign a variable a pointer to string constant. The string
+ * itself goes in the string pool (see StringLabel), so this is just
+ * an la of its label.
  */
 void Mips::EmitLoadStringConstant(Location *dst, const char *str)
 {
-  static int strNum = 1;
-  char label[16];
-  sprintf(label, "_string%d", strNum++);
-  Emit(".data\t\t\t# create string constant marked with label");
-  Emit("%s: .asciiz %s", label, str);
-  Emit(".text");
-  EmitLoadLabel(dst, label);
+  EmitLoadLabel(dst, StringLabel(str));
 }
 
 
@@ -334,6 +344,7 @@ void Mips::EmitLabel(const char *label)
 { 
   SpillAllDirtyRegisters(); 
   Emit("%s:", label);
+  lastLabel = label;
 }
 
 
@@ -391,11 +402,13 @@ void Mips::EmitParam(Location *arg)
  * jal for a label, a jalr if address in register. Both will save the
  * return address in $ra. If there is an expected result passed, we slave
  * the var to a register and copy function return value from $v0 into that
- * register.  
+ * register.  A built-in with a RegisterEntry changes none of the
+ * general-purpose registers, so they are not spilled for a call to it.
  */
 void Mips::EmitCallInstr(Location *result, const char *fn, bool isLabel)
 {
-  SpillAllDirtyRegisters();
+  if (!isLabel || !RegisterEntry(CodeGenerator::BuiltInForLabel(fn)))
+    SpillAllDirtyRegisters();
   Emit("%s %-15s\t# jump to function", isLabel? "jal": "jalr", fn);
   if (result != NULL) {
     Register r1 = GetRegisterForWrite(result);
@@ -447,6 +460,7 @@ void Mips::EmitPopParams(int bytes)
     Emit("move $v0, %s\t\t# assign return value into $v0",
 	   regs[GetRegister(returnVal)].name);
   SpillForEndFunction();
+  if (inMain) EmitMainReturn();
   Emit("move $sp, $fp\t\t# pop callee frame off stack");
   Emit("lw $ra, -4($fp)\t# restore saved ra");
   Emit("lw $fp, 0($fp)\t# restore saved fp");
@@ -465,6 +479,7 @@ void Mips::EmitPopParams(int bytes)
 void Mips::EmitBeginFunction(int stackFrameSize)
 {
   Assert(stackFrameSize >= 0);
+  inMain = lastLabel && strcmp(lastLabel, "main") == 0;
   Emit("subu $sp, $sp, 8\t# decrement sp to make space to save ra, fp");
   Emit("sw $fp, 8($sp)\t# save fp");
   Emit("sw $ra, 4($sp)\t# save ra");
@@ -511,56 +526,227 @@ void Mips::EmitVTable(const char *label, List<const char*> *methodLabels)
  * --------------------
  * Used to emit the starting sequence needed for a program. Not much
  * here, but need to indicate what follows is in text segment and
- * needs to be aligned on word boundary. main is our only global symbol.
+ * needs to be aligned on word boundary. main and the runtime routines
+ * the program needs are our global symbols. _ReadLine gets its buffer
+ * from _Alloc, so reading a line needs both, and _PrintBool prints with
+ * _PrintString. The collector scans the globals bytes of globals as
+ * roots.
  */
-void Mips::EmitPreamble()
+void Mips::EmitPreamble(const bool *used, int globals)
 {
+  globalBytes = globals;
+  for (int i = 0; i < NumBuiltIns; i++)
+    runtime[i] = used[i];
+  runtime[Alloc] |= runtime[ReadLine];
+  runtime[PrintString] |= runtime[PrintBool];
+  finishMain = HasOutput() || (runtime[Alloc] && IsDebugOn("gcstats"));
+
   Emit("# standard Decaf preamble ");
-  EmitData();
+  if (runtime[PrintBool]) EmitData();
   Emit(".text");
   Emit(".align 2");
   Emit(".globl main");
-  Emit(".globl _PrintInt");
-  Emit(".globl _PrintString");
-  Emit(".globl _PrintBool");
-  Emit(".globl _Alloc");
-  Emit(".globl _StringEqual");
-  Emit(".globl _Halt");
-  Emit(".globl _ReadInteger");
-  Emit(".globl _ReadLine");
+  for (int i = 0; i < NumBuiltIns; i++)
+    if (runtime[i]) Emit(".globl %s", CodeGenerator::LabelForBuiltIn((BuiltIn)i));
   Emit("");
 }
 
+/* Method: EmitRuntime
+ * -------------------
+ * Lays out the runtime routines chosen by EmitPreamble.
+ */
+void Mips::EmitRuntime()
+{
+  if (HasOutput()) EmitOutput();
+  if (runtime[PrintInt]) EmitPrintInt();
+  if (runtime[PrintString]) EmitPrintString();
+  if (runtime[PrintBool]) EmitPrintBool();
+  if (runtime[Alloc]) EmitAlloc();
+  if (runtime[Alloc]) EmitCollector();
+  if (runtime[StringEqual]) EmitStringEqual();
+  if (finishMain) EmitFinish();
+  if (runtime[Halt]) EmitHalt();
+  if (runtime[ReadInteger] || runtime[ReadLine]) EmitInput();
+  if (runtime[ReadInteger]) EmitReadInteger();
+  if (runtime[ReadLine]) EmitReadLine();
+}
+
+const char *Mips::RegisterEntry(BuiltIn b)
+{
+  switch (b) {
+    case PrintInt: return "_PrintIntA0";
+    case PrintString: return "_PrintStringA0";
+    case PrintBool: return "_PrintBoolA0";
+    case ReadInteger: return "_ReadInteger";
+    case Halt: return "_Halt";
+    default: return NULL;
+  }
+}
+
+/* Method: EmitOutput
+ * ------------------
+ * The print routines add to _OutBuf rather than each making a syscall,
+ * and _FlushOut writes what has piled up with one write. It is called
+ * when the buffer fills, at the first newline once OutFlushAt bytes
+ * are waiting (so output goes out in whole lines), before the program
+ * waits for input (see EmitInput) and when it ends (see EmitFinish).
+ * _FlushOut changes only $v0 and $v1.
+ */
+void Mips::EmitOutput()
+{
+  Emit(".data");
+  Emit(".align 2");
+  Emit("_Out:\t\t# bytes waiting in _OutBuf, which follows");
+  Emit(".word 0");
+  Emit("_OutBuf:");
+  Emit(".space %d", OutBufSize);
+  Emit(".text");
+  Emit("_FlushOut:");
+  Emit("subu $sp, $sp, 12");
+  Emit("sw $a0, 12($sp)");
+  Emit("sw $a1, 8($sp)");
+  Emit("sw $a2, 4($sp)");
+  Emit("la $a1, _Out");
+  Emit("lw $a2, 0($a1)");
+  Emit("beqz $a2, _FlushOutDone");
+  Emit("sw $zero, 0($a1)");
+  Emit("li $a0, 1\t\t# standard output");
+  Emit("addiu $a1, $a1, 4");
+  Emit("li $v0, 15      \t# system call for write");
+  Emit("syscall");
+  Emit("_FlushOutDone:");
+  Emit("lw $a0, 12($sp)");
+  Emit("lw $a1, 8($sp)");
+  Emit("lw $a2, 4($sp)");
+  Emit("addiu $sp, $sp, 12");
+  Emit("jr $ra");
+  Emit("\n");
+}
+
+  // What a print routine does when the buffer must be flushed, with $a1
+  // the address of _Out: it is called without a frame of its own.
+static void EmitCallFlushOut()
+{
+  Mips::Emit("subu $sp, $sp, 8");
+  Mips::Emit("sw $ra, 4($sp)");
+  Mips::Emit("jal _FlushOut");
+  Mips::Emit("lw $ra, 4($sp)");
+  Mips::Emit("addiu $sp, $sp, 8");
+  Mips::Emit("li $a2, 0");
+}
+
+  // Digits are made two at a time from the right, dividing by 100 as a
+  // multiply by 0x51EB851F and a shift and looking the remainder up in
+  // _DigitPairs. They are made in the 10 bytes after the sign, then
+  // moved down to it.
 void Mips::EmitPrintInt()
 {
+  std::string pairs;
+  for (int i = 0; i < 100; i++) {
+    pairs += (char)('0' + i / 10);
+    pairs += (char)('0' + i % 10);
+  }
+  Emit(".data");
+  Emit("_DigitPairs:");
+  Emit(".ascii \"%s\"", pairs.c_str());
+  Emit(".text");
   Emit("%s:", "_PrintInt");
-  Emit("subu $sp, $sp, 8\t# decrement so to make space to save ra, fp");
-  Emit("sw $fp, 8($sp)  \t# save fp");
-  Emit("sw $ra, 4($sp)  \t# save ra");
-  Emit("addiu $fp, $sp, 8\t# set up new fp");
-  Emit("li $v0, 1       \t# system call code for print_int");
-  Emit("lw $a0, 4($fp)");
-  Emit("syscall");
-  Emit("move $sp, $fp");
-  Emit("lw $ra, -4($fp)");
-  Emit("lw $fp, 0($fp)");
+  Emit("lw $a0, 4($sp)");
+  Emit("_PrintIntA0:");
+  Emit("la $a1, _Out");
+  Emit("lw $a2, 0($a1)");
+  Emit("sltiu $v1, $a2, %d\t# room for a sign and 10 digits", OutBufSize - 11);
+  Emit("bnez $v1, _PrintIntRoom");
+  EmitCallFlushOut();
+  Emit("_PrintIntRoom:");
+  Emit("addu $a3, $a1, $a2");
+  Emit("addiu $a3, $a3, 4");
+  Emit("bgez $a0, _PrintIntDigits");
+  Emit("li $v1, 45\t\t# '-'");
+  Emit("sb $v1, 0($a3)");
+  Emit("addiu $a3, $a3, 1");
+  Emit("subu $a0, $zero, $a0");
+  Emit("_PrintIntDigits:");
+  Emit("addiu $a2, $a3, 10");
+  Emit("_PrintIntPair:");
+  Emit("sltiu $v1, $a0, 100");
+  Emit("bnez $v1, _PrintIntLast");
+  Emit("li $v1, %d\t# 0x51EB851F", 0x51EB851F);
+  Emit("multu $a0, $v1");
+  Emit("mfhi $v0");
+  Emit("srl $v0, $v0, 5\t# $a0 / 100");
+  Emit("sll $v1, $v0, 2\t\t# less 100 times that, as 4 + 32 + 64");
+  Emit("subu $a0, $a0, $v1");
+  Emit("sll $v1, $v0, 5");
+  Emit("subu $a0, $a0, $v1");
+  Emit("sll $v1, $v0, 6");
+  Emit("subu $a0, $a0, $v1");
+  Emit("sll $a0, $a0, 1");
+  Emit("la $v1, _DigitPairs");
+  Emit("addu $v1, $v1, $a0");
+  Emit("lbu $a0, 1($v1)");
+  Emit("sb $a0, -1($a2)");
+  Emit("lbu $a0, 0($v1)");
+  Emit("sb $a0, -2($a2)");
+  Emit("addiu $a2, $a2, -2");
+  Emit("move $a0, $v0");
+  Emit("b _PrintIntPair");
+  Emit("_PrintIntLast:");
+  Emit("sll $v0, $a0, 1");
+  Emit("la $v1, _DigitPairs");
+  Emit("addu $v1, $v1, $v0");
+  Emit("lbu $v0, 1($v1)");
+  Emit("sb $v0, -1($a2)");
+  Emit("addiu $a2, $a2, -1");
+  Emit("sltiu $v0, $a0, 10");
+  Emit("bnez $v0, _PrintIntMove");
+  Emit("lbu $v0, 0($v1)");
+  Emit("sb $v0, -1($a2)");
+  Emit("addiu $a2, $a2, -1");
+  Emit("_PrintIntMove:");
+  Emit("addiu $v0, $a3, 10");
+  Emit("_PrintIntByte:");
+  Emit("lbu $v1, 0($a2)");
+  Emit("sb $v1, 0($a3)");
+  Emit("addiu $a2, $a2, 1");
+  Emit("addiu $a3, $a3, 1");
+  Emit("bne $a2, $v0, _PrintIntByte");
+  Emit("subu $a2, $a3, $a1");
+  Emit("addiu $a2, $a2, -4");
+  Emit("sw $a2, 0($a1)");
   Emit("jr $ra");
   Emit("\n");
 }
 
+  // _PrintStringA0 prints the string in $a0, for _PrintBool.
 void Mips::EmitPrintString()
 {
   Emit("%s:", "_PrintString");
-  Emit("subu $sp, $sp, 8");
-  Emit("sw $fp, 8($sp)");
-  Emit("sw $ra, 4($sp)");
-  Emit("addiu $fp, $sp, 8");
-  Emit("li $v0, 4       \t# system call for print_str");
-  Emit("lw $a0, 4($fp)");
-  Emit("syscall");
-  Emit("move $sp, $fp");
-  Emit("lw $ra, -4($fp)");
-  Emit("lw $fp, 0($fp)");
+  Emit("lw $a0, 4($sp)");
+  Emit("_PrintStringA0:");
+  Emit("la $a1, _Out");
+  Emit("lw $a2, 0($a1)");
+  Emit("_PrintStringByte:");
+  Emit("lbu $a3, 0($a0)");
+  Emit("beqz $a3, _PrintStringDone");
+  Emit("addu $v1, $a1, $a2");
+  Emit("sb $a3, 4($v1)");
+  Emit("addiu $a0, $a0, 1");
+  Emit("addiu $a2, $a2, 1");
+  Emit("xori $v1, $a3, 10");
+  Emit("beqz $v1, _PrintStringLine");
+  Emit("sltiu $v1, $a2, %d", OutBufSize);
+  Emit("bnez $v1, _PrintStringByte");
+  Emit("b _PrintStringFlush");
+  Emit("_PrintStringLine:");
+  Emit("sltiu $v1, $a2, %d", OutFlushAt);
+  Emit("bnez $v1, _PrintStringByte");
+  Emit("_PrintStringFlush:");
+  Emit("sw $a2, 0($a1)");
+  EmitCallFlushOut();
+  Emit("b _PrintStringByte");
+  Emit("_PrintStringDone:");
+  Emit("sw $a2, 0($a1)");
   Emit("jr $ra");
   Emit("\n");
 }
@@ -568,157 +754,766 @@ void Mips::EmitPrintString()
 void Mips::EmitPrintBool()
 {
   Emit("%s:", "_PrintBool");
-  Emit("subu $sp, $sp, 8");
-  Emit("sw $fp, 8($sp)");
-  Emit("sw $ra, 4($sp)");
-  Emit("addiu $fp, $sp, 8");
-  Emit("lw $t1, 4($fp)");
-  Emit("blez $t1, fbr");
-  Emit("li $v0, 4       \t# system call for print_str");
+  Emit("lw $a0, 4($sp)");
+  Emit("_PrintBoolA0:");
+  Emit("move $v0, $a0");
   Emit("la $a0, TRUE");
-  Emit("syscall");
-  Emit("b end");
-  Emit("%s:", "fbr");
-  Emit("li $v0, 4       \t# system call for print_str");
+  Emit("bgtz $v0, _PrintStringA0");
   Emit("la $a0, FALSE");
-  Emit("syscall");
-  Emit("%s:", "end");
-  Emit("move $sp, $fp");
-  Emit("lw $ra, -4($fp)");
-  Emit("lw $fp, 0($fp)");
-  Emit("jr $ra");
+  Emit("b _PrintStringA0");
   Emit("\n");
 }
 
+/* Method: EmitAlloc
+ * -----------------
+ * The heap is one run of memory got from sbrk a chunk at a time (a
+ * chunk is HeapChunk bytes, or the whole request if that is larger).
+ * Every block in it starts with a header word holding its size in
+ * bytes, header included, with HeaderMark and HeaderFree in the low
+ * bits, so the collector (see EmitCollector) can walk it. The program
+ * is handed the word after the header.
+ *
+ * Allocation bumps a pointer through a window of free memory, so most
+ * allocations make no syscall. The machine-IR path does that inline
+ * and only calls _AllocA0 (size in $a0) when the window is used up.
+ * _AllocA0 changes nothing but $a0-$a3, $v0 and $v1, so no register
+ * allocated to a variable. A new window is the first run on the free
+ * list that is big enough (zeroed, since programs count on new
+ * memory being zero), or, once HeapTrigger bytes have been handed out
+ * since the last collection, the result of collecting first, or else
+ * a new chunk. sbrk hands out memory in order, so a chunk that
+ * follows the window just extends it.
+ *
+ * _Heap holds the window and the rest of the allocator's state, at the
+ * Heap* offsets.
+ */
 void Mips::EmitAlloc()
 {
+  Emit(".data");
+  Emit(".align 2");
+  Emit("_Heap:\t\t# window next/end, start, top, free list, handed out,");
+  Emit(".word 0, 0, 0, 0, 0, 0\t# trigger, bitmap, covered, collections,");
+  Emit(".word %d, 0, 0, 0, 0, %d\t# freed, globals", GCMinTrigger, globalBytes);
+  Emit(".text");
   Emit("%s:", "_Alloc");
+  Emit("lw $a0, 4($sp)\t\t# bytes wanted");
+  Emit("_AllocA0:");
+  Emit("la $a1, _Heap");
+  Emit("lw $v0, %d($a1)", HeapNext);
+  Emit("lw $a2, %d($a1)", HeapEnd);
+  Emit("addiu $a3, $a0, 7\t# and the header, in words");
+  Emit("srl $a3, $a3, 2");
+  Emit("sll $a3, $a3, 2");
+  Emit("addu $v1, $v0, $a3");
+  Emit("sltu $a2, $a2, $v1");
+  Emit("bnez $a2, _AllocRefill\t# past the end of the window");
+  Emit("sw $v1, %d($a1)", HeapNext);
+  Emit("sw $a3, 0($v0)");
+  Emit("addiu $v0, $v0, 4");
+  Emit("jr $ra");
+  Emit("_AllocRefill:");
   Emit("subu $sp, $sp, 8");
-  Emit("sw $fp, 8($sp)");
   Emit("sw $ra, 4($sp)");
-  Emit("addiu $fp, $sp, 8");
+  Emit("sw $a0, 8($sp)");
+  Emit("jal _HeapRefill");
+  Emit("lw $a0, 8($sp)");
+  Emit("lw $ra, 4($sp)");
+  Emit("addiu $sp, $sp, 8");
+  Emit("b _AllocA0");
+  Emit("");
+
+    // A window of at least $a3 bytes. $t0 is the size wanted, $t1 the
+    // state, $t5 set once a collection has been tried.
+  Emit("_HeapRefill:");
+  Emit("subu $sp, $sp, 32");
+  Emit("sw $ra, 32($sp)");
+  for (int i = 0; i <= 5; i++)
+    Emit("sw $t%d, %d($sp)", i, 28 - 4 * i);
+  Emit("move $t0, $a3");
+  Emit("la $t1, _Heap");
+  Emit("li $t5, 0");
+  Emit("_RefillFree:");
+  Emit("addiu $t2, $t1, %d\t# the link to the run looked at", HeapFreeList);
+  Emit("_RefillScan:");
+  Emit("lw $t3, 0($t2)");
+  Emit("beqz $t3, _RefillNone");
+  Emit("lw $t4, 0($t3)");
+  Emit("srl $t4, $t4, 2");
+  Emit("sll $t4, $t4, 2");
+  Emit("sltu $v0, $t4, $t0");
+  Emit("beqz $v0, _RefillTake\t# first fit");
+  Emit("addiu $t2, $t3, 4");
+  Emit("b _RefillScan");
+  Emit("_RefillTake:");
+  Emit("lw $v0, 4($t3)");
+  Emit("sw $v0, 0($t2)");
+  Emit("jal _HeapClose");
+  Emit("addu $t4, $t3, $t4");
+  Emit("sw $t3, %d($t1)", HeapNext);
+  Emit("sw $t4, %d($t1)", HeapEnd);
+  Emit("subu $v1, $t4, $t3\t# zero it, the odd words first");
+  Emit("andi $v1, $v1, 28");
+  Emit("addu $v1, $t3, $v1");
+  Emit("move $v0, $t3");
+  Emit("_RefillZeroWord:");
+  Emit("beq $v0, $v1, _RefillZero");
+  Emit("sw $zero, 0($v0)");
+  Emit("addiu $v0, $v0, 4");
+  Emit("b _RefillZeroWord");
+  Emit("_RefillZero:");
+  Emit("beq $v0, $t4, _RefillZeroed");
+  for (int i = 0; i < 32; i += 4)
+    Emit("sw $zero, %d($v0)", i);
+  Emit("addiu $v0, $v0, 32");
+  Emit("b _RefillZero");
+  Emit("_RefillZeroed:");
+  Emit("subu $v0, $t4, $t3");
+  Emit("b _RefillDone");
+  Emit("_RefillNone:");
+  Emit("bnez $t5, _RefillSbrk");
+  Emit("lw $v0, %d($t1)", HeapHanded);
+  Emit("lw $v1, %d($t1)", HeapTrigger);
+  Emit("sltu $v0, $v0, $v1");
+  Emit("bnez $v0, _RefillSbrk");
+  Emit("jal _GC");
+  Emit("li $t5, 1");
+  Emit("b _RefillFree");
+  Emit("_RefillSbrk:");
+  Emit("li $a0, %d", HeapChunk);
+  Emit("sltu $v0, $t0, $a0");
+  Emit("bnez $v0, _RefillChunk");
+  Emit("move $a0, $t0\t\t# more than a chunk: just the request");
+  Emit("_RefillChunk:");
   Emit("li $v0, 9       \t# system call for sbrk");
-  Emit("lw $a0, 4($fp)");
   Emit("syscall");
-  Emit("move $sp, $fp");
-  Emit("lw $ra, -4($fp)");
-  Emit("lw $fp, 0($fp)");
+  Emit("lw $v1, %d($t1)", HeapStart);
+  Emit("bnez $v1, _RefillTop");
+  Emit("sw $v0, %d($t1)", HeapStart);
+  Emit("_RefillTop:");
+  Emit("addu $t4, $v0, $a0");
+  Emit("sw $t4, %d($t1)", HeapTop);
+  Emit("lw $v1, %d($t1)", HeapEnd);
+  Emit("bne $v0, $v1, _RefillFresh");
+  Emit("sw $t4, %d($t1)\t# follows the window: extend it", HeapEnd);
+  Emit("move $v0, $a0");
+  Emit("b _RefillDone");
+  Emit("_RefillFresh:");
+  Emit("move $t3, $v0");
+  Emit("jal _HeapClose");
+  Emit("sw $t3, %d($t1)", HeapNext);
+  Emit("sw $t4, %d($t1)", HeapEnd);
+  Emit("move $v0, $a0");
+  Emit("_RefillDone:");
+  Emit("lw $v1, %d($t1)", HeapHanded);
+  Emit("addu $v1, $v1, $v0");
+  Emit("sw $v1, %d($t1)", HeapHanded);
+  for (int i = 0; i <= 5; i++)
+    Emit("lw $t%d, %d($sp)", i, 28 - 4 * i);
+  Emit("lw $ra, 32($sp)");
+  Emit("addiu $sp, $sp, 32");
+  Emit("jr $ra");
+  Emit("");
+
+    // What is left of the window becomes a free block; $t1 is the state.
+  Emit("_HeapClose:");
+  Emit("lw $v0, %d($t1)", HeapNext);
+  Emit("lw $v1, %d($t1)", HeapEnd);
+  Emit("subu $v1, $v1, $v0");
+  Emit("beqz $v1, _HeapClosed");
+  Emit("ori $v1, $v1, %d", HeaderFree);
+  Emit("sw $v1, 0($v0)");
+  Emit("_HeapClosed:");
   Emit("jr $ra");
   Emit("\n");
 }
 
+/* Method: EmitCollector
+ * ---------------------
+ * _GC is a mark-sweep collector, conservative about what is a pointer:
+ * any word that holds the address just past the header of a block is
+ * taken to point to it. So the blocks need no description of their
+ * contents (the vtable pointer of an object and the length of an array
+ * never point into the heap), and a value in a register or in any slot
+ * of a frame keeps its block alive.
+ *
+ *   - The roots are the registers (saved on the stack on entry), the
+ *     stack from $sp up to the outermost frame, found by following the
+ *     saved $fp links to the one saved by main, and the globals, the
+ *     HeapGlobals bytes from $gp.
+ *   - Which words start a block is a bitmap, one bit per word of the
+ *     heap, rebuilt by walking the heap before marking. It lives in a
+ *     block of its own at the top of the heap, after a stack of blocks
+ *     marked but not yet scanned; one for twice the heap is got from
+ *     sbrk when the heap has outgrown it. If that stack fills up,
+ *     blocks are only marked, and then every marked block is scanned
+ *     again until nothing new is marked.
+ *   - The sweep clears the marks and joins each run of unmarked and
+ *     free blocks into one free block, put on the free list if it can
+ *     hold the link.
+ *   - The next collection is after as many bytes as survived (at least
+ *     GCMinTrigger) have been handed out again, so the heap settles at
+ *     about twice what is live.
+ *
+ * Registers: $s0 the state, $s1 the heap start, $s2 the bytes of heap
+ * the bitmap covers, $s3 the bitmap, $s4 and $s5 the bottom and top of
+ * the mark stack (which ends at the bitmap) and $s7 set when it
+ * overflowed.
+ */
+void Mips::EmitCollector()
+{
+  const int saved = 19 * 4;              // $ra, $t0-$t9, $s0-$s7
+  Emit("_GC:");
+  Emit("subu $sp, $sp, %d", saved);
+  Emit("sw $ra, %d($sp)", saved);
+  for (int i = 0; i <= 9; i++)
+    Emit("sw $t%d, %d($sp)", i, saved - 4 - 4 * i);
+  for (int i = 0; i <= 7; i++)
+    Emit("sw $s%d, %d($sp)", i, 32 - 4 * i);
+  Emit("la $s0, _Heap");
+  Emit("move $t1, $s0");
+  Emit("jal _HeapClose");
+  Emit("sw $zero, %d($s0)", HeapNext);
+  Emit("sw $zero, %d($s0)", HeapEnd);
+  Emit("lw $s1, %d($s0)", HeapStart);
+  Emit("lw $t0, %d($s0)", HeapTop);
+  Emit("subu $t0, $t0, $s1");
+  Emit("lw $s2, %d($s0)", HeapCovered);
+  Emit("sltu $t3, $s2, $t0");
+  Emit("beqz $t3, _GCBitmap");
+  Emit("srl $a0, $t0, 4\t\t# a new bitmap block, for twice the heap");
+  Emit("addiu $a0, $a0, %d", MarkStackBytes + 8);
+  Emit("srl $a0, $a0, 2");
+  Emit("sll $a0, $a0, 2");
+  Emit("li $v0, 9       \t# system call for sbrk");
+  Emit("syscall");
+  Emit("addu $t0, $v0, $a0");
+  Emit("sw $t0, %d($s0)", HeapTop);
+  Emit("sw $a0, 0($v0)");
+  Emit("sw $v0, %d($s0)", HeapBitmap);
+  Emit("subu $s2, $a0, %d", MarkStackBytes + 4);
+  Emit("sll $s2, $s2, 5");
+  Emit("sw $s2, %d($s0)", HeapCovered);
+  Emit("_GCBitmap:");
+  Emit("lw $s4, %d($s0)", HeapBitmap);
+  Emit("lw $t0, 0($s4)");
+  Emit("ori $t0, $t0, %d", HeaderMark);
+  Emit("sw $t0, 0($s4)");
+  Emit("addiu $s4, $s4, 4");
+  Emit("move $s5, $s4");
+  Emit("addiu $s3, $s4, %d", MarkStackBytes);
+  Emit("li $s7, 0");
+  Emit("srl $t0, $s2, 5");
+  Emit("addu $t0, $s3, $t0");
+  Emit("move $t1, $s3");
+  Emit("_GCClear:");
+  Emit("beq $t1, $t0, _GCStarts");
+  Emit("sw $zero, 0($t1)");
+  Emit("addiu $t1, $t1, 4");
+  Emit("b _GCClear");
+  Emit("_GCStarts:");
+  Emit("move $t1, $s1");
+  Emit("lw $t2, %d($s0)", HeapTop);
+  Emit("_GCStart:");
+  Emit("beq $t1, $t2, _GCRoots");
+  Emit("subu $t3, $t1, $s1");
+  Emit("sltu $t4, $t3, $s2");
+  Emit("beqz $t4, _GCNextStart");
+  Emit("srl $t3, $t3, 2");
+  Emit("srl $t4, $t3, 5");
+  Emit("sll $t4, $t4, 2");
+  Emit("addu $t4, $s3, $t4");
+  Emit("andi $t3, $t3, 31");
+  Emit("li $t5, 1");
+  Emit("sllv $t5, $t5, $t3");
+  Emit("lw $t6, 0($t4)");
+  Emit("or $t6, $t6, $t5");
+  Emit("sw $t6, 0($t4)");
+  Emit("_GCNextStart:");
+  Emit("lw $t3, 0($t1)");
+  Emit("srl $t3, $t3, 2");
+  Emit("sll $t3, $t3, 2");
+  Emit("addu $t1, $t1, $t3");
+  Emit("b _GCStart");
+
+  Emit("_GCRoots:");
+  Emit("move $t1, $fp");
+  Emit("_GCOuter:");
+  Emit("lw $t2, 0($t1)");
+  Emit("beqz $t2, _GCStack");
+  Emit("move $t1, $t2");
+  Emit("b _GCOuter");
+  Emit("_GCStack:");
+  Emit("move $t0, $sp");
+  Emit("addiu $t1, $t1, 4");
+  Emit("jal _GCScan");
+  Emit("move $t0, $gp");
+  Emit("lw $t1, %d($s0)", HeapGlobals);
+  Emit("addu $t1, $gp, $t1");
+  Emit("jal _GCScan");
+  Emit("_GCDrain:");
+  Emit("beq $s5, $s4, _GCDrained");
+  Emit("addiu $s5, $s5, -4");
+  Emit("lw $t0, 0($s5)");
+  Emit("lw $t1, 0($t0)");
+  Emit("srl $t1, $t1, 2");
+  Emit("sll $t1, $t1, 2");
+  Emit("addu $t1, $t0, $t1");
+  Emit("addiu $t0, $t0, 4");
+  Emit("jal _GCScan");
+  Emit("b _GCDrain");
+  Emit("_GCDrained:");
+  Emit("beqz $s7, _GCSweep");
+  Emit("li $s7, 0\t\t# the stack overflowed: scan every marked block");
+  Emit("move $t7, $s1");
+  Emit("lw $t8, %d($s0)", HeapTop);
+  Emit("lw $t9, %d($s0)", HeapBitmap);
+  Emit("_GCRescan:");
+  Emit("beq $t7, $t8, _GCDrain");
+  Emit("lw $t1, 0($t7)");
+  Emit("move $t0, $t7");
+  Emit("srl $t2, $t1, 2");
+  Emit("sll $t2, $t2, 2");
+  Emit("addu $t7, $t7, $t2");
+  Emit("andi $t1, $t1, %d", HeaderMark);
+  Emit("beqz $t1, _GCRescan");
+  Emit("beq $t0, $t9, _GCRescan");
+  Emit("move $t1, $t7");
+  Emit("addiu $t0, $t0, 4");
+  Emit("jal _GCScan");
+  Emit("b _GCRescan");
+
+  Emit("_GCSweep:");
+  Emit("move $t1, $s1");
+  Emit("lw $t2, %d($s0)", HeapTop);
+  Emit("li $t3, 0\t\t# start of the free run, if in one");
+  Emit("li $t5, 0\t\t# bytes kept");
+  Emit("li $t6, 0\t\t# bytes freed");
+  Emit("sw $zero, %d($s0)", HeapFreeList);
+  Emit("_GCSweepBlock:");
+  Emit("beq $t1, $t2, _GCSweepEnd");
+  Emit("lw $t0, 0($t1)");
+  Emit("srl $t4, $t0, 2");
+  Emit("sll $t4, $t4, 2");
+  Emit("andi $t7, $t0, %d", HeaderMark);
+  Emit("beqz $t7, _GCUnmarked");
+  Emit("sw $t4, 0($t1)");
+  Emit("addu $t5, $t5, $t4");
+  Emit("beqz $t3, _GCSweepNext");
+  Emit("jal _GCFreeRun");
+  Emit("li $t3, 0");
+  Emit("b _GCSweepNext");
+  Emit("_GCUnmarked:");
+  Emit("andi $t7, $t0, %d", HeaderFree);
+  Emit("bnez $t7, _GCInRun");
+  Emit("addu $t6, $t6, $t4");
+  Emit("_GCInRun:");
+  Emit("bnez $t3, _GCSweepNext");
+  Emit("move $t3, $t1");
+  Emit("_GCSweepNext:");
+  Emit("addu $t1, $t1, $t4");
+  Emit("b _GCSweepBlock");
+  Emit("_GCSweepEnd:");
+  Emit("beqz $t3, _GCSwept");
+  Emit("jal _GCFreeRun");
+  Emit("_GCSwept:");
+  Emit("lw $t0, %d($s0)", HeapCollections);
+  Emit("addiu $t0, $t0, 1");
+  Emit("sw $t0, %d($s0)", HeapCollections);
+  Emit("lw $t0, %d($s0)", HeapFreed);
+  Emit("addu $t0, $t0, $t6");
+  Emit("sw $t0, %d($s0)", HeapFreed);
+  Emit("sw $zero, %d($s0)", HeapHanded);
+  Emit("li $t0, %d", GCMinTrigger);
+  Emit("sltu $t1, $t5, $t0");
+  Emit("bnez $t1, _GCTrigger");
+  Emit("move $t0, $t5");
+  Emit("_GCTrigger:");
+  Emit("sw $t0, %d($s0)", HeapTrigger);
+  for (int i = 0; i <= 9; i++)
+    Emit("lw $t%d, %d($sp)", i, saved - 4 - 4 * i);
+  for (int i = 0; i <= 7; i++)
+    Emit("lw $s%d, %d($sp)", i, 32 - 4 * i);
+  Emit("lw $ra, %d($sp)", saved);
+  Emit("addiu $sp, $sp, %d", saved);
+  Emit("jr $ra");
+  Emit("");
+
+    // Marks the blocks the words from $t0 up to $t1 point to, pushing
+    // them for scanning.
+  Emit("_GCScan:");
+  Emit("beq $t0, $t1, _GCScanned");
+  Emit("lw $t2, 0($t0)");
+  Emit("addiu $t0, $t0, 4");
+  Emit("addiu $t2, $t2, -4\t# its header, if it points to a block");
+  Emit("subu $t3, $t2, $s1");
+  Emit("sltu $t4, $t3, $s2");
+  Emit("beqz $t4, _GCScan");
+  Emit("andi $t4, $t3, 3");
+  Emit("bnez $t4, _GCScan");
+  Emit("srl $t3, $t3, 2");
+  Emit("srl $t4, $t3, 5");
+  Emit("sll $t4, $t4, 2");
+  Emit("addu $t4, $s3, $t4");
+  Emit("lw $t4, 0($t4)");
+  Emit("andi $t3, $t3, 31");
+  Emit("srlv $t4, $t4, $t3");
+  Emit("andi $t4, $t4, 1");
+  Emit("beqz $t4, _GCScan\t# not the start of a block");
+  Emit("lw $t3, 0($t2)");
+  Emit("andi $t4, $t3, %d", HeaderMark | HeaderFree);
+  Emit("bnez $t4, _GCScan");
+  Emit("ori $t3, $t3, %d", HeaderMark);
+  Emit("sw $t3, 0($t2)");
+  Emit("beq $s5, $s3, _GCFull");
+  Emit("sw $t2, 0($s5)");
+  Emit("addiu $s5, $s5, 4");
+  Emit("b _GCScan");
+  Emit("_GCFull:");
+  Emit("li $s7, 1");
+  Emit("b _GCScan");
+  Emit("_GCScanned:");
+  Emit("jr $ra");
+  Emit("");
+
+    // The blocks from $t3 up to $t1 become one free block.
+  Emit("_GCFreeRun:");
+  Emit("subu $t7, $t1, $t3");
+  Emit("ori $t8, $t7, %d", HeaderFree);
+  Emit("sw $t8, 0($t3)");
+  Emit("sltiu $t8, $t7, 8");
+  Emit("bnez $t8, _GCFreeRunDone");
+  Emit("lw $t8, %d($s0)", HeapFreeList);
+  Emit("sw $t8, 4($t3)");
+  Emit("sw $t3, %d($s0)", HeapFreeList);
+  Emit("_GCFreeRunDone:");
+  Emit("jr $ra");
+  Emit("\n");
+}
+
+/* Method: EmitStringEqual
+ * ------------------------
+ * _StringEqual(a, b) in one pass, returning at once when a and b are
+ * the same string (as equal literals are, being pooled). When a and b
+ * are equally far from a word boundary, a word of each is compared at
+ * a time once they get there; a word of a with a zero byte in it,
+ * found by (w - 0x01010101) & ~w & 0x80808080, ends the string. A
+ * word that differs is compared again byte by byte, since the bytes
+ * after the ends of two equal strings may not be the same. Words are
+ * read only within the word holding the terminator, so never beyond
+ * the string's memory.
+ */
 void Mips::EmitStringEqual()
 {
   Emit("%s:", "_StringEqual");
+  Emit("lw $a0, 4($sp)");
+  Emit("lw $a1, 8($sp)");
+  Emit("li $v0, 1");
+  Emit("beq $a0, $a1, _StrEqDone\t# the same string");
+  Emit("xor $v1, $a0, $a1");
+  Emit("andi $v1, $v1, 3");
+  Emit("bnez $v1, _StrEqBytes\t# can never both be aligned");
+  Emit("_StrEqAlign:");
+  Emit("andi $v1, $a0, 3");
+  Emit("beqz $v1, _StrEqWords");
+  Emit("lbu $a2, 0($a0)");
+  Emit("lbu $a3, 0($a1)");
+  Emit("bne $a2, $a3, _StrEqDiffer");
+  Emit("beqz $a2, _StrEqDone");
+  Emit("addiu $a0, $a0, 1");
+  Emit("addiu $a1, $a1, 1");
+  Emit("b _StrEqAlign");
+  Emit("_StrEqWords:");
+  Emit("li $t0, %d\t# 0x01010101", 0x01010101);
+  Emit("sll $t1, $t0, 7\t# 0x80808080");
+  Emit("_StrEqWord:");
+  Emit("lw $a2, 0($a0)");
+  Emit("lw $a3, 0($a1)");
+  Emit("bne $a2, $a3, _StrEqBytes");
+  Emit("subu $v1, $a2, $t0");
+  Emit("nor $t2, $a2, $zero");
+  Emit("and $v1, $v1, $t2");
+  Emit("and $v1, $v1, $t1");
+  Emit("bnez $v1, _StrEqDone\t# equal up to the terminator");
+  Emit("addiu $a0, $a0, 4");
+  Emit("addiu $a1, $a1, 4");
+  Emit("b _StrEqWord");
+  Emit("_StrEqBytes:");
+  Emit("lbu $a2, 0($a0)");
+  Emit("lbu $a3, 0($a1)");
+  Emit("bne $a2, $a3, _StrEqDiffer");
+  Emit("beqz $a2, _StrEqDone");
+  Emit("addiu $a0, $a0, 1");
+  Emit("addiu $a1, $a1, 1");
+  Emit("b _StrEqBytes");
+  Emit("_StrEqDiffer:");
+  Emit("li $v0, 0");
+  Emit("_StrEqDone:");
+  Emit("jr $ra");
+  Emit("\n");
+}
+
+/* Method: EmitFinish
+ * ------------------
+ * _Finish is what has to happen before the program ends, either by
+ * returning from main (see EmitMainReturn) or through _Halt: the
+ * output still in the buffer is written. With -d gcstats, what the
+ * collector did, if it ran at all, is then reported on stderr, so the
+ * output of the program is the same either way. The report is built
+ * up in _GCReport by _ReportString and _ReportInt (which append to
+ * $a1 and use only $t2-$t4) and written with one system call.
+ */
+void Mips::EmitFinish()
+{
+  Emit("_Finish:");
   Emit("subu $sp, $sp, 8");
-  Emit("sw $fp, 8($sp)");
   Emit("sw $ra, 4($sp)");
-  Emit("addiu $fp, $sp, 8");
-  Emit("subu $sp, $sp, 4\t# decrement sp to make space for return value");
-  Emit("li $v0, 0");
-  Emit("#Determine length string 1");
-  Emit("lw $t0, 4($fp)");
-  Emit("li $t3, 0");
-  Emit("%s:", "bloop1");
-  Emit("lb $t5, ($t0)");
-  Emit("beqz $t5, eloop1");
-  Emit("addi $t0, 1");
-  Emit("addi $t3, 1");
-  Emit("b bloop1");
-  Emit("%s:", "eloop1");
-  Emit("#Determine length string 2");
-  Emit("lw $t1, 8($fp)");
-  Emit("li $t4, 0");
-  Emit("%s:", "bloop2");
-  Emit("lb $t5, ($t1)");
-  Emit("beqz $t5, eloop2");
-  Emit("addi $t1, 1");
-  Emit("addi $t4, 1");
-  Emit("b bloop2");
-  Emit("%s:", "eloop2");
-  Emit("bne $t3, $t4, end1\t# check if string lengths are the same");
-  Emit("lw $t0, 4($fp)");
-  Emit("lw $t1, 8($fp)");
-  Emit("li $t3, 0");
-  Emit("%s:", "bloop3");
-  Emit("lb $t5, ($t0)");
-  Emit("lb $t6, ($t1)");
-  Emit("bne $t5, $t6, end1");
-  Emit("addi $t3, 1");
-  Emit("addi $t0, 1");
-  Emit("addi $t1, 1");
-  Emit("bne $t3, $t4, bloop3");
-  Emit("%s:", "eloop3");
-  Emit("li $v0, 1");
-  Emit("%s:", "end1");
-  Emit("move $sp, $fp");
-  Emit("lw $ra, -4($fp)");
-  Emit("lw $fp, 0($fp)");
+  if (HasOutput()) Emit("jal _FlushOut");
+  if (runtime[Alloc] && IsDebugOn("gcstats")) {
+    static const char *text[] = { "\"gc: \"", "\" collections, \"", "\" bytes freed, heap \"" };
+    static const int value[] = { HeapCollections, HeapFreed, HeapTop };
+    Emit("la $t0, _Heap");
+    Emit("lw $t1, %d($t0)", HeapCollections);
+    Emit("beqz $t1, _FinishDone");
+    Emit("la $a1, _GCReport");
+    for (int i = 0; i < 3; i++) {
+      Emit("la $a0, %s", StringLabel(text[i]));
+      Emit("jal _ReportString");
+      Emit("lw $a0, %d($t0)", value[i]);
+      if (value[i] == HeapTop) {
+        Emit("lw $t1, %d($t0)", HeapStart);
+        Emit("subu $a0, $a0, $t1");
+      }
+      Emit("jal _ReportInt");
+    }
+    Emit("la $a0, %s", StringLabel("\" bytes\\n\""));
+    Emit("jal _ReportString");
+    Emit("la $a2, _GCReport");
+    Emit("subu $a2, $a1, $a2");
+    Emit("la $a1, _GCReport");
+    Emit("li $a0, 2\t\t# standard error");
+    Emit("li $v0, 15      \t# system call for write");
+    Emit("syscall");
+    Emit("_FinishDone:");
+  }
+  Emit("lw $ra, 4($sp)");
+  Emit("addiu $sp, $sp, 8");
   Emit("jr $ra");
+  if (runtime[Alloc] && IsDebugOn("gcstats")) {
+    Emit("_ReportString:");
+    Emit("lbu $t2, 0($a0)");
+    Emit("beqz $t2, _ReportStringDone");
+    Emit("sb $t2, 0($a1)");
+    Emit("addiu $a0, $a0, 1");
+    Emit("addiu $a1, $a1, 1");
+    Emit("b _ReportString");
+    Emit("_ReportStringDone:");
+    Emit("jr $ra");
+    Emit("_ReportInt:\t\t# $a0 unsigned");
+    Emit("move $t2, $a0");
+    Emit("li $t4, 10");
+    Emit("_ReportIntCount:\t# $a1 past where the last digit goes");
+    Emit("addiu $a1, $a1, 1");
+    Emit("divu $t2, $t4");
+    Emit("mflo $t2");
+    Emit("bnez $t2, _ReportIntCount");
+    Emit("move $t2, $a1");
+    Emit("_ReportIntDigit:");
+    Emit("divu $a0, $t4");
+    Emit("mfhi $t3");
+    Emit("mflo $a0");
+    Emit("addiu $t3, $t3, 48\t# '0'");
+    Emit("addiu $t2, $t2, -1");
+    Emit("sb $t3, 0($t2)");
+    Emit("bnez $a0, _ReportIntDigit");
+    Emit("jr $ra");
+    Emit(".data");
+    Emit("_GCReport:");
+    Emit(".space 96");
+    Emit(".text");
+  }
   Emit("\n");
 }
 
+void Mips::EmitMainReturn()
+{
+  if (finishMain) Emit("jal _Finish\t\t# write out what is buffered");
+}
+
 void Mips::EmitHalt() 
 {
   Emit("%s:", "_Halt");
+  if (finishMain) Emit("jal _Finish");
   Emit("li $v0, 10");
   Emit("syscall");
   Emit("\n");
 }
 
+/* Method: EmitInput
+ * -----------------
+ * Input is read into _InBuf a buffer at a time with read, and
+ * _GetChar hands it out a byte at a time: the next byte in $v0, or -1
+ * at the end of the input. Output waiting in _OutBuf is flushed first
+ * whenever the program has to wait for more, so a prompt shows before
+ * the program blocks on it. _GetChar changes only $v0, $v1 and $a3.
+ */
+void Mips::EmitInput()
+{
+  Emit(".data");
+  Emit(".align 2");
+  Emit("_In:\t\t# next and end of the input in _InBuf, which follows");
+  Emit(".word 0, 0");
+  Emit("_InBuf:");
+  Emit(".space %d", InBufSize);
+  Emit(".text");
+  Emit("_GetChar:");
+  Emit("la $v1, _In");
+  Emit("lw $v0, 0($v1)");
+  Emit("lw $a3, 4($v1)");
+  Emit("beq $v0, $a3, _GetCharRead");
+  Emit("addiu $a3, $v0, 1");
+  Emit("sw $a3, 0($v1)");
+  Emit("lbu $v0, 0($v0)");
+  Emit("jr $ra");
+  Emit("_GetCharRead:");
+  Emit("subu $sp, $sp, 16");
+  Emit("sw $ra, 16($sp)");
+  Emit("sw $a0, 12($sp)");
+  Emit("sw $a1, 8($sp)");
+  Emit("sw $a2, 4($sp)");
+  if (HasOutput()) Emit("jal _FlushOut");
+  Emit("li $a0, 0\t\t# standard input");
+  Emit("la $a1, _InBuf");
+  Emit("li $a2, %d", InBufSize);
+  Emit("li $v0, 14      \t# system call for read");
+  Emit("syscall");
+  Emit("move $a3, $a1");
+  Emit("lw $a2, 4($sp)");
+  Emit("lw $a1, 8($sp)");
+  Emit("lw $a0, 12($sp)");
+  Emit("lw $ra, 16($sp)");
+  Emit("addiu $sp, $sp, 16");
+  Emit("la $v1, _In");
+  Emit("blez $v0, _GetCharEnd");
+  Emit("addu $v0, $a3, $v0");
+  Emit("sw $v0, 4($v1)");
+  Emit("addiu $v0, $a3, 1");
+  Emit("sw $v0, 0($v1)");
+  Emit("lbu $v0, 0($a3)");
+  Emit("jr $ra");
+  Emit("_GetCharEnd:");
+  Emit("li $v0, -1");
+  Emit("jr $ra");
+  Emit("\n");
+}
+
+  // As SPIM's read_int: leading blanks, a sign and digits, the rest of
+  // the line skipped. Only $a0-$a3, $v0 and $v1 are changed (_GetChar
+  // keeps $a0-$a2), as for the print routines.
 void Mips::EmitReadInteger() 
 {
   Emit("%s:", "_ReadInteger");
   Emit("subu $sp, $sp, 8");
-  Emit("sw $fp, 8($sp)");
   Emit("sw $ra, 4($sp)");
-  Emit("addiu $fp, $sp, 8");
-  Emit("subu $sp, $sp, 4");
-  Emit("li $v0, 5");
-  Emit("syscall");
-  Emit("move $sp, $fp");
-  Emit("lw $ra, -4($fp)");
-  Emit("lw $fp, 0($fp)");
+  Emit("li $a0, 0\t\t# the number");
+  Emit("li $a1, 0\t\t# whether it is negative");
+  Emit("_ReadIntBlank:");
+  Emit("jal _GetChar");
+  Emit("xori $v1, $v0, 10");
+  Emit("beqz $v1, _ReadIntDone");
+  Emit("addiu $v1, $v0, -9\t# \\t, \\v, \\f, \\r");
+  Emit("sltiu $v1, $v1, 5");
+  Emit("bnez $v1, _ReadIntBlank");
+  Emit("xori $v1, $v0, 32");
+  Emit("beqz $v1, _ReadIntBlank");
+  Emit("xori $v1, $v0, 45\t# '-'");
+  Emit("bnez $v1, _ReadIntPlus");
+  Emit("li $a1, 1");
+  Emit("b _ReadIntSigned");
+  Emit("_ReadIntPlus:");
+  Emit("xori $v1, $v0, 43\t# '+'");
+  Emit("bnez $v1, _ReadIntDigit");
+  Emit("_ReadIntSigned:");
+  Emit("jal _GetChar");
+  Emit("_ReadIntDigit:");
+  Emit("addiu $v1, $v0, -48");
+  Emit("sltiu $a2, $v1, 10");
+  Emit("beqz $a2, _ReadIntRest");
+  Emit("sll $a2, $a0, 3");
+  Emit("sll $a0, $a0, 1");
+  Emit("addu $a0, $a0, $a2");
+  Emit("addu $a0, $a0, $v1");
+  Emit("b _ReadIntSigned");
+  Emit("_ReadIntRest:");
+  Emit("bltz $v0, _ReadIntDone");
+  Emit("xori $v1, $v0, 10");
+  Emit("beqz $v1, _ReadIntDone");
+  Emit("jal _GetChar");
+  Emit("b _ReadIntRest");
+  Emit("_ReadIntDone:");
+  Emit("move $v0, $a0");
+  Emit("beqz $a1, _ReadIntReturn");
+  Emit("subu $v0, $zero, $a0");
+  Emit("_ReadIntReturn:");
+  Emit("lw $ra, 4($sp)");
+  Emit("addiu $sp, $sp, 8");
   Emit("jr $ra");
   Emit("\n");
 }
 
+  // The line, without its newline, in a block that doubles when the
+  // line outgrows it, so it can be any length. The blocks are in $t0
+  // while _Alloc runs, where the collector sees them.
 void Mips::EmitReadLine()
 {
   Emit("%s:", "_ReadLine");
   Emit("subu $sp, $sp, 8");
-  Emit("sw $fp, 8($sp)");
   Emit("sw $ra, 4($sp)");
-  Emit("addiu $fp, $sp, 8");
-  Emit("li $t0, 40");
-  Emit("subu $sp, $sp, 4");
-  Emit("sw $t0, 4($sp)");
-  Emit("jal _Alloc");
+  Emit("li $t2, %d\t\t# room in the block", ReadLineFirst);
+  Emit("move $a0, $t2");
+  Emit("jal _AllocA0");
   Emit("move $t0, $v0");
-  Emit("li $a1, 40");
+  Emit("li $t1, 0\t\t# length so far");
+  Emit("_ReadLineByte:");
+  Emit("jal _GetChar");
+  Emit("bltz $v0, _ReadLineDone");
+  Emit("xori $v1, $v0, 10");
+  Emit("beqz $v1, _ReadLineDone");
+  Emit("addiu $v1, $t1, 1");
+  Emit("bne $v1, $t2, _ReadLineStore\t# room for it and the terminator");
+  Emit("move $t3, $v0");
+  Emit("sll $t2, $t2, 1");
+  Emit("move $a0, $t2");
+  Emit("jal _AllocA0");
   Emit("move $a0, $t0");
-  Emit("li $v0, 8");
-  Emit("syscall");
-  Emit("move $t1, $t0");
-  Emit("%s:", "bloop4");
-  Emit("lb $t5, ($t1)");
-  Emit("beqz $t5, eloop4");
-  Emit("addi $t1, 1");
-  Emit("b bloop4");
-  Emit("%s:", "eloop4");
-  Emit("addi $t1, -1"); // erase newline
-  Emit("li $t6, 0");
-  Emit("sb $t6, ($t1)");
+  Emit("move $a1, $v0");
+  Emit("addu $a2, $t0, $t1");
+  Emit("_ReadLineCopy:");
+  Emit("lbu $a3, 0($a0)");
+  Emit("sb $a3, 0($a1)");
+  Emit("addiu $a0, $a0, 1");
+  Emit("addiu $a1, $a1, 1");
+  Emit("bne $a0, $a2, _ReadLineCopy");
+  Emit("move $t0, $v0");
+  Emit("move $v0, $t3");
+  Emit("_ReadLineStore:");
+  Emit("addu $v1, $t0, $t1");
+  Emit("sb $v0, 0($v1)");
+  Emit("addiu $t1, $t1, 1");
+  Emit("b _ReadLineByte");
+  Emit("_ReadLineDone:");
+  Emit("addu $v1, $t0, $t1");
+  Emit("sb $zero, 0($v1)");
   Emit("move $v0, $t0");
-  Emit("move $sp, $fp");
-  Emit("lw $ra, -4($fp)");
-  Emit("lw $fp, 0($fp)");
+  Emit("lw $ra, 4($sp)");
+  Emit("addiu $sp, $sp, 8");
   Emit("jr $ra");
   Emit("\n");
 }
 
 void Mips::EmitData()
 {
+  stringLabels["\"true\""] = "TRUE";     // so Print("true") shares them
+  stringLabels["\"false\""] = "FALSE";
   Emit(".data");
   Emit("%s:", "TRUE");
   Emit(".asciiz \"true\"");
@@ -727,6 +1522,37 @@ void Mips::EmitData()
   Emit("\n");
 }
 
+/* Method: StringLabel
+ * --------------------
+ * Looks the literal up in the pool, adding it with the next _stringN
+ * label if it is not there yet.
+ */
+const char *Mips::StringLabel(const char *str)
+{
+  const char *&label = stringLabels[str];
+  if (!label) {
+    char buf[16];
+    pooledStrings.push_back(str);
+    sprintf(buf, "_string%d", (int)pooledStrings.size());
+    label = strdup(buf);
+  }
+  return label;
+}
+
+/* Method: EmitStringPool
+ * ----------------------
+ * Lays out every pooled string once, in one block of the data segment
+ * after all the code.
+ */
+void Mips::EmitStringPool()
+{
+  if (pooledStrings.empty()) return;
+  Emit(".data\t\t\t# string pool");
+  for (size_t i = 0; i < pooledStrings.size(); i++)
+    Emit("_string%d: .asciiz %s", (int)i + 1, pooledStrings[i].c_str());
+  Emit(".text");
+}
+
 /* Method: NameForTac
  * ------------------
  * Returns the appropriate MIPS instruction (add, seq, etc.) for
@@ -756,6 +1582,7 @@ Mips::Mips() {
   mipsName[BinaryOp::Less] = "slt";
   mipsName[BinaryOp::And] = "and";
   mipsName[BinaryOp::Or] = "or";
+  mipsName[BinaryOp::ULess] = "sltu";
   regs[zero] = (RegContents){false, NULL, "$zero", false};
   regs[at] = (RegContents){false, NULL, "$at", false};
   regs[v0] = (RegContents){false, NULL, "$v0", false};
@@ -789,7 +1616,11 @@ Mips::Mips() {
   regs[s6] = (RegContents){false, NULL, "$s6", true};
   regs[s7] = (RegContents){false, NULL, "$s7", true};
   lastUsed = zero;
+  lastLabel = NULL;
+  inMain = false;
 }
 const char *Mips::mipsName[BinaryOp::NumOps];
+std::map<std::string, const char *> Mips::stringLabels;
+std::vector<std::string> Mips::pooledStrings;
 
 
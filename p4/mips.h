@@ -20,10 +20,15 @@
 
 #include "tac.h"
 #include "list.h"
+#include "backend.h"
+#include "codegen.h"
+#include <map>
+#include <string>
+#include <vector>
 class Location;
 
 
-class Mips {
+class Mips : public Backend {
   private:
     typedef enum {zero, at, v0, v1, a0, a1, a2, a3,
 			t0, t1, t2, t3, t4, t5, t6, t7,
@@ -38,6 +43,13 @@ class Mips {
     } regs[NumRegs];
 
     Register lastUsed;
+    bool runtime[NumBuiltIns];     // routines EmitRuntime lays out
+    int globalBytes;               // from $gp, roots for the collector
+    const char *lastLabel;         // so EmitBeginFunction knows main
+    bool inMain;
+    static bool finishMain;        // main calls _Finish before it returns
+
+    bool HasOutput() { return runtime[PrintInt] || runtime[PrintString]; }
 
     typedef enum { ForRead, ForWrite } Reason;
 
@@ -55,6 +67,9 @@ class Mips {
     static const char *mipsName[BinaryOp::NumOps];
     static const char *NameForTac(BinaryOp::OpCode code);
 
+    static std::map<std::string, const char *> stringLabels;  // literal -> label
+    static std::vector<std::string> pooledStrings;            // _stringN is N-1
+
  public:
     
     Mips();
@@ -87,17 +102,41 @@ class Mips {
     
     void EmitVTable(const char *label, List<const char*> *methodLabels);
 
-    void EmitPreamble();
+      // The preamble and runtime hold only the built-ins that used
+      // says the program calls, and those they call in turn. globals
+      // is the bytes of global variables.
+    void EmitPreamble(const bool *used, int globals);
+    void EmitRuntime();
 
+    void EmitOutput();
+    void EmitInput();
+    void EmitFinish();
     void EmitPrintInt();
     void EmitPrintString();
     void EmitPrintBool();
     void EmitAlloc();
+    void EmitCollector();
     void EmitStringEqual();
     void EmitHalt();
     void EmitReadInteger();
     void EmitReadLine();
     void EmitData();
+
+      // The label of a string literal (quotes included) in the string
+      // pool, which is emitted once, after all the code, by
+      // EmitStringPool. Identical literals share one label.
+    static const char *StringLabel(const char *str);
+    static void EmitStringPool();
+
+      // What main does before its epilogue when it returns, so that
+      // the runtime can finish up (see EmitFinish).
+    static void EmitMainReturn();
+
+      // The entry of built-in b that takes its argument (if any) in
+      // $a0, for a built-in that changes no register but $a0-$a3, $v0
+      // and $v1 (and hi/lo), so a call to it need not save the others;
+      // NULL for the rest.
+    static const char *RegisterEntry(BuiltIn b);
 };
 #endif
  
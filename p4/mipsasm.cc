@@ -0,0 +1,549 @@
+/* File: mipsasm.cc
+ * ----------------
+ * Implementation of the Assembler and MipsProgram classes. The
+ * assembler makes one pass over the source, appending predecoded
+ * instructions and data as it goes and recording a fixup for every
+ * symbol reference. The fixups are resolved once all labels are known.
+ */
+
+#include "mipsasm.h"
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+static const char *opNames[NumMipsOps] = {
+  "nop",
+  "add", "addu", "sub", "subu", "and", "or", "xor", "nor",
+  "slt", "sltu", "sllv", "srlv", "srav",
+  "mul", "div", "divu", "rem", "remu",
+  "seq", "sne", "sle", "sgt", "sge",
+  "addi", "addiu", "andi", "ori", "xori", "slti", "sltiu",
+  "sll", "srl", "sra", "li",
+  "mult", "multu", "div", "divu", "mfhi", "mflo", "mthi", "mtlo",
+  "lw", "lh", "lhu", "lb", "lbu", "sw", "sh", "sb",
+  "beq", "bne", "blt", "ble", "bgt", "bge", "bltu", "bgeu",
+  "blez", "bgtz", "bltz", "bgez",
+  "j", "jal", "jr", "jalr", "syscall", "break" };
+
+static const char *regNames[32] = {
+  "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+  "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+  "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+  "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra" };
+
+static const int RegAt = 1, RegV0 = 2, RegRa = 31;
+
+
+const char *MipsProgram::NameForOp(int op)
+{
+  return (op >= 0 && op < NumMipsOps) ? opNames[op] : "???";
+}
+
+int MipsProgram::IndexForAddress(unsigned addr) const
+{
+  if (addr < TextBase || (addr & 3)) return -1;
+  unsigned word = (addr - TextBase) >> 2;
+  return word < indexForWord.size() ? indexForWord[word] : -1;
+}
+
+int MipsProgram::IndexForLabel(const char *label) const
+{
+  map<string, unsigned>::const_iterator i = symbols.find(label);
+  return (i == symbols.end()) ? -1 : IndexForAddress(i->second);
+}
+
+const char *MipsProgram::FunctionForIndex(int index) const
+{
+  int lo = 0, hi = (int)functionStarts.size() - 1, found = -1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (functionStarts[mid].first <= index) { found = mid; lo = mid + 1; }
+    else hi = mid - 1;
+  }
+  return found < 0 ? "(unknown)" : functionStarts[found].second.c_str();
+}
+
+
+Assembler::Assembler() : prog(NULL), inText(true), lineNum(0), errors(0),
+                         textAddr(MipsProgram::TextBase) {}
+
+void Assembler::Error(const char *fmt, ...)
+{
+  va_list args;
+  fprintf(stderr, "dsim: line %d: ", lineNum);
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+  fprintf(stderr, "\n");
+  errors++;
+}
+
+/* Method: Assemble
+ * ----------------
+ * Reads the file line by line. A three instruction startup stub that
+ * calls main and then exits (the job SPIM's trap handler does) is
+ * placed at the start of the text segment.
+ */
+bool Assembler::Assemble(FILE *in, MipsProgram *program)
+{
+  char buf[4096];
+  prog = program;
+  AddBranch(OpJal, 0, 0, "main", 1);
+  AddLoadImmediate(RegV0, 10);
+  Add(OpSyscall, 0, 0, 0, 0, 1);
+  prog->functionStarts.push_back(make_pair(0, string("__start")));
+
+  while (fgets(buf, sizeof(buf), in)) {
+    lineNum++;
+    AssembleLine(buf);
+  }
+  prog->textEnd = textAddr;
+  ResolveFixups();
+  return errors == 0;
+}
+
+static string Trim(const string &s)
+{
+  size_t b = s.find_first_not_of(" \t\r\n"), e = s.find_last_not_of(" \t\r\n");
+  return b == string::npos ? "" : s.substr(b, e - b + 1);
+}
+
+static bool IsSymbolChar(char ch)
+{
+  return isalnum((unsigned char)ch) || ch == '_' || ch == '.' || ch == '$';
+}
+
+void Assembler::AssembleLine(char *buf)
+{
+  bool inString = false;           // strip the comment, respecting quotes
+  for (char *p = buf; *p; p++) {
+    if (*p == '"' && (p == buf || p[-1] != '\\')) inString = !inString;
+    else if (*p == '#' && !inString) { *p = '\0'; break; }
+  }
+  string line = Trim(buf);
+
+  while (!line.empty()) {          // any number of leading labels
+    size_t n = 0;
+    while (n < line.size() && IsSymbolChar(line[n])) n++;
+    if (n == 0 || n >= line.size() || line[n] != ':') break;
+    DefineLabel(line.substr(0, n));
+    line = Trim(line.substr(n + 1));
+  }
+  if (line.empty()) return;
+
+  size_t n = line.find_first_of(" \t");
+  string first = line.substr(0, n);
+  string rest = (n == string::npos) ? "" : Trim(line.substr(n));
+  if (first[0] == '.') {
+    Directive(first, rest);
+    return;
+  }
+  vector<string> operands;
+  while (!rest.empty()) {
+    size_t comma = rest.find(',');
+    operands.push_back(Trim(rest.substr(0, comma)));
+    if (comma == string::npos) break;
+    rest = rest.substr(comma + 1);
+  }
+  Instruction(first, operands);
+}
+
+void Assembler::DefineLabel(const string &name)
+{
+  if (prog->symbols.count(name)) {
+    Error("label '%s' is defined more than once", name.c_str());
+    return;
+  }
+  if (inText) {
+    prog->symbols[name] = textAddr;
+  } else {
+    prog->symbols[name] = MipsProgram::DataBase + prog->data.size();
+  }
+}
+
+void Assembler::AlignData(int bytes)
+{
+  while (prog->data.size() % bytes) prog->data.push_back(0);
+}
+
+void Assembler::ParseString(const string &args, bool terminate)
+{
+  if (args.size() < 2 || args[0] != '"' || args[args.size() - 1] != '"') {
+    Error("expected a quoted string");
+    return;
+  }
+  for (size_t i = 1; i + 1 < args.size(); i++) {
+    char ch = args[i];
+    if (ch == '\\' && i + 2 < args.size()) {
+      switch (args[++i]) {
+        case 'n': ch = '\n'; break;
+        case 't': ch = '\t'; break;
+        case '0': ch = '\0'; break;
+        default:  ch = args[i]; break;
+      }
+    }
+    prog->data.push_back(ch);
+  }
+  if (terminate) prog->data.push_back('\0');
+}
+
+void Assembler::Directive(const string &name, const string &args)
+{
+  if (name == ".text") { inText = true; return; }
+  if (name == ".data") { inText = false; return; }
+  if (name == ".globl" || name == ".extern") return;
+  if (name == ".align") {
+    int n;
+    if (!ParseInt(args, n) || n < 0 || n > 12) Error("bad alignment '%s'", args.c_str());
+    else if (!inText) AlignData(1 << n);
+    return;
+  }
+  if (inText) {
+    Error("directive %s is only allowed in the data segment", name.c_str());
+    return;
+  }
+  if (name == ".asciiz" || name == ".ascii") {
+    ParseString(args, name == ".asciiz");
+  } else if (name == ".space") {
+    int n;
+    if (!ParseInt(args, n) || n < 0) Error("bad size '%s'", args.c_str());
+    else prog->data.resize(prog->data.size() + n, 0);
+  } else if (name == ".word" || name == ".half" || name == ".byte") {
+    int width = (name == ".word") ? 4 : (name == ".half") ? 2 : 1;
+    AlignData(width);
+    string rest = args;
+    while (!rest.empty()) {
+      size_t comma = rest.find(',');
+      string item = Trim(rest.substr(0, comma));
+      int value = 0;
+      if (!ParseInt(item, value)) {
+        if (width != 4) Error("symbol '%s' needs a .word", item.c_str());
+        Fixup f = { (int)prog->data.size(), item, 0, lineNum, false, true };
+        fixups.push_back(f);
+      }
+      for (int i = 0; i < width; i++)          // little-endian, like SPIM on x86
+        prog->data.push_back((value >> (8 * i)) & 0xff);
+      if (comma == string::npos) break;
+      rest = rest.substr(comma + 1);
+    }
+  } else {
+    Error("unknown directive %s", name.c_str());
+  }
+}
+
+
+bool Assembler::IsRegister(const string &s)
+{
+  return !s.empty() && s[0] == '$';
+}
+
+int Assembler::Register(const string &s)
+{
+  if (IsRegister(s)) {
+    string name = s.substr(1);
+    if (!name.empty() && isdigit((unsigned char)name[0])) {
+      int n = atoi(name.c_str());
+      if (n >= 0 && n < 32) return n;
+    }
+    if (name == "s8") return 30;
+    for (int i = 0; i < 32; i++)
+      if (name == regNames[i]) return i;
+  }
+  Error("expected a register, found '%s'", s.c_str());
+  return 0;
+}
+
+bool Assembler::ParseInt(const string &s, int &value)
+{
+  if (s.empty()) return false;
+  const char *p = s.c_str();
+  char *end;
+  if (*p == '\'' && s.size() == 3 && p[2] == '\'') { value = p[1]; return true; }
+  if (!isdigit((unsigned char)*p) && !((*p == '-' || *p == '+') && isdigit((unsigned char)p[1])))
+    return false;
+  value = (int)strtoll(p, &end, 0);
+  return *end == '\0';
+}
+
+/* Method: ParseMemory
+ * -------------------
+ * Parses the addressing forms off(reg), (reg) and a plain constant
+ * address. Symbolic addresses are handled by the caller through $at.
+ */
+bool Assembler::ParseMemory(const string &s, int &offset, int &base)
+{
+  size_t open = s.find('(');
+  offset = 0;
+  base = 0;
+  if (open == string::npos) return ParseInt(s, offset);
+  if (s[s.size() - 1] != ')') return false;
+  string off = Trim(s.substr(0, open));
+  if (!off.empty() && !ParseInt(off, offset)) return false;
+  base = Register(Trim(s.substr(open + 1, s.size() - open - 2)));
+  return true;
+}
+
+
+void Assembler::Add(int op, int rd, int rs, int rt, int imm, int size)
+{
+  Insn insn = { (unsigned char)op, (unsigned char)rd, (unsigned char)rs,
+                (unsigned char)rt, imm };
+  if (!inText) Error("instruction outside the text segment");
+  prog->code.push_back(insn);
+  prog->address.push_back(textAddr);
+  prog->size.push_back(size);
+  prog->line.push_back(lineNum);
+  textAddr += 4 * size;
+}
+
+void Assembler::AddBranch(int op, int rs, int rt, const string &target, int size)
+{
+  Fixup f = { (int)prog->code.size(), target, 0, lineNum, true, false };
+  fixups.push_back(f);
+  Add(op, 0, rs, rt, 0, size);
+}
+
+void Assembler::AddLoadImmediate(int rd, int value)
+{
+  bool small = (value >= -32768 && value <= 65535);
+  Add(OpLi, rd, 0, 0, value, small ? 1 : 2);
+}
+
+/* Method: LoadToAt
+ * ----------------
+ * Used when a register operand was given as a constant: emits li $at
+ * and substitutes $at, as the SPIM assembler does.
+ */
+bool Assembler::LoadToAt(const string &operand, int &reg)
+{
+  if (IsRegister(operand)) {
+    reg = Register(operand);
+    return true;
+  }
+  int value;
+  if (!ParseInt(operand, value)) return false;
+  AddLoadImmediate(RegAt, value);
+  reg = RegAt;
+  return true;
+}
+
+  // Machine instructions needed by each three-operand pseudo-op.
+static int SizeOf(int op)
+{
+  switch (op) {
+    case OpMul: case OpSeq: case OpSne: case OpSle: case OpSge: return 2;
+    case OpDiv3: case OpDivu3: case OpRem: case OpRemu: return 4;
+    case OpBlt: case OpBle: case OpBgt: case OpBge: case OpBltu: case OpBgeu: return 2;
+    default: return 1;
+  }
+}
+
+static bool WritesRd(int op)   // results that land in rd (and only there)
+{
+  return (op >= OpAdd && op <= OpLi) || op == OpMfhi || op == OpMflo ||
+         (op >= OpLw && op <= OpLbu);
+}
+
+void Assembler::InstructionBody(const string &m, vector<string> &ops)
+{
+  static const struct { const char *name; int reg, imm; } alu[] = {
+    {"add", OpAdd, OpAddi}, {"addu", OpAddu, OpAddiu}, {"sub", OpSub, -OpAddi},
+    {"subu", OpSubu, -OpAddiu}, {"and", OpAnd, OpAndi}, {"or", OpOr, OpOri},
+    {"xor", OpXor, OpXori}, {"nor", OpNor, 0}, {"slt", OpSlt, OpSlti},
+    {"sltu", OpSltu, OpSltiu}, {"sllv", OpSllv, 0}, {"srlv", OpSrlv, 0},
+    {"srav", OpSrav, 0}, {"mul", OpMul, 0}, {"rem", OpRem, 0}, {"remu", OpRemu, 0},
+    {"seq", OpSeq, 0}, {"sne", OpSne, 0}, {"sle", OpSle, 0}, {"sgt", OpSgt, 0},
+    {"sge", OpSge, 0}, {"div", OpDiv3, 0}, {"divu", OpDivu3, 0},
+    {"addi", OpAdd, OpAddi}, {"addiu", OpAddu, OpAddiu}, {"andi", OpAnd, OpAndi},
+    {"ori", OpOr, OpOri}, {"xori", OpXor, OpXori}, {"slti", OpSlt, OpSlti},
+    {"sltiu", OpSltu, OpSltiu} };
+  static const struct { const char *name; int op, nregs; } branches[] = {
+    {"beq", OpBeq, 2}, {"bne", OpBne, 2}, {"blt", OpBlt, 2}, {"ble", OpBle, 2},
+    {"bgt", OpBgt, 2}, {"bge", OpBge, 2}, {"bltu", OpBltu, 2}, {"bgeu", OpBgeu, 2},
+    {"beqz", OpBeq, 1}, {"bnez", OpBne, 1}, {"blez", OpBlez, 1},
+    {"bgtz", OpBgtz, 1}, {"bltz", OpBltz, 1}, {"bgez", OpBgez, 1} };
+  static const struct { const char *name; int op; } memory[] = {
+    {"lw", OpLw}, {"lh", OpLh}, {"lhu", OpLhu}, {"lb", OpLb}, {"lbu", OpLbu},
+    {"sw", OpSw}, {"sh", OpSh}, {"sb", OpSb} };
+  int n = ops.size();
+
+  if ((m == "div" || m == "divu" || m == "mult" || m == "multu") && n == 2) {
+    int op = (m == "div") ? OpDiv : (m == "divu") ? OpDivu : (m == "mult") ? OpMult : OpMultu;
+    Add(op, 0, Register(ops[0]), Register(ops[1]), 0, 1);
+    return;
+  }
+  for (size_t i = 0; i < sizeof(alu) / sizeof(alu[0]); i++) {
+    if (m != alu[i].name) continue;
+    if (n == 2) ops.insert(ops.begin(), ops[0]);   // addi $t0, 1 means $t0 = $t0 + 1
+    if (ops.size() != 3) { Error("%s takes three operands", m.c_str()); return; }
+    int rd = Register(ops[0]), rs = Register(ops[1]), value;
+    if (IsRegister(ops[2])) {
+      int op = alu[i].reg;
+      Add(op, rd, rs, Register(ops[2]), 0, SizeOf(op));
+    } else if (!ParseInt(ops[2], value)) {
+      Error("bad operand '%s'", ops[2].c_str());
+    } else {
+      int op = alu[i].imm < 0 ? -alu[i].imm : alu[i].imm;
+      if (alu[i].imm < 0) value = -value;
+      bool logical = (op == OpAndi || op == OpOri || op == OpXori);
+      bool fits = logical ? (value >= 0 && value <= 65535) : (value >= -32768 && value <= 32767);
+      if (op && fits) {
+        Add(op, rd, rs, 0, value, 1);
+      } else {
+        int rop = alu[i].reg;
+        if (alu[i].imm < 0) { rop = (rop == OpSub) ? OpAdd : OpAddu; }
+        AddLoadImmediate(RegAt, value);
+        Add(rop, rd, rs, RegAt, 0, SizeOf(rop));
+      }
+    }
+    return;
+  }
+  if (m == "sll" || m == "srl" || m == "sra") {
+    if (n != 3) { Error("%s takes three operands", m.c_str()); return; }
+    int rd = Register(ops[0]), rt = Register(ops[1]), amount;
+    if (IsRegister(ops[2])) {
+      int op = (m == "sll") ? OpSllv : (m == "srl") ? OpSrlv : OpSrav;
+      Add(op, rd, rt, Register(ops[2]), 0, 1);
+    } else if (!ParseInt(ops[2], amount) || amount < 0 || amount > 31) {
+      Error("bad shift amount '%s'", ops[2].c_str());
+    } else {
+      int op = (m == "sll") ? OpSll : (m == "srl") ? OpSrl : OpSra;
+      Add(op, rd, rt, 0, amount, 1);
+    }
+    return;
+  }
+  for (size_t i = 0; i < sizeof(branches) / sizeof(branches[0]); i++) {
+    if (m != branches[i].name) continue;
+    if (n != branches[i].nregs + 1) { Error("wrong number of operands to %s", m.c_str()); return; }
+    int rs = Register(ops[0]), rt = 0;
+    if (branches[i].nregs == 2 && !LoadToAt(ops[1], rt)) {
+      Error("bad operand '%s'", ops[1].c_str());
+      return;
+    }
+    AddBranch(branches[i].op, rs, rt, ops[n - 1], SizeOf(branches[i].op));
+    return;
+  }
+  for (size_t i = 0; i < sizeof(memory) / sizeof(memory[0]); i++) {
+    if (m != memory[i].name) continue;
+    if (n != 2) { Error("%s takes two operands", m.c_str()); return; }
+    int rt = Register(ops[0]), offset, base;
+    if (!ParseMemory(ops[1], offset, base)) {     // symbolic address: la $at, sym
+      Fixup f = { (int)prog->code.size(), ops[1], 0, lineNum, false, false };
+      fixups.push_back(f);
+      Add(OpLi, RegAt, 0, 0, 0, 2);
+      offset = 0;
+      base = RegAt;
+    }
+    Add(memory[i].op, rt, base, rt, offset, 1);
+    return;
+  }
+
+  if (m == "li" && n == 2) {
+    int value;
+    if (!ParseInt(ops[1], value)) Error("bad constant '%s'", ops[1].c_str());
+    else AddLoadImmediate(Register(ops[0]), value);
+  } else if (m == "lui" && n == 2) {
+    int value;
+    if (!ParseInt(ops[1], value)) Error("bad constant '%s'", ops[1].c_str());
+    else Add(OpLi, Register(ops[0]), 0, 0, value << 16, 1);
+  } else if (m == "la" && n == 2) {
+    int rd = Register(ops[0]), offset, base;
+    if (ops[1].find('(') != string::npos && ParseMemory(ops[1], offset, base)) {
+      Add(OpAddiu, rd, base, 0, offset, 1);
+    } else {
+      Fixup f = { (int)prog->code.size(), ops[1], 0, lineNum, false, false };
+      fixups.push_back(f);
+      Add(OpLi, rd, 0, 0, 0, 2);
+    }
+  } else if (m == "move" && n == 2) {
+    Add(OpAddu, Register(ops[0]), Register(ops[1]), 0, 0, 1);
+  } else if ((m == "neg" || m == "negu") && n == 2) {
+    Add(m == "neg" ? OpSub : OpSubu, Register(ops[0]), 0, Register(ops[1]), 0, 1);
+  } else if (m == "not" && n == 2) {
+    Add(OpNor, Register(ops[0]), Register(ops[1]), 0, 0, 1);
+  } else if ((m == "mfhi" || m == "mflo") && n == 1) {
+    Add(m == "mfhi" ? OpMfhi : OpMflo, Register(ops[0]), 0, 0, 0, 1);
+  } else if ((m == "mthi" || m == "mtlo") && n == 1) {
+    Add(m == "mthi" ? OpMthi : OpMtlo, 0, Register(ops[0]), 0, 0, 1);
+  } else if ((m == "b" || m == "j") && n == 1) {
+    AddBranch(m == "b" ? OpBeq : OpJ, 0, 0, ops[0], 1);
+  } else if (m == "jal" && n == 1) {
+    if (IsRegister(ops[0])) Add(OpJalr, RegRa, Register(ops[0]), 0, 0, 1);
+    else AddBranch(OpJal, 0, 0, ops[0], 1);
+  } else if (m == "jr" && n == 1) {
+    Add(OpJr, 0, Register(ops[0]), 0, 0, 1);
+  } else if (m == "jalr" && (n == 1 || n == 2)) {
+    Add(OpJalr, n == 2 ? Register(ops[0]) : RegRa, Register(ops[n - 1]), 0, 0, 1);
+  } else if (m == "syscall" && n == 0) {
+    Add(OpSyscall, 0, 0, 0, 0, 1);
+  } else if (m == "break") {
+    Add(OpBreak, 0, 0, 0, 0, 1);
+  } else if (m == "nop" && n == 0) {
+    Add(OpNop, 0, 0, 0, 0, 1);
+  } else {
+    Error("unknown instruction or bad operands: %s", m.c_str());
+  }
+}
+
+/* Method: Instruction
+ * -------------------
+ * Assembles one instruction. Writes to $zero are discarded, so any
+ * instruction whose only effect is to set $zero becomes a nop and the
+ * simulator never has to re-clear the register.
+ */
+void Assembler::Instruction(const string &m, vector<string> &ops)
+{
+  size_t before = prog->code.size();
+  InstructionBody(m, ops);
+  for (size_t i = before; i < prog->code.size(); i++)
+    if (prog->code[i].rd == 0 && WritesRd(prog->code[i].op))
+      prog->code[i].op = OpNop;
+}
+
+/* Method: ResolveFixups
+ * ---------------------
+ * Builds the address to instruction map, then patches branch targets
+ * (as Insn indices), la/li constants and .word data with the values
+ * of the symbols they refer to. Text labels that are targets of jal
+ * or whose address is taken (vtables, la) are taken to start functions.
+ */
+void Assembler::ResolveFixups()
+{
+  prog->indexForWord.assign((textAddr - MipsProgram::TextBase) / 4, -1);
+  for (size_t i = 0; i < prog->code.size(); i++)
+    prog->indexForWord[(prog->address[i] - MipsProgram::TextBase) / 4] = i;
+
+  for (size_t i = 0; i < fixups.size(); i++) {
+    Fixup &f = fixups[i];
+    string name = f.symbol;
+    int addend = 0;
+    size_t plus = name.find_first_of("+-", 1);
+    if (plus != string::npos && ParseInt(name.substr(plus), addend))
+      name = Trim(name.substr(0, plus));
+    lineNum = f.line;
+    map<string, unsigned>::iterator sym = prog->symbols.find(name);
+    if (sym == prog->symbols.end()) {
+      Error("undefined symbol '%s'", name.c_str());
+      continue;
+    }
+    unsigned value = sym->second + addend;
+    int index = prog->IndexForAddress(value);
+    bool isCall = !f.isBranch || prog->code[f.index].op == OpJal;
+    if (index >= 0 && isCall && addend == 0)    // called, or its address taken
+      prog->functionStarts.push_back(make_pair(index, name));
+    if (f.isData) {
+      memcpy(&prog->data[f.index], &value, 4);
+    } else if (f.isBranch) {
+      int target = prog->IndexForAddress(value);
+      if (target < 0) Error("branch target '%s' is not an instruction", name.c_str());
+      prog->code[f.index].imm = target;
+    } else {
+      prog->code[f.index].imm = value;
+    }
+  }
+  sort(prog->functionStarts.begin(), prog->functionStarts.end());
+  prog->functionStarts.erase(unique(prog->functionStarts.begin(), prog->functionStarts.end()),
+                             prog->functionStarts.end());
+}
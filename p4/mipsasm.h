@@ -0,0 +1,132 @@
+/* File: mipsasm.h
+ * ---------------
+ * The Assembler class reads the MIPS assembly produced by dcc (the
+ * subset emitted by the Mips class plus the rest of the common MIPS32
+ * integer instructions and SPIM pseudo-instructions) and builds a
+ * MipsProgram, the in-memory image run by the simulator (see
+ * mipssim.h). It understands the .text, .data, .asciiz, .ascii,
+ * .word, .byte, .space, .align and .globl directives.
+ *
+ * Instructions are predecoded into a compact Insn array instead of
+ * being encoded into 32-bit machine words. Each pseudo-instruction
+ * (li, la, mul, rem, seq, blt, ...) stays a single Insn so it can be
+ * executed in one dispatch, but it records how many machine
+ * instructions a straightforward expansion needs (li of a large
+ * constant is lui+ori, mul is mult+mflo, and so on). Text addresses
+ * are assigned from those sizes, so labels, $ra values and vtable
+ * entries look like those of a real encoding.
+ */
+
+#ifndef _H_mipsasm
+#define _H_mipsasm
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+  // Internal opcodes. Most map to one MIPS instruction; the three
+  // operand forms of mul/div/rem and the set/branch pseudo-ops are
+  // kept whole. Register-immediate forms use the imm field.
+typedef enum {
+  OpNop,
+  OpAdd, OpAddu, OpSub, OpSubu, OpAnd, OpOr, OpXor, OpNor,
+  OpSlt, OpSltu, OpSllv, OpSrlv, OpSrav,
+  OpMul, OpDiv3, OpDivu3, OpRem, OpRemu,
+  OpSeq, OpSne, OpSle, OpSgt, OpSge,
+  OpAddi, OpAddiu, OpAndi, OpOri, OpXori, OpSlti, OpSltiu,
+  OpSll, OpSrl, OpSra, OpLi,
+  OpMult, OpMultu, OpDiv, OpDivu, OpMfhi, OpMflo, OpMthi, OpMtlo,
+  OpLw, OpLh, OpLhu, OpLb, OpLbu, OpSw, OpSh, OpSb,
+  OpBeq, OpBne, OpBlt, OpBle, OpBgt, OpBge, OpBltu, OpBgeu,
+  OpBlez, OpBgtz, OpBltz, OpBgez,
+  OpJ, OpJal, OpJr, OpJalr, OpSyscall, OpBreak,
+  NumMipsOps
+} MipsOp;
+
+  // One predecoded instruction. For branches and j/jal, imm holds the
+  // index of the target Insn; for everything else it is the immediate
+  // or memory offset.
+struct Insn {
+  unsigned char op, rd, rs, rt;
+  int imm;
+};
+
+class MipsProgram {
+  public:
+    static const unsigned TextBase = 0x00400000;
+    static const unsigned DataBase = 0x10000000;
+
+    vector<Insn> code;
+    vector<unsigned> address;     // text address of each Insn
+    vector<unsigned char> size;   // machine instructions each Insn stands for
+    vector<int> line;             // source line of each Insn, for errors
+    vector<unsigned char> data;   // initial contents of the data segment
+    map<string, unsigned> symbols;
+    unsigned textEnd;             // first address past the last Insn
+
+    static const char *NameForOp(int op);
+
+      // Maps a text address to the index of the Insn that starts there,
+      // or -1 if no instruction starts at that address.
+    int IndexForAddress(unsigned addr) const;
+
+      // Returns the index of the Insn at the given label, -1 if undefined.
+    int IndexForLabel(const char *label) const;
+
+      // The function containing the Insn: the closest preceding label
+      // that is called with jal or has its address taken. Used for
+      // errors and to attribute statistics to functions.
+    const char *FunctionForIndex(int index) const;
+
+  private:
+    vector<int> indexForWord;     // (addr - TextBase)/4 -> Insn index
+    vector<pair<int, string> > functionStarts;
+    friend class Assembler;
+    friend class Translator;
+};
+
+class Assembler {
+  public:
+    Assembler();
+
+      // Assembles the whole file into program. Reports problems on
+      // stderr (with line numbers) and returns false if there were any.
+    bool Assemble(FILE *in, MipsProgram *program);
+
+  private:
+    struct Fixup {
+        int index;            // Insn (or data offset for .word) to patch
+        string symbol;
+        int addend, line;
+        bool isBranch, isData;
+    };
+
+    MipsProgram *prog;
+    bool inText;
+    int lineNum, errors;
+    unsigned textAddr;
+    vector<Fixup> fixups;
+
+    void Error(const char *fmt, ...);
+    void AssembleLine(char *line);
+    void Directive(const string &name, const string &args);
+    void Instruction(const string &mnemonic, vector<string> &operands);
+    void InstructionBody(const string &mnemonic, vector<string> &operands);
+    void DefineLabel(const string &name);
+    void Add(int op, int rd, int rs, int rt, int imm, int size);
+    void AddBranch(int op, int rs, int rt, const string &target, int size);
+    void AddLoadImmediate(int rd, int value);
+    bool LoadToAt(const string &operand, int &reg);
+    void ResolveFixups();
+
+    int Register(const string &operand);
+    bool IsRegister(const string &operand);
+    bool ParseInt(const string &s, int &value);
+    bool ParseMemory(const string &operand, int &offset, int &base);
+    void ParseString(const string &args, bool terminate);
+    void AlignData(int bytes);
+};
+
+#endif
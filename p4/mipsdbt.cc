@@ -0,0 +1,442 @@
+/* File: mipsdbt.cc
+ * ----------------
+ * Implementation of the Translator class. Register use in translated
+ * code: rbx = &regs[0] (hi, lo and the other Simulator fields the code
+ * touches are addressed relative to it), r12 = host address of
+ * simulated address 0, r13 = the entry table, r14 = the program's
+ * address to Insn index map; eax, ecx and edx are scratch. A block
+ * leaves with the index of the next Insn to interpret in eax.
+ */
+
+#include "mipsdbt.h"
+#include "mipssim.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static const int RegRa = 31;
+
+  // The register array slot of a simulated register.
+static X86Mem R(int reg)
+{
+  return Mem(RBX, 4 * reg);
+}
+
+
+Translator::Translator(Simulator *simulator)
+  : sim(simulator), code(&simulator->code[0]), numInsns(simulator->code.size()),
+    blocks(0), flushes(0)
+{
+  void *m = mmap(NULL, CacheSize, PROT_READ | PROT_WRITE | PROT_EXEC,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (m == MAP_FAILED) {
+    fprintf(stderr, "dsim: cannot allocate the translation cache\n");
+    exit(1);
+  }
+  cache = (unsigned char *)m;
+  entry.assign(numInsns, (void *)NULL);
+  heat.assign(numInsns, 0);
+
+    // The entry trampoline: save the callee-saved registers, load the
+    // fixed ones from the arguments and jump into the block. The exit
+    // path after it undoes that and returns eax.
+  X86Encoder e(cache, CacheSize);
+  e.Push(RBX); e.Push(RBP); e.Push(R12); e.Push(R13); e.Push(R14); e.Push(R15);
+  e.AluImm(AluSub, RSP, 8, true);
+  e.Mov(RBX, RSI, true);
+  e.Mov(R12, RDX, true);
+  e.Mov(R13, RCX, true);
+  e.Mov(R14, R8, true);
+  e.JmpReg(RDI);
+  epilogue = cache + e.Here();
+  e.AluImm(AluAdd, RSP, 8, true);
+  e.Pop(R15); e.Pop(R14); e.Pop(R13); e.Pop(R12); e.Pop(RBP); e.Pop(RBX);
+  e.Ret();
+  enter = (EnterFunction)(void *)cache;
+  cacheStart = cacheUsed = (e.Here() + 15) & ~15;
+}
+
+Translator::~Translator()
+{
+  munmap(cache, CacheSize);
+}
+
+int Translator::Enter(void *block)
+{
+  unsigned char *memoryBase = (unsigned char *)((uintptr_t)sim->memory - MipsProgram::DataBase);
+  return enter(block, sim->regs, memoryBase, &entry[0], &sim->prog->indexForWord[0]);
+}
+
+  // Displacement of a Simulator field from rbx.
+int Translator::Offset(const void *member)
+{
+  return (const char *)member - (const char *)sim->regs;
+}
+
+void Translator::JumpTo(X86Encoder &e, const void *target)
+{
+  size_t at = e.Jmp();
+  if (!e.Full()) X86Encoder::PatchAbsolute(e.Start() + at, target);
+}
+
+void Translator::Count(X86Encoder &e, int done)
+{
+  if (done > 0) e.AluImm(AluAdd, Mem(RBX, Offset(&sim->translated)), done, true);
+}
+
+/* Method: ExitTo
+ * --------------
+ * Leaves the block for a known Insn after `done` Insns. The jump is
+ * linked to the target's translation when the block is installed;
+ * until then it falls through into a stub that returns to the
+ * interpreter.
+ */
+void Translator::ExitTo(X86Encoder &e, int target, int done)
+{
+  Count(e, done);
+  size_t at = e.Jmp();
+  e.Patch(at, e.Here());
+  links.push_back(make_pair(at, target));
+  e.MovImm(RAX, target);
+  JumpTo(e, epilogue);
+}
+
+  // Jumps out of line, if cond holds, to a stub that returns to the
+  // interpreter at index, which then re-executes that Insn itself. The
+  // stub returns ~index so that the interpreter knows not to enter a
+  // translation there (it would fail the same way at once).
+size_t Translator::Fault(X86Encoder &e, X86Cond cond, int index, int done)
+{
+  Exit f = { e.Jcc(cond), index, done };
+  faults.push_back(f);
+  return f.jump;
+}
+
+/* Method: ExitIndirect
+ * --------------------
+ * jr and jalr: maps the address in the rs register to an Insn index
+ * the way MipsProgram::IndexForAddress does and continues in its
+ * translation if there is one. Bad addresses go back to the
+ * interpreter, which reports them. For jalr, link is the register
+ * that gets the return address.
+ */
+void Translator::ExitIndirect(X86Encoder &e, int index, int done, int link)
+{
+  const Insn &insn = code[index];
+  e.Mov(RAX, R(insn.rs));
+  e.AluImm(AluSub, RAX, MipsProgram::TextBase);
+  e.TestImm(RAX, 3);
+  Fault(e, CondNE, index, done - 1);
+  e.Shift(ShiftShr, RAX, 2);
+  e.AluImm(AluCmp, RAX, sim->prog->indexForWord.size());
+  Fault(e, CondAE, index, done - 1);
+  e.Mov(RAX, Mem(R14, RAX, 4, 0));
+  e.Test(RAX, RAX);
+  Fault(e, CondS, index, done - 1);
+  if (link >= 0) e.MovImm(R(link), sim->nextAddress[index]);
+  Count(e, done);
+  e.Mov(RCX, Mem(R13, RAX, 8, 0), true);
+  e.Test(RCX, RCX, true);
+  size_t at = e.Jcc(CondE);
+  if (!e.Full()) X86Encoder::PatchAbsolute(e.Start() + at, epilogue);
+  e.JmpReg(RCX);
+}
+
+/* Method: CheckAddress
+ * --------------------
+ * Computes rs + offset into eax and checks it the way the interpreter
+ * does. For an aligned access the Simulator's range test reduces to
+ * "in the stack or below the heap end", since both limits are word
+ * aligned.
+ */
+void Translator::CheckAddress(X86Encoder &e, int index, int done, int bytes)
+{
+  const Insn &insn = code[index];
+  e.Mov(RAX, R(insn.rs));
+  if (insn.imm) e.AluImm(AluAdd, RAX, insn.imm);
+  if (bytes > 1) {
+    e.TestImm(RAX, bytes - 1);
+    Fault(e, CondNE, index, done - 1);
+  }
+  e.Lea(RCX, Mem(RAX, -(int)sim->stackLow));
+  e.AluImm(AluCmp, RCX, Simulator::StackLimit);
+  size_t inStack = e.Jcc(CondB);
+  e.Lea(RCX, Mem(RAX, -(int)MipsProgram::DataBase));
+  e.Alu(AluCmp, RCX, Mem(RBX, Offset(&sim->heapBytes)));
+  Fault(e, CondAE, index, done - 1);
+  e.Patch(inStack, e.Here());
+}
+
+static X86Cond SetCondition(int op)
+{
+  switch (op) {
+    case OpSlt: case OpSlti: return CondL;
+    case OpSltu: case OpSltiu: return CondB;
+    case OpSeq: return CondE;
+    case OpSne: return CondNE;
+    case OpSle: return CondLE;
+    case OpSgt: return CondG;
+    default: return CondGE;                 // OpSge
+  }
+}
+
+static X86Cond BranchCondition(int op)
+{
+  switch (op) {
+    case OpBeq: return CondE;
+    case OpBne: return CondNE;
+    case OpBlt: case OpBltz: return CondL;
+    case OpBle: case OpBlez: return CondLE;
+    case OpBgt: case OpBgtz: return CondG;
+    case OpBge: case OpBgez: return CondGE;
+    case OpBltu: return CondB;
+    default: return CondAE;                 // OpBgeu
+  }
+}
+
+static X86Cond Invert(X86Cond c)
+{
+  return (X86Cond)(c ^ 1);
+}
+
+/* Method: Block
+ * -------------
+ * Translates the superblock starting at index. `done` is the number of
+ * Insns completed when control leaves at a given point, which is what
+ * each exit adds to the instruction count.
+ */
+void Translator::Block(X86Encoder &e, int index)
+{
+  static const X86Alu alu[] = { AluAdd, AluAdd, AluSub, AluSub, AluAnd, AluOr, AluXor, AluOr };
+  static const X86Shift shift[] = { ShiftShl, ShiftShr, ShiftSar };
+
+  for (int i = index; ; i++) {
+    const Insn &insn = code[i];
+    int op = insn.op, done = i - index + 1;
+    if (op == OpSyscall || op == OpBreak || op >= NumMipsOps || done > MaxBlockInsns) {
+      ExitTo(e, i, done - 1);
+      return;
+    }
+    switch (op) {
+      case OpNop:
+        break;
+      case OpAdd: case OpAddu: case OpSub: case OpSubu:
+      case OpAnd: case OpOr: case OpXor: case OpNor:
+        e.Mov(RAX, R(insn.rs));
+        e.Alu(alu[op - OpAdd], RAX, R(insn.rt));
+        if (op == OpAdd || op == OpSub) Fault(e, CondO, i, done - 1);
+        if (op == OpNor) e.Not(RAX);
+        e.Mov(R(insn.rd), RAX);
+        break;
+      case OpSlt: case OpSltu: case OpSeq: case OpSne: case OpSle: case OpSgt: case OpSge:
+        e.Mov(RCX, R(insn.rs));
+        e.Alu(AluXor, RAX, RAX);             // before the compare: xor sets flags
+        e.Alu(AluCmp, RCX, R(insn.rt));
+        e.Setcc(SetCondition(op), RAX);
+        e.Mov(R(insn.rd), RAX);
+        break;
+      case OpSllv: case OpSrlv: case OpSrav:
+        e.Mov(RCX, R(insn.rt));
+        e.Mov(RAX, R(insn.rs));
+        e.ShiftCl(shift[op - OpSllv], RAX);
+        e.Mov(R(insn.rd), RAX);
+        break;
+      case OpMul:
+        e.Mov(RAX, R(insn.rs));
+        e.Imul(RAX, R(insn.rt));
+        e.Mov(R(insn.rd), RAX);
+        break;
+      case OpDiv3: case OpRem: {
+        e.Mov(RCX, R(insn.rt));
+        e.Test(RCX, RCX);
+        Fault(e, CondE, i, done - 1);
+        e.Mov(RAX, R(insn.rs));
+        e.AluImm(AluCmp, RCX, -1);           // INT_MIN / -1 would trap on x86
+        size_t normal = e.Jcc(CondNE);
+        if (op == OpDiv3) e.Neg(RAX);
+        else e.MovImm(RAX, 0);
+        size_t join = e.Jmp();
+        e.Patch(normal, e.Here());
+        e.Cdq();
+        e.Div(RCX, true);
+        if (op == OpRem) e.Mov(RAX, RDX);
+        e.Patch(join, e.Here());
+        e.Mov(R(insn.rd), RAX);
+        break;
+      }
+      case OpDivu3: case OpRemu:
+        e.Mov(RCX, R(insn.rt));
+        e.Test(RCX, RCX);
+        Fault(e, CondE, i, done - 1);
+        e.Mov(RAX, R(insn.rs));
+        e.Alu(AluXor, RDX, RDX);
+        e.Div(RCX, false);
+        e.Mov(R(insn.rd), op == OpDivu3 ? RAX : RDX);
+        break;
+      case OpAddi: case OpAddiu: case OpAndi: case OpOri: case OpXori: {
+        static const X86Alu immAlu[] = { AluAdd, AluAdd, AluAnd, AluOr, AluXor };
+        e.Mov(RAX, R(insn.rs));
+        e.AluImm(immAlu[op - OpAddi], RAX, insn.imm);
+        if (op == OpAddi) Fault(e, CondO, i, done - 1);
+        e.Mov(R(insn.rd), RAX);
+        break;
+      }
+      case OpSlti: case OpSltiu:
+        e.Mov(RCX, R(insn.rs));
+        e.Alu(AluXor, RAX, RAX);
+        e.AluImm(AluCmp, RCX, insn.imm);
+        e.Setcc(SetCondition(op), RAX);
+        e.Mov(R(insn.rd), RAX);
+        break;
+      case OpSll: case OpSrl: case OpSra:
+        e.Mov(RAX, R(insn.rs));
+        e.Shift(shift[op - OpSll], RAX, insn.imm);
+        e.Mov(R(insn.rd), RAX);
+        break;
+      case OpLi:
+        e.MovImm(R(insn.rd), insn.imm);
+        break;
+      case OpMult: case OpMultu:
+        e.Mov(RAX, R(insn.rs));
+        e.Mul64(R(insn.rt), op == OpMult);
+        e.Mov(Mem(RBX, Offset(&sim->lo)), RAX);
+        e.Mov(Mem(RBX, Offset(&sim->hi)), RDX);
+        break;
+      case OpDiv: case OpDivu: {               // no trap; HI/LO unchanged on zero
+        e.Mov(RCX, R(insn.rt));
+        e.Test(RCX, RCX);
+        size_t skip = e.Jcc(CondE), skip2 = 0;
+        e.Mov(RAX, R(insn.rs));
+        if (op == OpDiv) {
+          e.AluImm(AluCmp, RCX, -1);
+          size_t normal = e.Jcc(CondNE);
+          e.Neg(RAX);
+          e.Alu(AluXor, RDX, RDX);
+          skip2 = e.Jmp();
+          e.Patch(normal, e.Here());
+          e.Cdq();
+          e.Div(RCX, true);
+        } else {
+          e.Alu(AluXor, RDX, RDX);
+          e.Div(RCX, false);
+        }
+        if (op == OpDiv) e.Patch(skip2, e.Here());
+        e.Mov(Mem(RBX, Offset(&sim->lo)), RAX);
+        e.Mov(Mem(RBX, Offset(&sim->hi)), RDX);
+        e.Patch(skip, e.Here());
+        break;
+      }
+      case OpMfhi: case OpMflo:
+        e.Mov(RAX, Mem(RBX, Offset(op == OpMfhi ? &sim->hi : &sim->lo)));
+        e.Mov(R(insn.rd), RAX);
+        break;
+      case OpMthi: case OpMtlo:
+        e.Mov(RAX, R(insn.rs));
+        e.Mov(Mem(RBX, Offset(op == OpMthi ? &sim->hi : &sim->lo)), RAX);
+        break;
+      case OpLw: case OpLh: case OpLhu: case OpLb: case OpLbu: {
+        X86Mem host = Mem(R12, RAX, 1, 0);
+        CheckAddress(e, i, done, op == OpLw ? 4 : (op == OpLh || op == OpLhu) ? 2 : 1);
+        if (op == OpLw) e.Mov(RDX, host);
+        else if (op == OpLh || op == OpLhu) e.Load16(RDX, host, op == OpLh);
+        else e.Load8(RDX, host, op == OpLb);
+        e.Mov(R(insn.rd), RDX);
+        break;
+      }
+      case OpSw: case OpSh: case OpSb: {
+        X86Mem host = Mem(R12, RAX, 1, 0);
+        CheckAddress(e, i, done, op == OpSw ? 4 : op == OpSh ? 2 : 1);
+        e.Mov(RDX, R(insn.rt));
+        if (op == OpSw) e.Mov(host, RDX);
+        else if (op == OpSh) e.Store16(host, RDX);
+        else e.Store8(host, RDX);
+        break;
+      }
+      case OpBeq: case OpBne: case OpBlt: case OpBle: case OpBgt: case OpBge:
+      case OpBltu: case OpBgeu: case OpBlez: case OpBgtz: case OpBltz: case OpBgez: {
+        if (op >= OpBlez) {
+          e.AluImm(AluCmp, R(insn.rs), 0);
+        } else {
+          e.Mov(RAX, R(insn.rs));
+          e.Alu(AluCmp, RAX, R(insn.rt));
+        }
+        size_t notTaken = e.Jcc(Invert(BranchCondition(op)));
+        ExitTo(e, insn.imm, done);
+        e.Patch(notTaken, e.Here());
+        break;
+      }
+      case OpJ:
+        ExitTo(e, insn.imm, done);
+        return;
+      case OpJal:
+        e.MovImm(R(RegRa), sim->nextAddress[i]);
+        ExitTo(e, insn.imm, done);
+        return;
+      case OpJr:
+        ExitIndirect(e, i, done, -1);
+        return;
+      case OpJalr:
+        ExitIndirect(e, i, done, insn.rd);
+        return;
+    }
+  }
+}
+
+/* Method: Translate
+ * -----------------
+ * Translates the block at index into the cache, installs it in the
+ * entry table and links every jump that was waiting for it, as well as
+ * the block's own exits to targets that are already translated. If the
+ * cache is full it is flushed and the block retried once.
+ */
+void *Translator::Translate(int index)
+{
+  int op = code[index].op;
+  if (op == OpSyscall || op == OpBreak || op >= NumMipsOps) return NULL;
+
+  for (int attempt = 0; attempt < 2; attempt++) {
+    X86Encoder e(cache + cacheUsed, CacheSize - cacheUsed);
+    faults.clear();
+    links.clear();
+    Block(e, index);
+    for (size_t i = 0; i < faults.size(); i++) {
+      e.Patch(faults[i].jump, e.Here());
+      Count(e, faults[i].done);
+      e.MovImm(RAX, ~faults[i].index);
+      JumpTo(e, epilogue);
+    }
+    if (e.Full()) {
+      Flush();
+      continue;
+    }
+    unsigned char *start = e.Start();
+    cacheUsed = (cacheUsed + e.Here() + 15) & ~(size_t)15;
+    entry[index] = start;
+    blocks++;
+
+    for (size_t i = 0; i < links.size(); i++) {
+      unsigned char *field = start + links[i].first;
+      if (entry[links[i].second]) X86Encoder::PatchAbsolute(field, entry[links[i].second]);
+      else chains[links[i].second].push_back(field);
+    }
+    map<int, vector<unsigned char *> >::iterator waiting = chains.find(index);
+    if (waiting != chains.end()) {
+      for (size_t i = 0; i < waiting->second.size(); i++)
+        X86Encoder::PatchAbsolute(waiting->second[i], start);
+      chains.erase(waiting);
+    }
+    return start;
+  }
+  heat[index] = HotThreshold;               // too big even for an empty cache
+  return NULL;
+}
+
+void Translator::Flush()
+{
+  cacheUsed = cacheStart;
+  entry.assign(numInsns, (void *)NULL);
+  heat.assign(numInsns, 0);
+  chains.clear();
+  flushes++;
+}
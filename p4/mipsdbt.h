@@ -0,0 +1,116 @@
+/* File: mipsdbt.h
+ * ---------------
+ * The Translator class is the dynamic binary translation mode of the
+ * simulator (dsim -translate). The Simulator interprets as usual and
+ * counts how often each jump target is entered; once a target is hot,
+ * the code from there is translated into x86-64 and later entries run
+ * the translation instead.
+ *
+ * Translation unit: a superblock, the straight-line run of Insns from
+ * the entry up to the first unconditional jump (j, jal, jr, jalr).
+ * Taken conditional branches leave it through side exits. Syscalls and
+ * break are never translated; the block ends just before them and the
+ * interpreter carries on from there.
+ *
+ * Generated code: the simulated registers stay in the Simulator's regs
+ * array, addressed through rbx, and simulated memory is reached as
+ * r12 + address. Every load and store does the same range and
+ * alignment checks as the interpreter; if a check fails, or an add
+ * overflows or a divide by zero is attempted, the translation stops
+ * before the faulting Insn and the interpreter re-executes it, so the
+ * error report and the machine state are exactly those of a pure
+ * interpreted run. Likewise the instruction count is kept exact by
+ * adding the length of the path taken at each exit.
+ *
+ * Chaining and the code cache: an exit to a direct target that is
+ * already translated jumps straight to it. Otherwise it returns to the
+ * interpreter through a stub, and the jump is patched to go to the
+ * target once that is translated. Indirect jumps (jr, jalr: returns and
+ * method calls) look the target up in the entry table inline. All
+ * translations live in one executable buffer; when it fills up, it is
+ * flushed and hot blocks are translated again as they are entered.
+ */
+
+#ifndef _H_mipsdbt
+#define _H_mipsdbt
+
+#include "mipsasm.h"
+#include "x86enc.h"
+#include <map>
+
+class Simulator;
+
+class Translator {
+  public:
+    static const int HotThreshold = 32;    // entries before translating
+    static const int MaxBlockInsns = 256;
+    static const size_t CacheSize = 16 << 20;
+
+    Translator(Simulator *simulator);
+    ~Translator();
+
+      // Translated code only runs on x86-64 hosts.
+    static bool HostSupported()
+    {
+#if defined(__x86_64__)
+      return true;
+#else
+      return false;
+#endif
+    }
+
+      // Returns the translation for the block starting at index, making
+      // one if the block has just become hot, or NULL if the block
+      // should be interpreted.
+    void *Lookup(int index)
+    {
+      if (entry[index]) return entry[index];
+      if (++heat[index] != HotThreshold) return NULL;
+      return Translate(index);
+    }
+
+      // Runs translated code from the given entry until it exits and
+      // returns the index of the Insn the interpreter continues with,
+      // or ~index if that Insn is one that faulted in translated code.
+    int Enter(void *code);
+
+    long long BlocksTranslated() const { return blocks; }
+    long long CacheFlushes() const { return flushes; }
+
+  private:
+    typedef int (*EnterFunction)(void *code, unsigned *regs, unsigned char *memory,
+                                 void **entries, const int *indexForWord);
+
+    struct Exit {                          // a pending out-of-line exit
+        size_t jump;                       // rel32 field that reaches it
+        int index, done;
+    };
+
+    Simulator *sim;
+    const Insn *code;
+    int numInsns;
+    unsigned char *cache, *epilogue;
+    size_t cacheStart, cacheUsed;
+    EnterFunction enter;
+    vector<void *> entry;
+    vector<int> heat;
+    map<int, vector<unsigned char *> > chains;  // jumps waiting for a target
+    long long blocks, flushes;
+
+    void *Translate(int index);
+    void Block(X86Encoder &e, int index);
+    void Flush();
+    int Offset(const void *member);
+    void Count(X86Encoder &e, int done);
+    void ExitTo(X86Encoder &e, int target, int done);
+    void ExitIndirect(X86Encoder &e, int index, int done, int link);
+    size_t Fault(X86Encoder &e, X86Cond cond, int index, int done);
+    void CheckAddress(X86Encoder &e, int index, int done, int bytes);
+    void JumpTo(X86Encoder &e, const void *target);
+
+      // Exits of the block being translated, resolved once it is done.
+    vector<Exit> faults;
+    vector<pair<size_t, int> > links;      // rel32 field, target index
+};
+
+#endif
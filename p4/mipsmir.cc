@@ -0,0 +1,1745 @@
+/* File: mipsmir.cc
+ * ----------------
+ * Instruction selection from Tac to MIPS machine IR, and the MIPS
+ * description the machine passes run against.
+ */
+
+#include "mipsmir.h"
+#include "mips.h"
+#include "utility.h"
+#include <string.h>
+#include <algorithm>
+#include <limits.h>
+
+typedef MipsTarget T;
+
+const char *T::name[NumOpcodes] = {
+  "li", "la", "move", "lw", "sw",
+  "addu", "subu", "mul", "div", "rem", "slt", "sltu", "and", "or", "xor",
+  "addiu", "slti", "sltiu", "andi", "ori", "xori", "sll", "sra", "srl", "mulhi",
+  "b", "beqz", "bnez", "beq", "bne", "jal", "jalr", "ret"
+};
+
+const int T::flags[NumOpcodes] = {
+  0, 0, MIsCopy, MMayLoad, MMayStore,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  MIsJump, MIsBranch, MIsBranch, MIsBranch, MIsBranch, MIsCall, MIsCall, MIsReturn
+};
+
+const int T::numDefs[NumOpcodes] = {
+  1, 1, 1, 1, 0,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  0, 0, 0, 0, 0, 0, 0, 0
+};
+
+  // The latencies of the pipeline dsim -timing models by default (see
+  // TimingConfig): a load's result can be used the next cycle but one,
+  // a product 12 cycles after the multiply, a quotient 35.
+static const int LoadLatency = 2, MulLatency = 12, DivLatency = 35;
+
+const int T::latency[NumOpcodes] = {
+  1, 1, 1, LoadLatency, 1,
+  1, 1, MulLatency, DivLatency, DivLatency, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, MulLatency,
+  1, 1, 1, 1, 1, 1, 1, 1
+};
+
+static const char *regName[T::NumRegs] = {
+  "$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+  "$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+  "$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+  "$t8", "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra"
+};
+
+
+  // The $t registers come first, since only the $s registers cost a
+  // save and restore in the function that uses them.
+MipsTarget::MipsTarget() : callerSaved(0), withFp(true), savesRa(true), spBelow(0), wrapAt(0)
+{
+  for (int r = t0; r <= t7; r++) {
+    allocatable.push_back(r);
+    callerSaved |= (RegMask)1 << r;
+  }
+  for (int r = s0; r <= s7; r++) {
+    allocatable.push_back(r);
+    calleeSaved.push_back(r);
+  }
+  scratch.push_back(t8);
+  scratch.push_back(t9);
+}
+
+const char *MipsTarget::RegName(int reg)
+{
+  Assert(reg >= 0 && reg < NumRegs);
+  return regName[reg];
+}
+
+  // A runtime routine with a register entry keeps them all; a function
+  // already noted clobbers what it was noted to; anything else (a call
+  // through a vtable, to a function not compiled yet or to the rest of
+  // the runtime) may change all the caller-saved registers.
+RegMask MipsTarget::CallClobbers(MInstr *call)
+{
+  if (call->Is(MKeepsRegs)) return 0;
+  if (call->opcode == Jal) {
+    map<string, RegMask>::iterator c = clobbers.find(call->ops[0].label);
+    if (c != clobbers.end()) return c->second;
+  }
+  return callerSaved;
+}
+
+void MipsTarget::NoteClobbers(MFunction *fn, RegMask also)
+{
+  RegMask mask = also, restored = 0, regs = 0;
+  for (size_t b = 0; b < fn->blocks.size(); b++)
+    for (size_t i = 0; i < fn->blocks[b]->code.size(); i++) {
+      MInstr *in = fn->blocks[b]->code[i];
+      for (int o = 0; o < in->numDefs; o++)
+        if (in->ops[o].IsReg() && in->ops[o].value < NumRegs) mask |= (RegMask)1 << in->ops[o].value;
+      if (in->Is(MIsCall)) mask |= CallClobbers(in);
+    }
+  for (size_t i = 0; i < fn->saved.size(); i++) restored |= (RegMask)1 << fn->saved[i];
+  for (size_t i = 0; i < allocatable.size(); i++) regs |= (RegMask)1 << allocatable[i];
+  clobbers[fn->name] = mask & regs & ~restored;
+}
+
+MInstr *MipsTarget::New(Opcode op)
+{
+  return new MInstr(op, flags[op], numDefs[op]);
+}
+
+MInstr *MipsTarget::CreateCopy(int dst, int src)
+{
+  return New(Move)->Add(MOperand::Reg(dst))->Add(MOperand::Reg(src));
+}
+
+MInstr *MipsTarget::CreateLoad(int reg, int frameObject)
+{
+  return New(Lw)->Add(MOperand::Reg(reg))->Add(MOperand::Frame(frameObject))->Add(MOperand::Imm(0));
+}
+
+MInstr *MipsTarget::CreateStore(int reg, int frameObject)
+{
+  return New(Sw)->Add(MOperand::Reg(reg))->Add(MOperand::Frame(frameObject))->Add(MOperand::Imm(0));
+}
+
+MInstr *MipsTarget::CreateJump(const char *label)
+{
+  return New(B)->Add(MOperand::Label(label));
+}
+
+  // beqz and bnez, beq and bne test opposite conditions.
+bool MipsTarget::ReverseBranch(MInstr *branch, const char *label)
+{
+  static const Opcode reverse[][2] = { {Beqz, Bnez}, {Bnez, Beqz}, {Beq, Bne}, {Bne, Beq} };
+  for (size_t i = 0; i < sizeof(reverse) / sizeof(reverse[0]); i++)
+    if (branch->opcode == reverse[i][0]) {
+      branch->opcode = reverse[i][1];
+      branch->ops.back() = MOperand::Label(label);
+      return true;
+    }
+  return false;
+}
+
+/* Method: LayoutFrame
+ * -------------------
+ * Offsets are from where $sp was at entry (where main's $fp points):
+ * the saved $ra at -4 unless the function is a leaf, then the saved $s
+ * registers, then the spill slots. A function that calls anything
+ * leaves a word free below all that, as the Mips class does, since a
+ * runtime routine may use 0($sp) and the last stack argument of a call
+ * goes there. frameSize is the whole of it. Then ShrinkWrap decides
+ * where the frame is set up, which may rename registers, so it is
+ * done before anything looks at what the function clobbers.
+ */
+void MipsTarget::LayoutFrame(MFunction *fn)
+{
+  withFp = !strcmp(fn->name, "main");
+  savesRa = withFp;
+  for (size_t b = 0; b < fn->blocks.size(); b++)
+    for (size_t i = 0; i < fn->blocks[b]->code.size(); i++)
+      savesRa |= fn->blocks[b]->code[i]->Is(MIsCall);
+  int offset = SavedOffset(fn->saved.size());
+  for (size_t i = 0; i < fn->frame.size(); i++)
+    if (!fn->frame[i].fixed) {
+      fn->frame[i].offset = offset;
+      offset -= 4;
+    }
+  fn->frameSize = savesRa ? -offset : -4 - offset;
+  fn->ComputeSuccessors();
+  wrapAt = ShrinkWrap(fn);
+}
+
+void MipsTarget::PrintOperand(FILE *out, MFunction *fn, const MOperand &o)
+{
+  switch (o.kind) {
+    case MOpReg:
+      if (o.IsVirtual()) fprintf(out, "%%%d", o.value - FirstVirtualReg);
+      else fprintf(out, "%s", RegName(o.value));
+      break;
+    case MOpImm: fprintf(out, "%d", o.value); break;
+    case MOpLabel: fprintf(out, "%s", o.label); break;
+    case MOpFrame: fprintf(out, "fi%d", o.value); break;
+  }
+}
+
+void MipsTarget::PrintInstr(FILE *out, MFunction *fn, MInstr *in)
+{
+  if (in->opcode == MulHi) {              // the high word of a product
+    fprintf(out, "mult %s, %s\n\tmfhi %s\n", RegName(in->ops[1].value),
+            RegName(in->ops[2].value), RegName(in->ops[0].value));
+    return;
+  }
+  fprintf(out, "%s ", name[in->opcode]);
+  if (in->Is(MMayLoad | MMayStore)) {      // data, offset(base)
+    PrintOperand(out, fn, in->ops[0]);
+    const MOperand &base = in->ops[1];
+    if (base.kind == MOpFrame && withFp)
+      fprintf(out, ", %d($fp)\n", fn->frame[base.value].offset + in->ops[2].value);
+    else if (base.kind == MOpFrame)
+      fprintf(out, ", %d($sp)\n", fn->frame[base.value].offset + in->ops[2].value + spBelow);
+    else {
+      fprintf(out, ", %d(", in->ops[2].value);
+      PrintOperand(out, fn, base);
+      fprintf(out, ")\n");
+    }
+    return;
+  }
+  for (size_t i = 0; i < in->ops.size(); i++) {
+    if (i) fprintf(out, ", ");
+    PrintOperand(out, fn, in->ops[i]);
+  }
+  fprintf(out, "\n");
+}
+
+  // Whether the block needs the frame set up: it calls, moves $sp or
+  // uses a frame object. (A callee-saved register is dealt with in
+  // ShrinkWrap.)
+static bool NeedsFrame(MBlock *block)
+{
+  for (size_t i = 0; i < block->code.size(); i++) {
+    MInstr *in = block->code[i];
+    if (in->Is(MIsCall)) return true;
+    for (size_t o = 0; o < in->ops.size(); o++)
+      if (in->ops[o].kind == MOpFrame || (in->ops[o].IsReg() && in->ops[o].value == T::sp))
+        return true;
+  }
+  return false;
+}
+
+  // Renames register from to to in the block.
+static void RenameReg(MBlock *block, int from, int to)
+{
+  for (size_t i = 0; i < block->code.size(); i++)
+    for (size_t o = 0; o < block->code[i]->ops.size(); o++)
+      if (block->code[i]->ops[o] == MOperand::Reg(from))
+        block->code[i]->ops[o].value = to;
+}
+
+/* Method: ShrinkWrap
+ * ------------------
+ * Marks the blocks that run with the frame set up: those that need it
+ * and every block reachable from them. Returns the block the prologue
+ * goes at the start of, or -1 if no block needs a frame. That is the
+ * entry, unless the marked blocks are all entered through one block
+ * whose predecessors are all unmarked, so the paths that never reach
+ * it return without setting the frame up. main always has its frame.
+ *
+ * The blocks before the prologue must not change a callee-saved
+ * register before it is saved, so one they use (typically for a
+ * parameter that lives across the calls further on) is renamed there
+ * to a $t register they do not use, and copied to it after the
+ * prologue. If there are not enough of those, the frame is set up at
+ * the entry after all.
+ */
+int MipsTarget::ShrinkWrap(MFunction *fn)
+{
+  int n = fn->blocks.size();
+  hasFrame.assign(n, true);
+  if (withFp) return 0;
+  hasFrame.assign(n, false);
+  vector<int> work;
+  for (int b = 0; b < n; b++)
+    if (NeedsFrame(fn->blocks[b])) {
+      hasFrame[b] = true;
+      work.push_back(b);
+    }
+  if (work.empty()) return -1;
+  while (!work.empty()) {
+    MBlock *block = fn->blocks[work.back()];
+    work.pop_back();
+    for (size_t s = 0; s < block->succs.size(); s++)
+      if (!hasFrame[block->succs[s]]) {
+        hasFrame[block->succs[s]] = true;
+        work.push_back(block->succs[s]);
+      }
+  }
+  if (hasFrame[0]) return 0;
+
+  int at = -1;
+  bool once = true;
+  for (int b = 0; b < n; b++)
+    for (size_t s = 0; s < fn->blocks[b]->succs.size(); s++) {
+      int to = fn->blocks[b]->succs[s];
+      if (hasFrame[b] || !hasFrame[to]) continue;
+      if (at >= 0 && to != at) once = false;
+      at = to;
+    }
+  for (int b = 0; once && b < n; b++)
+    if (hasFrame[b] && std::count(fn->blocks[b]->succs.begin(), fn->blocks[b]->succs.end(), at))
+      once = false;
+
+  vector<bool> used(NumRegs, false);
+  for (int b = 0; once && b < n; b++)
+    for (size_t i = 0; !hasFrame[b] && i < fn->blocks[b]->code.size(); i++)
+      for (size_t o = 0; o < fn->blocks[b]->code[i]->ops.size(); o++)
+        if (fn->blocks[b]->code[i]->ops[o].IsReg())
+          used[fn->blocks[b]->code[i]->ops[o].value] = true;
+  vector<std::pair<int, int> > renames;  // callee-saved, $t
+  for (int r = t0, i = 0; once && i < (int)fn->saved.size(); i++) {
+    if (!used[fn->saved[i]]) continue;
+    while (r <= t7 && used[r]) r++;
+    if (r > t7) once = false;
+    else renames.push_back(std::make_pair(fn->saved[i], r++));
+  }
+  if (!once) {
+    hasFrame.assign(n, true);
+    return 0;
+  }
+  vector<MInstr *> &code = fn->blocks[at]->code;
+  for (size_t i = 0; i < renames.size(); i++) {
+    for (int b = 0; b < n; b++)
+      if (!hasFrame[b]) RenameReg(fn->blocks[b], renames[i].first, renames[i].second);
+    code.insert(code.begin(), CreateCopy(renames[i].first, renames[i].second));
+  }
+  return at;
+}
+
+  // Where the i'th saved $s register goes, below the saved $ra if any.
+int MipsTarget::SavedOffset(int i)
+{
+  return (savesRa ? -8 : -4) - 4 * i;
+}
+
+  // main's is the prologue of the Mips class; the others just move $sp.
+void MipsTarget::EmitPrologue(MFunction *fn)
+{
+  if (withFp) {
+    Mips::Emit("subu $sp, $sp, 8\t# decrement sp to make space to save ra, fp");
+    Mips::Emit("sw $fp, 8($sp)\t# save fp");
+    Mips::Emit("sw $ra, 4($sp)\t# save ra");
+    Mips::Emit("addiu $fp, $sp, 8\t# set up new fp");
+    if (fn->frameSize > 8)
+      Mips::Emit("subu $sp, $sp, %d\t# decrement sp to make space for spills", fn->frameSize - 8);
+  } else {
+    if (fn->frameSize != 0)
+      Mips::Emit("subu $sp, $sp, %d\t# decrement sp to make space for the frame", fn->frameSize);
+    if (savesRa) Mips::Emit("sw $ra, %d($sp)\t# save ra", fn->frameSize - 4);
+  }
+  for (size_t i = 0; i < fn->saved.size(); i++)
+    Mips::Emit("sw %s, %d(%s)\t# save callee-saved register", RegName(fn->saved[i]),
+               SavedOffset(i) + (withFp ? 0 : fn->frameSize), withFp ? "$fp" : "$sp");
+}
+
+void MipsTarget::EmitEpilogue(MFunction *fn)
+{
+  if (withFp && strcmp(fn->name, "main") == 0) Mips::EmitMainReturn();
+  for (size_t i = 0; i < fn->saved.size(); i++)
+    Mips::Emit("lw %s, %d(%s)\t# restore callee-saved register", RegName(fn->saved[i]),
+               SavedOffset(i) + (withFp ? 0 : fn->frameSize), withFp ? "$fp" : "$sp");
+  if (withFp) {
+    Mips::Emit("move $sp, $fp\t\t# pop callee frame off stack");
+    Mips::Emit("lw $ra, -4($fp)\t# restore saved ra");
+    Mips::Emit("lw $fp, 0($fp)\t# restore saved fp");
+  } else {
+    if (savesRa) Mips::Emit("lw $ra, %d($sp)\t# restore saved ra", fn->frameSize - 4);
+    if (fn->frameSize != 0)
+      Mips::Emit("addiu $sp, $sp, %d\t# pop the frame", fn->frameSize);
+  }
+  Mips::Emit("jr $ra\t\t# return from function");
+}
+
+/* Method: EmitFunction
+ * --------------------
+ * Prints the function (right after LayoutFrame and the passes that
+ * follow it), with the prologue where ShrinkWrap put it and
+ * each Ret as the epilogue (or just jr $ra where there is no frame).
+ * Frame objects are printed off $sp by how far it is below where it
+ * was at entry: the frame, where it is set up, and the stack arguments
+ * of a call being made (which each block passes on to its successors).
+ */
+void MipsTarget::EmitFunction(MFunction *fn)
+{
+  fn->ComputeSuccessors();
+  vector<int> pushed(fn->blocks.size(), 0);
+  Mips::Emit("%s:", fn->name);
+  for (size_t b = 0; b < fn->blocks.size(); b++) {
+    MBlock *block = fn->blocks[b];
+    if (block->label) Mips::Emit("%s:", block->label);
+    if ((int)b == wrapAt) EmitPrologue(fn);
+    spBelow = (hasFrame[b] ? fn->frameSize : 0) + pushed[b];
+    for (size_t i = 0; i < block->code.size(); i++) {
+      MInstr *in = block->code[i];
+      if (in->opcode == Ret && hasFrame[b])
+        EmitEpilogue(fn);
+      else if (in->opcode == Ret)
+        Mips::Emit("jr $ra\t\t# return from function");
+      else {
+        printf("\t");
+        PrintInstr(stdout, fn, in);
+      }
+      if (in->opcode == Addiu && in->ops[0].value == sp) spBelow -= in->ops[2].value;
+    }
+    for (size_t s = 0; s < block->succs.size(); s++)
+      if (block->succs[s] > (int)b)
+        pushed[block->succs[s]] = spBelow - (hasFrame[b] ? fn->frameSize : 0);
+  }
+}
+
+
+MipsISel::MipsISel() : fn(NULL), entry(NULL), cur(NULL), functionLabel(NULL),
+                       regArgs(!IsDebugOn("stackargs")),
+                       wholeProgram(!IsDebugOn("nointerproc"))
+{
+  escapes.insert("main");
+}
+
+static bool Fits16(long long c) { return c >= -32768 && c <= 32767; }
+static bool FitsUnsigned16(long long c) { return c >= 0 && c <= 65535; }
+
+
+void MipsISel::Record(TacKind kind, Location *dst, Location *a, Location *b,
+                      int val, const char *label, BinaryOp::OpCode code)
+{
+  TacOp op = { kind, code, dst, a, b, val, label, false };
+  ops.push_back(op);
+}
+
+void MipsISel::EmitLoadConstant(Location *dst, int val)
+{
+  Record(TConst, dst, NULL, NULL, val);
+}
+
+void MipsISel::EmitLoadStringConstant(Location *dst, const char *str)
+{
+  Record(TAddr, dst, NULL, NULL, 0, Mips::StringLabel(str));
+}
+
+void MipsISel::EmitLoadLabel(Location *dst, const char *label)
+{
+  Record(TAddr, dst, NULL, NULL, 0, label);
+}
+
+void MipsISel::EmitLoad(Location *dst, Location *reference, int offset)
+{
+  Record(TLoad, dst, reference, NULL, offset);
+}
+
+void MipsISel::EmitStore(Location *reference, Location *value, int offset)
+{
+  Record(TStore, NULL, reference, value, offset);
+}
+
+void MipsISel::EmitCopy(Location *dst, Location *src)
+{
+  Record(TCopy, dst, src, NULL);
+}
+
+void MipsISel::EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                            Location *op1, Location *op2)
+{
+  Record(TBinary, dst, op1, op2, 0, NULL, code);
+}
+
+  // Outside a function, the label names the function about to begin.
+void MipsISel::EmitLabel(const char *label)
+{
+  if (!fn) functionLabel = label;
+  else Record(TLabel, NULL, NULL, NULL, 0, label);
+}
+
+void MipsISel::EmitGoto(const char *label)
+{
+  Record(TGoto, NULL, NULL, NULL, 0, label);
+}
+
+void MipsISel::EmitIfZ(Location *test, const char *label)
+{
+  Record(TIfZ, NULL, test, NULL, 0, label);
+}
+
+void MipsISel::EmitReturn(Location *returnVal)
+{
+  Record(TReturn, NULL, returnVal, NULL);
+}
+
+void MipsISel::EmitParam(Location *arg)
+{
+  Record(TParam, NULL, arg, NULL);
+}
+
+  // A call to _Alloc, or to a built-in with a register entry (see
+  // Mips::RegisterEntry), takes over the push of its argument, and the
+  // pop that follows is dropped.
+void MipsISel::EmitLCall(Location *result, const char *label)
+{
+  BuiltIn b = CodeGenerator::BuiltInForLabel(label);
+  const char *entry = b == NumBuiltIns ? NULL : Mips::RegisterEntry(b);
+  bool takesParam = b != NumBuiltIns && CodeGenerator::NumArgsForBuiltIn(b) == 1 &&
+                    !ops.empty() && ops.back().kind == TParam;
+  if ((b == Alloc || entry) && takesParam) {
+    ops.back().kind = b == Alloc ? TAlloc : TBuiltIn;
+    ops.back().dst = result;
+    ops.back().label = entry;
+  } else if (entry && CodeGenerator::NumArgsForBuiltIn(b) == 0)
+    Record(TBuiltIn, result, NULL, NULL, 0, entry);
+  else
+    Record(TLCall, result, NULL, NULL, 0, label);
+}
+
+void MipsISel::EmitACall(Location *result, Location *fnAddr)
+{
+  Record(TACall, result, fnAddr, NULL);
+}
+
+  // With the register convention a call takes its own arguments off
+  // the stack, so it just notes how many bytes of them there are.
+void MipsISel::EmitPopParams(int bytes)
+{
+  if (!ops.empty() && (ops.back().kind == TAlloc || (ops.back().kind == TBuiltIn && ops.back().a)) &&
+      bytes == CodeGenerator::VarSize)
+    return;
+  if (regArgs && !ops.empty() && (ops.back().kind == TLCall || ops.back().kind == TACall)) {
+    ops.back().val = bytes;
+    return;
+  }
+  Record(TPop, NULL, NULL, NULL, bytes);
+}
+
+void MipsISel::EmitVTable(const char *label, List<const char*> *methodLabels)
+{
+  Mips::Emit(".data");
+  Mips::Emit(".align 2");
+  Mips::Emit("%s:\t\t# label for class %s vtable", label, label);
+  for (int i = 0; i < methodLabels->NumElements(); i++) {
+    Mips::Emit(".word %s\n", methodLabels->Nth(i));
+    escapes.insert(methodLabels->Nth(i));
+  }
+  Mips::Emit(".text");
+}
+
+
+void MipsISel::EmitBeginFunction(int frameSize)
+{
+  Assert(functionLabel && !fn);
+  fn = new MFunction(functionLabel);
+}
+
+/* Method: EmitEndFunction
+ * -----------------------
+ * The whole function has been collected: find the tree temps, select
+ * instructions and hand the result to the machine passes, or hold it
+ * back until the whole program has been selected. The entry block
+ * only ever holds the loads of the parameters, so that no branch can
+ * lead back to them.
+ */
+void MipsISel::EmitEndFunction()
+{
+  Analyze();
+  entry = fn->NewBlock(NULL);
+  cur = fn->NewBlock(NULL);
+  for (size_t i = 0; i < ops.size(); i++)
+    if (!ops[i].dead) Select(ops[i]);
+  Append(T::Ret);
+  if (wholeProgram) held.push_back(fn);
+  else {
+    RunMachinePasses(fn, &target);
+    target.EmitFunction(fn);
+    delete fn;
+  }
+
+  for (size_t i = 0; i < nodes.size(); i++) delete nodes[i];
+  nodes.clear();
+  ops.clear();
+  vars.clear();
+  pending.clear();
+  fn = NULL;
+  functionLabel = NULL;
+}
+
+
+  // Tarjan's algorithm over the call graph: each strongly connected
+  // component is found after all those it calls into.
+struct CallGraph {
+    vector<vector<int> > callees, components;
+    vector<int> number, low, stack;
+    vector<bool> onStack;
+    int count;
+
+    void Visit(int f);
+};
+
+void CallGraph::Visit(int f)
+{
+  number[f] = low[f] = count++;
+  stack.push_back(f);
+  onStack[f] = true;
+  for (size_t c = 0; c < callees[f].size(); c++) {
+    int g = callees[f][c];
+    if (number[g] < 0) {
+      Visit(g);
+      low[f] = std::min(low[f], low[g]);
+    } else if (onStack[g])
+      low[f] = std::min(low[f], number[g]);
+  }
+  if (low[f] != number[f]) return;
+  components.push_back(vector<int>());
+  int g;
+  do {
+    g = stack.back();
+    stack.pop_back();
+    onStack[g] = false;
+    components.back().push_back(g);
+  } while (g != f);
+}
+
+/* Method: EmitProgram
+ * -------------------
+ * Register allocation across functions. The functions are compiled
+ * callees first, so that when a caller is allocated, what each of
+ * its direct calls clobbers is known (see MipsTarget::NoteClobbers),
+ * and a value can stay in a $t register the callee leaves alone
+ * instead of an $s register saved at entry or a store around the
+ * call. The functions of a recursive cycle are compiled with the
+ * calls among them clobbering all the caller-saved registers, as
+ * are calls through a vtable.
+ *
+ * A function only ever called by name (a global function: methods
+ * are called through their vtables, and main by the runtime) that is
+ * not recursive also chooses its own argument registers (see
+ * ChooseConvention), which its callers, compiled after it, use.
+ * The functions are printed in the order they are compiled.
+ */
+void MipsISel::EmitProgram()
+{
+  if (!wholeProgram) return;
+  map<string, int> index;
+  for (size_t f = 0; f < held.size(); f++) index[held[f]->name] = f;
+  CallGraph graph;
+  graph.callees.resize(held.size());
+  graph.number.assign(held.size(), -1);
+  graph.low.assign(held.size(), 0);
+  graph.onStack.assign(held.size(), false);
+  graph.count = 0;
+  for (size_t f = 0; f < held.size(); f++)
+    for (size_t b = 0; b < held[f]->blocks.size(); b++)
+      for (size_t i = 0; i < held[f]->blocks[b]->code.size(); i++) {
+        MInstr *in = held[f]->blocks[b]->code[i];
+        if (in->opcode == T::Jal && index.count(in->ops[0].label))
+          graph.callees[f].push_back(index[in->ops[0].label]);
+      }
+  for (size_t f = 0; f < held.size(); f++)
+    if (graph.number[f] < 0) graph.Visit(f);
+  Summarize();
+
+  for (size_t c = 0; c < graph.components.size(); c++) {
+    vector<int> &component = graph.components[c];
+    int f = component[0];
+    bool recursive = component.size() > 1 ||
+      std::count(graph.callees[f].begin(), graph.callees[f].end(), f);
+    for (size_t i = 0; i < component.size(); i++) {
+      MFunction *g = held[component[i]];
+      Compile(g, regArgs && !recursive && !escapes.count(g->name));
+    }
+  }
+  held.clear();
+}
+
+  // The passes, what a call to f clobbers (and the registers it takes
+  // its arguments in, if it chooses them), and the printing.
+void MipsISel::Compile(MFunction *f, bool ownConvention)
+{
+  UseConventions(f);
+  PromoteGlobals(f);
+  RunMachinePasses(f, &target);
+  RegMask argRegs = ownConvention ? ChooseConvention(f) : 0;
+  target.NoteClobbers(f, argRegs);
+  target.EmitFunction(f);
+  delete f;
+}
+
+  // Each call in f to a function whose convention is known gets its
+  // arguments in the registers that function chose, and none for an
+  // argument it never reads. The arguments are the copies to $a0-$a3
+  // between the call and the one before it, see SelectCall.
+void MipsISel::UseConventions(MFunction *f)
+{
+  for (size_t b = 0; b < f->blocks.size(); b++) {
+    vector<MInstr *> &code = f->blocks[b]->code;
+    for (size_t i = 0; i < code.size(); i++) {
+      if (code[i]->opcode != T::Jal || !conventions.count(code[i]->ops[0].label)) continue;
+      const vector<int> &regs = conventions[code[i]->ops[0].label];
+      for (size_t j = i; j-- > 0 && !code[j]->Is(MIsCall); ) {
+        int k = code[j]->numDefs ? code[j]->ops[0].value - T::a0 : -1;
+        if (k < 0 || k >= NumArgRegs) continue;
+        if (regs[k] >= 0) code[j]->ops[0].value = regs[k];
+        else {
+          delete code[j];
+          code.erase(code.begin() + j);
+          i--;
+        }
+      }
+    }
+  }
+}
+
+/* Method: ChooseConvention
+ * ------------------------
+ * f is allocated. An argument passed in $a0-$a3 that f only reads to
+ * copy it at entry to a caller-saved register, which the entry block
+ * uses for nothing else, is passed in that register instead, and the
+ * copy is dropped; one f never reads is not passed at all. Returns
+ * the registers f now takes arguments in, which it changes as far as
+ * its callers are concerned.
+ */
+RegMask MipsISel::ChooseConvention(MFunction *f)
+{
+  vector<int> regs(NumArgRegs), reads(NumArgRegs, 0);
+  vector<MInstr *> copy(NumArgRegs, (MInstr *)NULL);
+  for (size_t b = 0; b < f->blocks.size(); b++)
+    for (size_t i = 0; i < f->blocks[b]->code.size(); i++) {
+      MInstr *in = f->blocks[b]->code[i];
+      for (size_t o = in->numDefs; o < in->ops.size(); o++) {
+        int k = in->ops[o].IsReg() ? in->ops[o].value - T::a0 : -1;
+        if (k < 0 || k >= NumArgRegs) continue;
+        reads[k]++;
+        if (b == 0 && in->Is(MIsCopy)) copy[k] = in;
+      }
+    }
+
+  vector<MInstr *> &code = f->blocks[0]->code;
+  RegMask argRegs = 0;
+  for (int k = 0; k < NumArgRegs; k++) {
+    regs[k] = reads[k] ? T::a0 + k : -1;
+    if (reads[k] != 1 || !copy[k]) continue;
+    int r = copy[k]->ops[0].value, uses = 0;
+    for (size_t i = 0; i < code.size(); i++)
+      for (size_t o = 0; o < code[i]->ops.size(); o++)
+        if (code[i]->ops[o] == MOperand::Reg(r)) uses++;
+    if (!target.IsCallerSaved(r) || uses != 1) continue;
+    regs[k] = r;
+    argRegs |= (RegMask)1 << r;
+    code.erase(std::find(code.begin(), code.end(), copy[k]));
+    delete copy[k];
+  }
+  conventions[f->name] = regs;
+  return argRegs;
+}
+
+
+  // A load or store of a global: lw/sw off $gp at a constant offset.
+static bool IsGlobal(MInstr *in)
+{
+  return (in->opcode == T::Lw || in->opcode == T::Sw) && in->ops[1] == MOperand::Reg(T::gp) &&
+         in->ops[2].kind == MOpImm;
+}
+
+  // Whether in reads $gp other than as the base of a global, which
+  // only an address too far from it for an offset does.
+static bool OtherGp(MInstr *in)
+{
+  for (size_t o = in->numDefs; o < in->ops.size(); o++)
+    if (in->ops[o] == MOperand::Reg(T::gp) && !(o == 1 && IsGlobal(in))) return true;
+  return false;
+}
+
+static bool MergeSet(set<int> &into, const set<int> &from)
+{
+  size_t before = into.size();
+  into.insert(from.begin(), from.end());
+  return into.size() != before;
+}
+
+bool MipsISel::ModRef::Merge(const ModRef &o)
+{
+  bool grew = MergeSet(mod, o.mod);
+  grew |= MergeSet(ref, o.ref);
+  grew |= o.any && !any;
+  any |= o.any;
+  return grew;
+}
+
+  // A call through a vtable may reach any method; a runtime routine
+  // touches no global of the program (the collector reads them, but
+  // finds the value of one kept in a register among the registers).
+const MipsISel::ModRef *MipsISel::CallSummary(MInstr *call)
+{
+  if (call->opcode == T::Jalr) return &methods;
+  map<string, ModRef>::iterator s = summaries.find(call->ops[0].label);
+  return s == summaries.end() ? NULL : &s->second;
+}
+
+/* Method: Summarize
+ * -----------------
+ * The mod/ref summary of each function held back: the globals it
+ * stores to and loads from itself, and those of everything it calls,
+ * to a fixed point (the calls through vtables make the call graph
+ * hard to order).
+ */
+void MipsISel::Summarize()
+{
+  for (size_t f = 0; f < held.size(); f++) {
+    ModRef &s = summaries[held[f]->name];
+    for (size_t b = 0; b < held[f]->blocks.size(); b++)
+      for (size_t i = 0; i < held[f]->blocks[b]->code.size(); i++) {
+        MInstr *in = held[f]->blocks[b]->code[i];
+        if (IsGlobal(in)) (in->opcode == T::Sw ? s.mod : s.ref).insert(in->ops[2].value);
+        s.any |= OtherGp(in);
+      }
+  }
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (size_t f = 0; f < held.size(); f++)
+      if (escapes.count(held[f]->name)) changed |= methods.Merge(summaries[held[f]->name]);
+    for (size_t f = 0; f < held.size(); f++) {
+      ModRef &s = summaries[held[f]->name];
+      for (size_t b = 0; b < held[f]->blocks.size(); b++)
+        for (size_t i = 0; i < held[f]->blocks[b]->code.size(); i++) {
+          MInstr *in = held[f]->blocks[b]->code[i];
+          const ModRef *callee = in->Is(MIsCall) ? CallSummary(in) : NULL;
+          if (callee && callee != &s) changed |= s.Merge(*callee);
+        }
+    }
+  }
+}
+
+static bool WritesReg(MInstr *in, int reg)
+{
+  for (int o = 0; o < in->numDefs; o++)
+    if (in->ops[o] == MOperand::Reg(reg)) return true;
+  return false;
+}
+
+static bool ReadsReg(MInstr *in, int reg)
+{
+  for (size_t o = in->numDefs; o < in->ops.size(); o++)
+    if (in->ops[o] == MOperand::Reg(reg)) return true;
+  return false;
+}
+
+/* Function: FoldGlobalCopies
+ * --------------------------
+ * The loads and stores of a promoted global become copies, mostly of
+ * a temp used once in the same block. A temp copied from the global
+ * is read from the global's register instead, up to where either is
+ * written, and the copy goes once no read of the temp is left; the
+ * instruction that computes a temp copied to the global writes the
+ * global's register itself, if nothing in between uses it.
+ */
+static void FoldGlobalCopies(MFunction *f, const vector<int> &isPromoted)
+{
+  vector<int> defs(f->numVRegs, 0), reads(f->numVRegs, 0);
+  for (size_t b = 0; b < f->blocks.size(); b++)
+    for (size_t i = 0; i < f->blocks[b]->code.size(); i++) {
+      MInstr *in = f->blocks[b]->code[i];
+      for (size_t o = 0; o < in->ops.size(); o++)
+        if (in->ops[o].IsVirtual())
+          ((int)o < in->numDefs ? defs : reads)[in->ops[o].value - FirstVirtualReg]++;
+    }
+  for (size_t b = 0; b < f->blocks.size(); b++) {
+    vector<MInstr *> &code = f->blocks[b]->code;
+    for (size_t i = 0; i < code.size(); i++) {
+      MInstr *copy = code[i];
+      if (!copy->Is(MIsCopy) || !copy->ops[0].IsVirtual() || !copy->ops[1].IsVirtual()) continue;
+      int to = copy->ops[0].value, from = copy->ops[1].value;
+      if (isPromoted[from - FirstVirtualReg] && !isPromoted[to - FirstVirtualReg]) {
+        for (size_t j = i + 1; j < code.size(); j++) {
+          for (size_t o = code[j]->numDefs; o < code[j]->ops.size(); o++)
+            if (code[j]->ops[o] == MOperand::Reg(to)) {
+              code[j]->ops[o].value = from;
+              reads[to - FirstVirtualReg]--;
+            }
+          if (WritesReg(code[j], from) || WritesReg(code[j], to)) break;
+        }
+        if (reads[to - FirstVirtualReg] > 0 || defs[to - FirstVirtualReg] != 1) continue;
+      } else if (isPromoted[to - FirstVirtualReg] && !isPromoted[from - FirstVirtualReg] &&
+                 defs[from - FirstVirtualReg] == 1 && reads[from - FirstVirtualReg] == 1) {
+        size_t j = i;
+        while (j-- > 0 && !WritesReg(code[j], from))
+          if (ReadsReg(code[j], to) || WritesReg(code[j], to)) break;
+        if (j == (size_t)-1 || !WritesReg(code[j], from) || code[j]->numDefs != 1) continue;
+        code[j]->ops[0].value = to;
+      } else
+        continue;
+      delete copy;
+      code.erase(code.begin() + i--);
+    }
+  }
+}
+
+  // How a global is used by the function being promoted in.
+struct GlobalUse {
+    long long accesses, syncs;   // weighted by the loops around them
+    bool written;
+    int reg;
+};
+
+/* Method: PromoteGlobals
+ * ----------------------
+ * A global f uses often enough lives in a virtual register for the
+ * whole of f: it is loaded at entry and its loads and stores become
+ * copies. If f writes it, it is stored back before each return and
+ * before each call that may read or write it (see Summarize), and it
+ * is reloaded after each call that may write it. A global is
+ * promoted if that saves memory accesses, each counting eight times
+ * as much per loop around it (loops being found by their back edges,
+ * the blocks being in source order).
+ */
+void MipsISel::PromoteGlobals(MFunction *f)
+{
+  int n = f->blocks.size();
+  f->ComputeSuccessors();
+  vector<int> depth(n + 1, 0);
+  for (int b = 0; b < n; b++)
+    for (size_t s = 0; s < f->blocks[b]->succs.size(); s++)
+      if (f->blocks[b]->succs[s] <= b) {
+        depth[f->blocks[b]->succs[s]]++;
+        depth[b + 1]--;
+      }
+  vector<long long> weight(n);
+  for (int b = 0, d = 0; b < n; b++) {
+    d += depth[b];
+    weight[b] = 1LL << 3 * std::min(d, 4);
+  }
+
+  map<int, GlobalUse> uses;
+  for (int b = 0; b < n; b++)
+    for (size_t i = 0; i < f->blocks[b]->code.size(); i++) {
+      MInstr *in = f->blocks[b]->code[i];
+      if (OtherGp(in)) return;
+      if (!IsGlobal(in)) continue;
+      GlobalUse &u = uses[in->ops[2].value];
+      u.accesses += weight[b];
+      u.written |= in->opcode == T::Sw;
+    }
+  for (int b = 0; b < n; b++)
+    for (size_t i = 0; i < f->blocks[b]->code.size(); i++) {
+      MInstr *in = f->blocks[b]->code[i];
+      const ModRef *callee = in->Is(MIsCall) ? CallSummary(in) : NULL;
+      for (map<int, GlobalUse>::iterator g = uses.begin(); g != uses.end(); g++) {
+        bool mod = callee && (callee->any || callee->mod.count(g->first));
+        bool ref = callee && (callee->any || callee->ref.count(g->first));
+        if (g->second.written && (mod || ref || in->opcode == T::Ret)) g->second.syncs += weight[b];
+        if (mod) g->second.syncs += weight[b];
+      }
+    }
+
+  vector<int> promoted, isPromoted(f->numVRegs, false);
+  for (map<int, GlobalUse>::iterator g = uses.begin(); g != uses.end(); g++)
+    if (g->second.accesses > g->second.syncs + 1) {
+      g->second.reg = f->NewVReg();
+      promoted.push_back(g->first);
+      isPromoted.push_back(true);
+    }
+  if (promoted.empty()) return;
+
+  for (int b = 0; b < n; b++) {
+    vector<MInstr *> &code = f->blocks[b]->code, out;
+    for (size_t i = 0; i < code.size(); i++) {
+      MInstr *in = code[i];
+      if (IsGlobal(in) && std::count(promoted.begin(), promoted.end(), in->ops[2].value)) {
+        int g = uses[in->ops[2].value].reg, r = in->ops[0].value;
+        out.push_back(in->opcode == T::Lw ? target.CreateCopy(r, g) : target.CreateCopy(g, r));
+        delete in;
+        continue;
+      }
+      const ModRef *callee = in->Is(MIsCall) ? CallSummary(in) : NULL;
+      vector<int> reload;
+      for (size_t p = 0; p < promoted.size(); p++) {
+        GlobalUse &u = uses[promoted[p]];
+        bool mod = callee && (callee->any || callee->mod.count(promoted[p]));
+        bool ref = callee && (callee->any || callee->ref.count(promoted[p]));
+        if (u.written && (mod || ref || in->opcode == T::Ret))
+          out.push_back(MipsTarget::New(T::Sw)->Add(MOperand::Reg(u.reg))->
+                        Add(MOperand::Reg(T::gp))->Add(MOperand::Imm(promoted[p])));
+        if (mod) reload.push_back(promoted[p]);
+      }
+      out.push_back(in);
+      for (size_t p = 0; p < reload.size(); p++)
+        out.push_back(MipsTarget::New(T::Lw)->Add(MOperand::Reg(uses[reload[p]].reg))->
+                      Add(MOperand::Reg(T::gp))->Add(MOperand::Imm(reload[p])));
+    }
+    code = out;
+  }
+  for (size_t p = 0; p < promoted.size(); p++)
+    f->blocks[0]->code.push_back(MipsTarget::New(T::Lw)->Add(MOperand::Reg(uses[promoted[p]].reg))->
+                                 Add(MOperand::Reg(T::gp))->Add(MOperand::Imm(promoted[p])));
+  FoldGlobalCopies(f, isPromoted);
+}
+
+
+bool MipsISel::IsLocal(Location *var)
+{
+  return var && var->GetSegment() == fpRelative && var->GetOffset() < 0;
+}
+
+MipsISel::Var &MipsISel::Lookup(Location *var)
+{
+  map<int, Var>::iterator v = vars.find(var->GetOffset());
+  if (v != vars.end()) return v->second;
+  Var fresh = { 0, 0, -1, -1, -1, !strncmp(var->GetName(), "_tmp", 4), false, false, 0, -1, NULL, 0 };
+  return vars[var->GetOffset()] = fresh;
+}
+
+bool MipsISel::IsTree(Location *var)
+{
+  if (!IsLocal(var)) return false;
+  Var &v = Lookup(var);
+  return v.temp && !v.constant && v.defs == 1 && !v.multiBlock && v.firstUse > v.defPos;
+}
+
+  // The value of a op b the way the instructions compute it, if that
+  // is known at compile time (division by zero is left to run time).
+static bool Fold(BinaryOp::OpCode code, int a, int b, int *result)
+{
+  switch (code) {
+    case BinaryOp::Add: *result = (unsigned)a + (unsigned)b; return true;
+    case BinaryOp::Sub: *result = (unsigned)a - (unsigned)b; return true;
+    case BinaryOp::Mul: *result = (unsigned)a * (unsigned)b; return true;
+    case BinaryOp::Div:
+    case BinaryOp::Mod:
+      if (b == 0 || (a == INT_MIN && b == -1)) return false;
+      *result = code == BinaryOp::Div ? a / b : a % b;
+      return true;
+    case BinaryOp::Less: *result = a < b; return true;
+    case BinaryOp::ULess: *result = (unsigned)a < (unsigned)b; return true;
+    case BinaryOp::Eq: *result = a == b; return true;
+    case BinaryOp::And: *result = a & b; return true;
+    case BinaryOp::Or: *result = a | b; return true;
+    default: return false;
+  }
+}
+
+/* Method: Analyze
+ * ---------------
+ * Counts the assignments and reads of each local and temp, and notes
+ * the blocks they appear in. Then the temps assigned a constant once
+ * (or computed once from such temps) are marked constant, and temps
+ * nobody reads are dropped along with whatever only they read.
+ */
+void MipsISel::Analyze()
+{
+  int block = 0;
+  for (size_t i = 0; i < ops.size(); i++) {
+    TacOp &op = ops[i];
+    if (op.kind == TLabel) block++;
+    Location *reads[2] = { op.a, op.kind == TStore || op.kind == TBinary ? op.b : NULL };
+    for (int r = 0; r < 2; r++) {
+      if (!IsLocal(reads[r])) continue;
+      Var &v = Lookup(reads[r]);
+      v.uses++;
+      if (v.firstUse < 0) v.firstUse = i;
+      if (v.block >= 0 && v.block != block) v.multiBlock = true;
+      v.block = block;
+    }
+    if (IsLocal(op.dst)) {
+      Var &v = Lookup(op.dst);
+      v.defs++;
+      v.defPos = i;
+      v.constant = op.kind == TConst;
+      v.value = op.val;
+      if (v.block >= 0 && v.block != block) v.multiBlock = true;
+      v.block = block;
+    }
+    if (op.kind == TGoto || op.kind == TIfZ || op.kind == TReturn) block++;
+  }
+  for (map<int, Var>::iterator v = vars.begin(); v != vars.end(); v++)
+    v->second.constant = v->second.constant && v->second.temp && v->second.defs == 1;
+  for (size_t i = 0; i < ops.size(); i++) {      // and what is computed from constants
+    TacOp &op = ops[i];
+    if ((op.kind != TBinary && op.kind != TCopy) || !IsLocal(op.dst)) continue;
+    Var &v = Lookup(op.dst);
+    if (!v.temp || v.defs != 1 || !IsLocal(op.a) || !Lookup(op.a).constant) continue;
+    if (op.kind == TCopy) {
+      v.constant = true;
+      v.value = Lookup(op.a).value;
+    } else if (IsLocal(op.b) && Lookup(op.b).constant)
+      v.constant = Fold(op.code, Lookup(op.a).value, Lookup(op.b).value, &v.value);
+  }
+
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (size_t i = 0; i < ops.size(); i++) {
+      TacOp &op = ops[i];
+      bool divides = op.kind == TBinary && (op.code == BinaryOp::Div || op.code == BinaryOp::Mod);
+      bool pure = op.kind == TConst || op.kind == TAddr || op.kind == TLoad || op.kind == TCopy ||
+                  (op.kind == TBinary && !divides) ||
+                  (divides && IsLocal(op.b) && Lookup(op.b).constant && Lookup(op.b).value != 0);
+      if (op.dead || !pure || !IsLocal(op.dst)) continue;
+      Var &v = Lookup(op.dst);
+      if (!v.temp || v.uses > 0) continue;
+      op.dead = changed = true;
+      if (IsLocal(op.a)) Lookup(op.a).uses--;
+      if (op.kind == TBinary && IsLocal(op.b)) Lookup(op.b).uses--;
+    }
+  }
+}
+
+
+MInstr *MipsISel::Append(MipsTarget::Opcode op)
+{
+  Assert(cur);
+  MInstr *in = MipsTarget::New(op);
+  cur->code.push_back(in);
+  return in;
+}
+
+MInstr *MipsISel::Append(MipsTarget::Opcode op, int d, int s, int t)
+{
+  return Append(op)->Add(MOperand::Reg(d))->Add(MOperand::Reg(s))->Add(MOperand::Reg(t));
+}
+
+MInstr *MipsISel::AppendImm(MipsTarget::Opcode op, int d, int s, int imm)
+{
+  return Append(op)->Add(MOperand::Reg(d))->Add(MOperand::Reg(s))->Add(MOperand::Imm(imm));
+}
+
+MInstr *MipsISel::AppendMem(MipsTarget::Opcode op, int r, int base, int offset)
+{
+  return Append(op)->Add(MOperand::Reg(r))->Add(MOperand::Reg(base))->Add(MOperand::Imm(offset));
+}
+
+  // Starts a block, unless the current one is still empty (as it is
+  // after a branch) and can just take the label.
+void MipsISel::StartBlock(const char *label)
+{
+  pending.clear();
+  if (!cur->code.empty() || (cur->label && label))
+    cur = fn->NewBlock(label);
+  else if (label)
+    cur->label = label;
+}
+
+  // The register of a variable (a local or temp that is not a tree
+  // temp, or a parameter, which is copied or loaded at entry).
+int MipsISel::VarReg(Location *var)
+{
+  Var &v = Lookup(var);
+  if (v.reg >= 0) return v.reg;
+  v.reg = fn->NewVReg();
+  int slot = (var->GetOffset() - CodeGenerator::OffsetToFirstParam) / CodeGenerator::VarSize;
+  if (var->GetOffset() > 0 && regArgs && slot < NumArgRegs)
+    entry->code.push_back(target.CreateCopy(v.reg, T::a0 + slot));
+  else if (var->GetOffset() > 0) {
+    int offset = var->GetOffset() - (regArgs ? NumArgRegs * CodeGenerator::VarSize : 0);
+    int fi = fn->NewFixedObject(offset);
+    fn->home[v.reg] = fi;
+    entry->code.push_back(target.CreateLoad(v.reg, fi));
+  }
+  return v.reg;
+}
+
+
+MipsISel::Node *MipsISel::NewNode(Node::Kind kind, int val, Node *left, Node *right)
+{
+  Node *n = new Node;
+  n->kind = kind;
+  n->code = BinaryOp::Add;
+  n->val = val;
+  n->label = NULL;
+  n->kid[0] = left;
+  n->kid[1] = right;
+  n->uses = 0;
+  n->reg = -1;
+  nodes.push_back(n);
+  return n;
+}
+
+  // The tree for reading var here.
+MipsISel::Node *MipsISel::Operand(Location *var)
+{
+  if (var->GetSegment() == gpRelative)
+    return NewNode(Node::Load, var->GetOffset(), NewNode(Node::Reg, T::gp));
+  if (IsLocal(var)) {
+    Var &v = Lookup(var);
+    if (v.constant) return NewNode(Node::Const, v.value);
+    if (IsTree(var)) {
+      Assert(v.node);
+      v.remaining--;
+      return v.node;
+    }
+  }
+  return NewNode(Node::Reg, VarReg(var));
+}
+
+/* Method: Assign
+ * --------------
+ * A tree temp is just bound to its tree. Anything else is a root: the
+ * tree is selected now, into the variable's register or (for a global)
+ * stored to memory.
+ */
+void MipsISel::Assign(Location *dst, Node *value)
+{
+  if (dst->GetSegment() == gpRelative) {
+    Barrier();
+    AppendMem(T::Sw, MunchReg(value), T::gp, dst->GetOffset());
+  } else if (IsTree(dst)) {
+    Var &v = Lookup(dst);
+    v.node = value;
+    v.remaining = v.uses;
+    value->uses += v.uses;
+    pending.push_back(dst->GetOffset());
+  } else {
+    int reg = VarReg(dst);
+    BeforeDef(reg);
+    int r = MunchReg(value, reg);
+    if (r != reg) cur->code.push_back(target.CreateCopy(reg, r));
+  }
+}
+
+bool MipsISel::Reads(Node *n, int reg)
+{
+  if (!n || n->reg >= 0) return false;
+  if (n->kind == Node::Reg) return n->val == reg;
+  return Reads(n->kid[0], reg) || Reads(n->kid[1], reg);
+}
+
+bool MipsISel::HasEffect(Node *n)
+{
+  if (!n || n->reg >= 0) return false;
+  if (n->kind == Node::Load) return true;
+  if (n->kind == Node::Binary && (n->code == BinaryOp::Div || n->code == BinaryOp::Mod) &&
+      !(n->kid[1]->kind == Node::Const && n->kid[1]->val != 0))
+    return true;
+  return HasEffect(n->kid[0]) || HasEffect(n->kid[1]);
+}
+
+  // Computes a pending tree into a register of its own now.
+void MipsISel::Materialize(Node *n)
+{
+  if (n->reg >= 0 || n->kind == Node::Const) return;
+  int r = MunchReg(n);
+  if (n->kind == Node::Reg) {
+    n->reg = fn->NewVReg();
+    cur->code.push_back(target.CreateCopy(n->reg, r));
+  } else
+    n->reg = r;
+}
+
+  // Before a store or a call: trees still to be read that load from
+  // memory (or may trap) are computed first.
+void MipsISel::Barrier()
+{
+  for (size_t i = 0; i < pending.size(); i++) {
+    Var &v = vars[pending[i]];
+    if (v.remaining > 0 && HasEffect(v.node)) Materialize(v.node);
+  }
+}
+
+  // Before reg is assigned: trees still to be read that read it are
+  // computed first.
+void MipsISel::BeforeDef(int reg)
+{
+  for (size_t i = 0; i < pending.size(); i++) {
+    Var &v = vars[pending[i]];
+    if (v.remaining > 0 && Reads(v.node, reg)) Materialize(v.node);
+  }
+}
+
+
+/* Method: MunchReg
+ * ----------------
+ * Selects instructions for the tree n, leaving its value in a register
+ * (dst if given and n is not shared, so no copy is needed) which is
+ * returned. A tree read more than once keeps its register.
+ */
+int MipsISel::MunchReg(Node *n, int dst)
+{
+  if (n->reg >= 0) return n->reg;
+  if (n->uses > 1) dst = -1;
+  int d = dst >= 0 ? dst : -1, base, offset;
+  switch (n->kind) {
+    case Node::Const:
+      if (n->val == 0 && dst < 0) return T::zero;
+      if (d < 0) d = fn->NewVReg();
+      Append(T::Li)->Add(MOperand::Reg(d))->Add(MOperand::Imm(n->val));
+      return d;
+    case Node::Reg:
+      return n->val;
+    case Node::Addr:
+      if (d < 0) d = fn->NewVReg();
+      Append(T::La)->Add(MOperand::Reg(d))->Add(MOperand::Label(n->label));
+      break;
+    case Node::Load:
+      offset = MunchAddress(n->kid[0], n->val, &base);
+      if (d < 0) d = fn->NewVReg();
+      AppendMem(T::Lw, d, base, offset);
+      break;
+    case Node::Binary:
+      d = MunchBinary(n, d);
+      break;
+  }
+  if (n->uses > 1) n->reg = d;
+  return d;
+}
+
+/* Method: MunchAddress
+ * --------------------
+ * Selects the address n plus offset for a lw or sw: a constant added
+ * to the address folds into the instruction's offset. Returns the
+ * offset, with the base register in *base.
+ */
+int MipsISel::MunchAddress(Node *n, int offset, int *base)
+{
+  if (n->reg < 0 && n->uses <= 1 && n->kind == Node::Binary && n->code == BinaryOp::Add) {
+    for (int side = 0; side < 2; side++) {
+      Node *c = n->kid[1 - side];
+      if (c->kind == Node::Const && Fits16((long long)offset + c->val)) {
+        *base = MunchReg(n->kid[side]);
+        return offset + c->val;
+      }
+    }
+  }
+  *base = MunchReg(n);
+  if (!Fits16(offset)) {
+    int sum = fn->NewVReg();
+    Append(T::Li)->Add(MOperand::Reg(sum))->Add(MOperand::Imm(offset));
+    Append(T::Addu, sum, sum, *base);
+    *base = sum;
+    return 0;
+  }
+  return offset;
+}
+
+/* Method: MunchBinary
+ * -------------------
+ * The tiles for a binary operator, preferring the immediate forms when
+ * an operand is a small enough constant. Both operands are selected
+ * before the last instruction writes dst, which may be one of them.
+ */
+int MipsISel::MunchBinary(Node *n, int dst)
+{
+  Node *l = n->kid[0], *r = n->kid[1];
+  int d = dst >= 0 ? dst : fn->NewVReg(), t;
+  bool lc = l->kind == Node::Const, rc = r->kind == Node::Const;
+  long long lv = l->val, rv = r->val;
+
+  switch (n->code) {
+    case BinaryOp::Add:
+      if (rc && Fits16(rv)) AppendImm(T::Addiu, d, MunchReg(l), rv);
+      else if (lc && Fits16(lv)) AppendImm(T::Addiu, d, MunchReg(r), lv);
+      else Append(T::Addu, d, MunchReg(l), MunchReg(r));
+      break;
+    case BinaryOp::Sub:
+      if (rc && Fits16(-rv)) AppendImm(T::Addiu, d, MunchReg(l), -rv);
+      else Append(T::Subu, d, MunchReg(l), MunchReg(r));
+      break;
+    case BinaryOp::Mul:
+      if (rc) MunchMulConst(d, MunchReg(l), rv);
+      else if (lc) MunchMulConst(d, MunchReg(r), lv);
+      else Append(T::Mul, d, MunchReg(l), MunchReg(r));
+      break;
+    case BinaryOp::Div:
+    case BinaryOp::Mod:
+      if (rc && rv != 0) {
+        MunchDivConst(d, MunchReg(l), rv, n->code == BinaryOp::Mod);
+        break;
+      }
+      t = MunchReg(l);
+      Append(n->code == BinaryOp::Div ? T::Div : T::Rem, d, t, MunchReg(r));
+      break;
+    case BinaryOp::Less:
+      if (rc && Fits16(rv)) AppendImm(T::Slti, d, MunchReg(l), rv);
+      else Append(T::Slt, d, MunchReg(l), MunchReg(r));
+      break;
+    case BinaryOp::ULess:                // sltiu sign-extends, then compares unsigned
+      if (rc && Fits16(rv)) AppendImm(T::Sltiu, d, MunchReg(l), rv);
+      else Append(T::Sltu, d, MunchReg(l), MunchReg(r));
+      break;
+    case BinaryOp::Eq:                   // x == y is (x ^ y) <u 1
+      if (rc && rv == 0) t = MunchReg(l);
+      else if (lc && lv == 0) t = MunchReg(r);
+      else {
+        t = fn->NewVReg();
+        if (rc && FitsUnsigned16(rv)) AppendImm(T::Xori, t, MunchReg(l), rv);
+        else if (lc && FitsUnsigned16(lv)) AppendImm(T::Xori, t, MunchReg(r), lv);
+        else Append(T::Xor, t, MunchReg(l), MunchReg(r));
+      }
+      AppendImm(T::Sltiu, d, t, 1);
+      break;
+    case BinaryOp::And:
+    case BinaryOp::Or:
+      if (rc && FitsUnsigned16(rv))
+        AppendImm(n->code == BinaryOp::And ? T::Andi : T::Ori, d, MunchReg(l), rv);
+      else if (lc && FitsUnsigned16(lv))
+        AppendImm(n->code == BinaryOp::And ? T::Andi : T::Ori, d, MunchReg(r), lv);
+      else
+        Append(n->code == BinaryOp::And ? T::And : T::Or, d, MunchReg(l), MunchReg(r));
+      break;
+    default:
+      Assert(0);
+  }
+  return d;
+}
+
+
+/* Method: Select
+ * --------------
+ * Selects one Tac instruction. Assignments go through Assign; stores,
+ * branches, calls and returns are the roots whose trees are munched
+ * where they stand.
+ */
+void MipsISel::Select(TacOp &op)
+{
+  Node *n, *value;
+  int r, base, offset;
+  if ((op.kind == TConst || op.kind == TBinary || op.kind == TCopy) &&
+      IsLocal(op.dst) && Lookup(op.dst).constant)
+    return;                              // read as the constant itself
+  switch (op.kind) {
+    case TConst:
+      Assign(op.dst, NewNode(Node::Const, op.val));
+      break;
+    case TAddr:
+      n = NewNode(Node::Addr, 0);
+      n->label = op.label;
+      Assign(op.dst, n);
+      break;
+    case TLoad:
+      Assign(op.dst, NewNode(Node::Load, op.val, Operand(op.a)));
+      break;
+    case TCopy:
+      Assign(op.dst, Operand(op.a));
+      break;
+    case TBinary:
+      n = Operand(op.a);
+      n = NewNode(Node::Binary, 0, n, Operand(op.b));
+      n->code = op.code;
+      Assign(op.dst, n);
+      break;
+    case TStore:
+      n = Operand(op.a);
+      value = Operand(op.b);
+      Barrier();
+      r = MunchReg(value);
+      offset = MunchAddress(n, op.val, &base);
+      AppendMem(T::Sw, r, base, offset);
+      break;
+
+    case TLabel:
+      StartBlock(op.label);
+      break;
+    case TGoto:
+      Append(T::B)->Add(MOperand::Label(op.label));
+      StartBlock(NULL);
+      break;
+    case TIfZ:                           // IfZ x == y is bne x, y
+      n = Operand(op.a);
+      if (n->reg < 0 && n->uses <= 1 && n->kind == Node::Binary && n->code == BinaryOp::Eq) {
+        r = MunchReg(n->kid[0]);
+        base = MunchReg(n->kid[1]);
+        Append(T::Bne)->Add(MOperand::Reg(r))->Add(MOperand::Reg(base))->Add(MOperand::Label(op.label));
+      } else {
+        r = MunchReg(n);
+        Append(T::Beqz)->Add(MOperand::Reg(r))->Add(MOperand::Label(op.label));
+      }
+      StartBlock(NULL);
+      break;
+    case TReturn:
+      if (op.a) {
+        r = MunchReg(Operand(op.a), T::v0);
+        if (r != T::v0) cur->code.push_back(target.CreateCopy(T::v0, r));
+      }
+      Append(T::Ret);
+      StartBlock(NULL);
+      break;
+
+    case TParam:
+      n = Operand(op.a);
+      if (regArgs) {                     // kept for the call, see SelectCall
+        args.push_back(n->kind == Node::Const ? n : NewNode(Node::Reg, MunchReg(n)));
+        break;
+      }
+      r = MunchReg(n);
+      AppendImm(T::Addiu, T::sp, T::sp, -4);
+      AppendMem(T::Sw, r, T::sp, 4);
+      break;
+    case TLCall:
+    case TACall:
+    case TBuiltIn:
+      SelectCall(op);
+      break;
+    case TPop:
+      if (op.val != 0) AppendImm(T::Addiu, T::sp, T::sp, op.val);
+      break;
+    case TAlloc:
+      SelectAlloc(op);
+      break;
+      break;
+  }
+}
+
+/* Method: SelectCall
+ * ------------------
+ * A call, with its arguments: as many of them as its pop (op.val
+ * bytes) says are taken off args, the first of them on top. A Decaf
+ * function gets the first four in $a0-$a3 and the rest stored above
+ * $sp, a runtime routine all of them there; a register entry of a
+ * built-in (TBuiltIn) gets op.a in $a0 and keeps the allocatable
+ * registers. $sp is moved only if something goes on the stack.
+ */
+void MipsISel::SelectCall(TacOp &op)
+{
+  Node *n = op.kind != TLCall && op.a ? Operand(op.a) : NULL;
+  Barrier();
+  vector<Node *> actual;
+  if (op.kind == TBuiltIn) {
+    if (n) actual.push_back(n);
+  } else {
+    int count = op.val / CodeGenerator::VarSize;
+    actual.assign(args.rbegin(), args.rbegin() + count);
+    args.resize(args.size() - count);
+  }
+  bool runtime = op.kind == TLCall && CodeGenerator::BuiltInForLabel(op.label) != NumBuiltIns;
+  int inRegs = runtime ? 0 : std::min((int)actual.size(), (int)NumArgRegs);
+  int stackBytes = (actual.size() - inRegs) * CodeGenerator::VarSize;
+  int fnAddr = op.kind == TACall ? MunchReg(n) : -1;
+
+  if (stackBytes > 0) AppendImm(T::Addiu, T::sp, T::sp, -stackBytes);
+  for (size_t k = inRegs; k < actual.size(); k++)
+    AppendMem(T::Sw, MunchReg(actual[k]), T::sp, CodeGenerator::VarSize * (k - inRegs + 1));
+  for (int k = 0; k < inRegs; k++)
+    if (actual[k]->kind == Node::Const)
+      Append(T::Li)->Add(MOperand::Reg(T::a0 + k))->Add(MOperand::Imm(actual[k]->val));
+    else
+      cur->code.push_back(target.CreateCopy(T::a0 + k, MunchReg(actual[k])));
+  if (op.kind == TACall)
+    Append(T::Jalr)->Add(MOperand::Reg(fnAddr));
+  else {
+    MInstr *jal = Append(T::Jal)->Add(MOperand::Label(op.label));
+    if (op.kind == TBuiltIn) jal->flags |= MKeepsRegs;
+  }
+  if (stackBytes > 0) AppendImm(T::Addiu, T::sp, T::sp, stackBytes);
+
+  if (!op.dst) return;
+  int r;
+  if (IsLocal(op.dst) && !IsTree(op.dst)) {
+    r = VarReg(op.dst);
+    BeforeDef(r);
+    cur->code.push_back(target.CreateCopy(r, T::v0));
+  } else {
+    r = fn->NewVReg();
+    cur->code.push_back(target.CreateCopy(r, T::v0));
+    Assign(op.dst, NewNode(Node::Reg, r));
+  }
+}
+
+/* Method: SelectAlloc
+ * -------------------
+ * dst = _Alloc(a) as the runtime's fast path, with a call only when
+ * the current window is used up. Each block starts with a header
+ * holding its size, for the collector:
+ *
+ *         la    h, _Heap
+ *         lw    dst, 0(h)        # next free byte
+ *         lw    end, 4(h)        # end of the window
+ *         addiu n, a, 4          # and the header
+ *         addu  next, dst, n
+ *         sltu  full, end, next
+ *         beqz  full, fast
+ *         move  $a0, a
+ *         jal   _AllocA0         # keeps the allocatable registers
+ *         move  dst, $v0
+ *         b     done
+ *   fast: sw    next, 0(h)
+ *         sw    n, 0(dst)
+ *         addiu dst, dst, 4
+ *   done:
+ *
+ * The blocks are made here rather than with StartBlock, since the
+ * trees of the block being selected are still to be read after it.
+ */
+void MipsISel::SelectAlloc(TacOp &op)
+{
+  Node *size = Operand(op.a);
+  Barrier();
+  if (size->kind != Node::Const || !Fits16(size->val + 4))
+    size = NewNode(Node::Reg, MunchReg(size));
+  int result = fn->NewVReg(), heap = fn->NewVReg(), end = fn->NewVReg();
+  int next = fn->NewVReg(), full = fn->NewVReg(), total = fn->NewVReg();
+  const char *fast = CodeGenerator::NewLabel(), *done = CodeGenerator::NewLabel();
+
+  Append(T::La)->Add(MOperand::Reg(heap))->Add(MOperand::Label("_Heap"));
+  AppendMem(T::Lw, result, heap, 0);
+  AppendMem(T::Lw, end, heap, 4);
+  if (size->kind == Node::Reg) AppendImm(T::Addiu, total, size->val, 4);
+  else Append(T::Li)->Add(MOperand::Reg(total))->Add(MOperand::Imm(size->val + 4));
+  Append(T::Addu, next, result, total);
+  Append(T::Sltu, full, end, next);
+  Append(T::Beqz)->Add(MOperand::Reg(full))->Add(MOperand::Label(fast));
+
+  cur = fn->NewBlock(NULL);
+  if (size->kind == Node::Reg) cur->code.push_back(target.CreateCopy(T::a0, size->val));
+  else Append(T::Li)->Add(MOperand::Reg(T::a0))->Add(MOperand::Imm(size->val));
+  Append(T::Jal)->Add(MOperand::Label("_AllocA0"))->flags |= MKeepsRegs;
+  cur->code.push_back(target.CreateCopy(result, T::v0));
+  Append(T::B)->Add(MOperand::Label(done));
+
+  cur = fn->NewBlock(fast);
+  AppendMem(T::Sw, next, heap, 0);
+  AppendMem(T::Sw, total, result, 0);
+  AppendImm(T::Addiu, result, result, 4);
+  cur = fn->NewBlock(done);
+
+  if (IsLocal(op.dst) && !IsTree(op.dst)) {
+    int r = VarReg(op.dst);
+    BeforeDef(r);
+    cur->code.push_back(target.CreateCopy(r, result));
+  } else
+    Assign(op.dst, NewNode(Node::Reg, result));
+}
+
+/* Method: MunchMulConst
+ * ---------------------
+ * d = x * c. With the set bits of |c| as shifts of x added up, or a
+ * run of ones as the difference of two shifts, whichever is shorter;
+ * mul (12 cycles before its result can be used on the pipeline dsim
+ * models) only when that would take more than four instructions.
+ */
+void MipsISel::MunchMulConst(int d, int x, int c)
+{
+  unsigned u = c < 0 ? -(unsigned)c : c;
+  if (u == 0) {
+    Append(T::Move)->Add(MOperand::Reg(d))->Add(MOperand::Reg(T::zero));
+    return;
+  }
+  int bits = __builtin_popcount(u), low = __builtin_ctz(u);
+  unsigned run = u + (1u << low);               // a run of ones: u = run - 2^low
+  bool isRun = run == 0 || !(run & (run - 1));
+  int addCost = bits == 1 ? (low ? 1 : 0) : 2 * bits - 1 - (low == 0);
+  int runCost = 3 - (low == 0);
+  int cost = std::min(addCost, isRun && bits > 1 ? runCost : addCost) + (c < 0);
+  if (cost > 4) {
+    int k = fn->NewVReg();
+    Append(T::Li)->Add(MOperand::Reg(k))->Add(MOperand::Imm(c));
+    Append(T::Mul, d, x, k);
+    return;
+  }
+
+  int dst = c < 0 ? fn->NewVReg() : d, acc = -1;
+  if (isRun && bits > 1 && runCost < addCost) {  // x << (low + bits) - x << low
+    int hi = T::zero, lo = x;
+    if (low + bits < 32) AppendImm(T::Sll, hi = fn->NewVReg(), x, low + bits);
+    if (low) AppendImm(T::Sll, lo = fn->NewVReg(), x, low);
+    Append(T::Subu, dst, hi, lo);
+  } else if (bits == 1 && !low) {
+    Append(T::Move)->Add(MOperand::Reg(dst))->Add(MOperand::Reg(x));
+  } else {
+    for (int b = 0; b < 32; b++) {
+      if (!(u & (1u << b))) continue;
+      int term = x;
+      bool last = !(u >> b >> 1);
+      if (b) {
+        term = last && acc < 0 ? dst : fn->NewVReg();
+        AppendImm(T::Sll, term, x, b);
+      }
+      if (acc < 0) acc = term;
+      else {
+        int sum = last ? dst : fn->NewVReg();
+        Append(T::Addu, sum, acc, term);
+        acc = sum;
+      }
+    }
+  }
+  if (c < 0) Append(T::Subu, d, T::zero, dst);
+}
+
+  // The magic number and shift for signed division by c, where
+  // |c| >= 2 (Hacker's Delight, figure 10-1).
+static void Magic(int c, int *multiplier, int *shift)
+{
+  const unsigned two31 = 0x80000000u;
+  unsigned ad = c < 0 ? -(unsigned)c : c;
+  unsigned t = two31 + ((unsigned)c >> 31);
+  unsigned anc = t - 1 - t % ad;
+  int p = 31;
+  unsigned q1 = two31 / anc, r1 = two31 - q1 * anc;
+  unsigned q2 = two31 / ad, r2 = two31 - q2 * ad, delta;
+  do {
+    p++;
+    q1 *= 2; r1 *= 2;
+    if (r1 >= anc) { q1++; r1 -= anc; }
+    q2 *= 2; r2 *= 2;
+    if (r2 >= ad) { q2++; r2 -= ad; }
+    delta = ad - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+  *multiplier = (int)(q2 + 1);
+  if (c < 0) *multiplier = -*multiplier;
+  *shift = p - 32;
+}
+
+/* Method: MunchDivConst
+ * ---------------------
+ * d = x / c or x % c (truncating, as div and rem do) for a constant c
+ * other than 0. A power of two is a shift, after adding 2^k - 1 to a
+ * negative x so it rounds toward zero. Anything else takes the high
+ * word of x times the magic reciprocal of c, shifted and corrected by
+ * one when negative; the remainder is then x - (x / c) * c.
+ */
+void MipsISel::MunchDivConst(int d, int x, int c, bool mod)
+{
+  unsigned u = c < 0 ? -(unsigned)c : c;
+  if (u == 1) {
+    if (mod) Append(T::Move)->Add(MOperand::Reg(d))->Add(MOperand::Reg(T::zero));
+    else if (c == 1) Append(T::Move)->Add(MOperand::Reg(d))->Add(MOperand::Reg(x));
+    else Append(T::Subu, d, T::zero, x);
+    return;
+  }
+  if (!(u & (u - 1))) {
+    int k = __builtin_ctz(u), bias = fn->NewVReg(), sum = fn->NewVReg();
+    if (k == 1) AppendImm(T::Srl, bias, x, 31);
+    else {
+      AppendImm(T::Sra, bias, x, 31);
+      AppendImm(T::Srl, bias, bias, 32 - k);
+    }
+    Append(T::Addu, sum, x, bias);
+    if (mod) {                                  // ((x + bias) & (2^k - 1)) - bias
+      int low = fn->NewVReg();
+      if (FitsUnsigned16(u - 1)) AppendImm(T::Andi, low, sum, u - 1);
+      else {
+        int mask = fn->NewVReg();
+        Append(T::Li)->Add(MOperand::Reg(mask))->Add(MOperand::Imm(u - 1));
+        Append(T::And, low, sum, mask);
+      }
+      Append(T::Subu, d, low, bias);
+    } else if (c > 0)
+      AppendImm(T::Sra, d, sum, k);
+    else {
+      int q = fn->NewVReg();
+      AppendImm(T::Sra, q, sum, k);
+      Append(T::Subu, d, T::zero, q);
+    }
+    return;
+  }
+
+  int multiplier, shift;
+  Magic(c, &multiplier, &shift);
+  int m = fn->NewVReg(), q = fn->NewVReg();
+  Append(T::Li)->Add(MOperand::Reg(m))->Add(MOperand::Imm(multiplier));
+  Append(T::MulHi, q, x, m);
+  if (c > 0 && multiplier < 0) Append(T::Addu, q, q, x);
+  if (c < 0 && multiplier > 0) Append(T::Subu, q, q, x);
+  if (shift) AppendImm(T::Sra, q, q, shift);
+  int sign = fn->NewVReg();
+  AppendImm(T::Srl, sign, q, 31);
+  if (!mod) {
+    Append(T::Addu, d, q, sign);
+    return;
+  }
+  int quotient = fn->NewVReg(), product = fn->NewVReg();
+  Append(T::Addu, quotient, q, sign);
+  MunchMulConst(product, quotient, c);
+  Append(T::Subu, d, x, product);
+}
@@ -0,0 +1,314 @@
+/* File: mipsmir.h
+ * ---------------
+ * The MIPS target of the machine IR (see mir.h). This is the default
+ * MIPS code generator; the Mips class still supplies the preamble and
+ * the runtime routines, and can translate the Tac directly instead
+ * (dcc -d direct), which is what it did before.
+ *
+ * MipsISel is the instruction selector. It is a Backend, so the Tac
+ * list is walked with EmitSpecific as for the other consumers; it
+ * collects the Tac of one function (BeginFunc to EndFunc) and then
+ * selects instructions for it into an MFunction:
+ *
+ *   - a temp that is assigned once and only read in the same block is
+ *     a tree temp: it gets no register of its own, its value becomes
+ *     a node of the block's expression DAG, and the trees are covered
+ *     by maximal munch where they are used, so constants fold into
+ *     immediate forms (addiu, slti, andi, sll for a power of two...),
+ *     an address computation into the offset of its lw/sw, and a test
+ *     of equality into its branch. A tree read more than once is
+ *     computed once, into a register;
+ *   - multiplying by a constant is a few shifts and adds when that
+ *     beats mul, and dividing by a constant (or taking the remainder)
+ *     a multiply by its magic reciprocal, or shifts for a power of
+ *     two, instead of div/rem;
+ *   - a temp assigned a constant once, or computed once from such
+ *     temps, is that constant everywhere;
+ *   - temps nobody reads are dropped (unless computing them traps);
+ *   - other locals and temps (fp-relative Locations at a negative
+ *     offset) are one virtual register each for the whole function;
+ *   - each parameter becomes a virtual register, copied at entry from
+ *     the register it was passed in or loaded from its stack slot, a
+ *     fixed frame object (see the calling convention below);
+ *   - globals are read and written with lw/sw off $gp, though the
+ *     ones a function uses most are then kept in registers (see
+ *     PromoteGlobals, which needs the whole program);
+ *   - the call sequence is explicit: the arguments, jal/jalr and the
+ *     copy of $v0 to the result.
+ *   - a call to _Alloc is a bump of the heap pointer inline, checked
+ *     against the end of the runtime's current window of free heap,
+ *     and the header the collector needs is stored; only when the
+ *     window is used up is _Alloc called (see Mips::EmitAlloc).
+ *   - a call to a print built-in, ReadInteger or Halt passes its
+ *     argument in $a0 to the routine's register entry (see
+ *     Mips::RegisterEntry), with no push or pop. Those routines change
+ *     only $a0-$a3, $v0 and $v1, so the call keeps the allocatable
+ *     registers, as the call to _AllocA0 does.
+ *
+ * Trees are evaluated late, so a tree that reads memory (or may divide
+ * by zero) is computed into its register before any store or call,
+ * and one that reads a variable before that variable is assigned
+ * again.
+ * Arithmetic is done with the non-trapping addu/subu/addiu, which
+ * wrap on overflow like the other targets.
+ *
+ * Decaf functions pass their first four arguments (this, for a method,
+ * being the first) in $a0-$a3 and the rest on the stack, where the
+ * callee finds the fifth at 4($fp), the sixth at 8($fp) and so on, so
+ * a parameter's slot is 16 bytes below the one its Tac Location names.
+ * The caller moves $sp once to make room for the stack arguments, and
+ * once to take them off again, rather than pushing each; a call with
+ * four arguments or fewer does not move it at all. The arguments of a
+ * call are taken when the call is selected, since the Tac pushes them
+ * one at a time, each as soon as it is evaluated, with the calls made
+ * to evaluate the others in between. The runtime routines still take
+ * their arguments on the stack (but see Mips::RegisterEntry), all
+ * stored after one move of $sp. With -d stackargs every argument is
+ * pushed as the Tac says, as the Mips class does.
+ *
+ * The functions are held back until the whole program has been
+ * selected, then compiled (RunMachinePasses) and printed callees
+ * first (see EmitProgram), so that each call is known to clobber only
+ * the registers its callee may change, and a global function that is
+ * not recursive takes its arguments in the registers it would have
+ * copied them to. With -d nointerproc, each function goes through
+ * the passes and is printed as soon as it ends, every call clobbers
+ * all the caller-saved registers and no global is promoted. Strings
+ * and vtables are data and go straight to the output as they are
+ * seen.
+ *
+ * MipsTarget describes the registers and prints the instructions. The
+ * frame holds the saved $ra, then the $s registers the function uses,
+ * saved at entry and restored on return, then the spill slots in place
+ * of the Tac's locals and temps; the parameters passed in registers
+ * have no slot unless they are spilled. The $t registers are handed
+ * out first, and the $s registers (which the function must save) to
+ * values that live across a call, or when the $t are used up.
+ *
+ * Only main sets up $fp, as the Mips class does for every function
+ * (the collector finds the top of the stack by following the saved
+ * $fp links to main's frame, see Mips::EmitCollector). Every other
+ * frame is of a size known at compile time, so it is addressed off
+ * $sp, and $fp is left alone. A leaf function (one without a jal or
+ * jalr) does not save $ra, and one that needs no frame at all is just
+ * its body and a jr $ra. The frame is also shrink-wrapped: when the
+ * blocks that need it (see ShrinkWrap) are entered at one place, the
+ * prologue goes there, and a path that returns without reaching it
+ * never sets the frame up.
+ */
+
+#ifndef _H_mipsmir
+#define _H_mipsmir
+
+#include "mir.h"
+#include "backend.h"
+#include <map>
+#include <set>
+#include <string>
+using std::map;
+using std::set;
+using std::string;
+
+class MipsTarget : public MTarget {
+  public:
+    typedef enum {zero, at, v0, v1, a0, a1, a2, a3,
+                  t0, t1, t2, t3, t4, t5, t6, t7,
+                  s0, s1, s2, s3, s4, s5, s6, s7,
+                  t8, t9, k0, k1, gp, sp, fp, ra, NumRegs } Register;
+
+    typedef enum {
+        Li, La, Move, Lw, Sw,
+        Addu, Subu, Mul, Div, Rem, Slt, Sltu, And, Or, Xor,
+        Addiu, Slti, Sltiu, Andi, Ori, Xori, Sll, Sra, Srl, MulHi,
+        B, Beqz, Bnez, Beq, Bne, Jal, Jalr, Ret, NumOpcodes
+    } Opcode;
+
+    MipsTarget();
+
+    const vector<int> &AllocatableRegs() { return allocatable; }
+    const vector<int> &ScratchRegs()     { return scratch; }
+    const vector<int> &CalleeSavedRegs() { return calleeSaved; }
+    RegMask CallClobbers(MInstr *call);
+    const char *RegName(int reg);
+
+    MInstr *CreateCopy(int dst, int src);
+    MInstr *CreateLoad(int reg, int frameObject);
+    MInstr *CreateStore(int reg, int frameObject);
+
+    int Latency(MInstr *instr) { return latency[instr->opcode]; }
+
+    MInstr *CreateJump(const char *label);
+    bool ReverseBranch(MInstr *branch, const char *label);
+
+    void LayoutFrame(MFunction *fn);
+    void PrintInstr(FILE *out, MFunction *fn, MInstr *instr);
+    void EmitFunction(MFunction *fn);
+
+      // Records what a call to fn (allocated, and so final but for its
+      // prologue) may change: the allocatable registers it writes and
+      // does not restore, what its own calls clobber, and the registers
+      // in also -- the argument registers ChooseConvention picked for it,
+      // which its callers load and it does not preserve.
+    void NoteClobbers(MFunction *fn, RegMask also);
+    bool IsCallerSaved(int reg) { return reg < NumRegs && (callerSaved >> reg & 1); }
+
+    static MInstr *New(Opcode op);
+
+  private:
+    static const char *name[NumOpcodes];
+    static const int flags[NumOpcodes], numDefs[NumOpcodes], latency[NumOpcodes];
+    vector<int> allocatable, scratch, calleeSaved;
+    RegMask callerSaved;      // the allocatable registers but calleeSaved
+    map<string, RegMask> clobbers;  // by the functions noted so far
+    bool withFp;              // frame objects are addressed off $fp, not $sp
+    bool savesRa;             // the function calls something
+    int spBelow;              // how far $sp is below where it was at entry
+    int wrapAt;               // the block the prologue goes at, see ShrinkWrap
+    vector<bool> hasFrame;    // the blocks that run with the frame set up
+
+    void PrintOperand(FILE *out, MFunction *fn, const MOperand &o);
+    int ShrinkWrap(MFunction *fn);
+    int SavedOffset(int i);
+    void EmitPrologue(MFunction *fn);
+    void EmitEpilogue(MFunction *fn);
+};
+
+
+class MipsISel : public Backend {
+  public:
+    MipsISel();
+
+    void EmitLoadConstant(Location *dst, int val);
+    void EmitLoadStringConstant(Location *dst, const char *str);
+    void EmitLoadLabel(Location *dst, const char *label);
+
+    void EmitLoad(Location *dst, Location *reference, int offset);
+    void EmitStore(Location *reference, Location *value, int offset);
+    void EmitCopy(Location *dst, Location *src);
+
+    void EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                      Location *op1, Location *op2);
+
+    void EmitLabel(const char *label);
+    void EmitGoto(const char *label);
+    void EmitIfZ(Location *test, const char *label);
+    void EmitReturn(Location *returnVal);
+
+    void EmitBeginFunction(int frameSize);
+    void EmitEndFunction();
+
+    void EmitParam(Location *arg);
+    void EmitLCall(Location *result, const char *label);
+    void EmitACall(Location *result, Location *fnAddr);
+    void EmitPopParams(int bytes);
+
+    void EmitVTable(const char *label, List<const char*> *methodLabels);
+
+      // After the last Tac: compiles and prints the functions held back.
+    void EmitProgram();
+
+  private:
+    typedef enum { TConst, TAddr, TLoad, TStore, TCopy, TBinary, TLabel, TGoto,
+                   TIfZ, TReturn, TParam, TLCall, TACall, TPop,
+                   TAlloc,                  // dst = _Alloc(a), pushed and popped
+                   TBuiltIn } TacKind;      // dst = label(a), a register entry
+
+      // One Tac instruction of the function being selected.
+    struct TacOp {
+        TacKind kind;
+        BinaryOp::OpCode code;
+        Location *dst, *a, *b;   // b is the stored value of a TStore
+        int val;                 // constant, offset or bytes popped
+        const char *label;
+        bool dead;
+    };
+
+      // A node of the expression DAG of a block.
+    struct Node {
+        typedef enum { Const, Reg, Addr, Load, Binary } Kind;
+        Kind kind;
+        BinaryOp::OpCode code;
+        int val;                 // constant, register or load offset
+        const char *label;
+        Node *kid[2];
+        int uses;                // reads of the temps bound to it
+        int reg;                 // once computed and kept, else -1
+    };
+
+      // What is known about a local or temp (keyed by fp offset).
+    struct Var {
+        int defs, uses, defPos, firstUse, block;
+        bool temp, multiBlock, constant;
+        int value;               // if constant
+        int reg;                 // if a variable, its virtual register
+        Node *node;              // if a tree temp, the tree for its value
+        int remaining;           // reads of a tree temp not yet selected
+    };
+
+    MipsTarget target;
+    MFunction *fn;
+    MBlock *entry, *cur;
+    const char *functionLabel;
+    vector<TacOp> ops;
+    map<int, Var> vars;
+    vector<Node *> nodes;
+    vector<int> pending;                 // tree temps of this block
+    static const int NumArgRegs = 4;     // $a0-$a3
+    bool regArgs;                        // the first four arguments in $a0-$a3
+    vector<Node *> args;                 // pushed for calls not yet selected, last on top
+    bool wholeProgram;                   // functions held back to EmitProgram
+    vector<MFunction *> held;
+    set<string> escapes;                 // functions called other than by name
+    map<string, vector<int> > conventions;  // register of each argument, -1 if unused
+
+      // The globals (by $gp offset) a function and what it calls may
+      // read and write, or any of them.
+    struct ModRef {
+        set<int> mod, ref;
+        bool any;
+        ModRef() : any(false) {}
+        bool Merge(const ModRef &o);   // true if this one grew
+    };
+    map<string, ModRef> summaries;
+    ModRef methods;                      // of whatever a vtable may call
+
+    void Record(TacKind kind, Location *dst, Location *a, Location *b,
+                int val = 0, const char *label = NULL,
+                BinaryOp::OpCode code = BinaryOp::Add);
+    void Analyze();
+    void Select(TacOp &op);
+    void SelectCall(TacOp &op);
+    void SelectAlloc(TacOp &op);
+    void Compile(MFunction *f, bool ownConvention);
+    void UseConventions(MFunction *f);
+    RegMask ChooseConvention(MFunction *f);
+    void Summarize();
+    const ModRef *CallSummary(MInstr *call);
+    void PromoteGlobals(MFunction *f);
+    Var &Lookup(Location *var);
+    bool IsLocal(Location *var);
+    bool IsTree(Location *var);
+
+    MInstr *Append(MipsTarget::Opcode op);
+    MInstr *Append(MipsTarget::Opcode op, int d, int s, int t);
+    MInstr *AppendImm(MipsTarget::Opcode op, int d, int s, int imm);
+    MInstr *AppendMem(MipsTarget::Opcode op, int r, int base, int offset);
+    void StartBlock(const char *label);
+    int VarReg(Location *var);
+
+    static bool Reads(Node *n, int reg);
+    static bool HasEffect(Node *n);
+    Node *NewNode(Node::Kind kind, int val, Node *left = NULL, Node *right = NULL);
+    Node *Operand(Location *var);
+    void Assign(Location *dst, Node *value);
+    void Materialize(Node *n);
+    void Barrier();
+    void BeforeDef(int reg);
+    int MunchReg(Node *n, int dst = -1);
+    int MunchAddress(Node *n, int offset, int *base);
+    int MunchBinary(Node *n, int dst);
+    void MunchMulConst(int d, int x, int c);
+    void MunchDivConst(int d, int x, int c, bool mod);
+};
+
+#endif
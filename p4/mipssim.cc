@@ -0,0 +1,401 @@
+/* File: mipssim.cc
+ * ----------------
+ * Implementation of the Simulator class. Run is the hot loop; it keeps
+ * the instruction pointer and register file in locals and leaves only
+ * for system calls and exceptions.
+ */
+
+#include "mipssim.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static const unsigned DataBase = MipsProgram::DataBase;
+static const unsigned MemorySize = Simulator::StackTop - MipsProgram::DataBase;
+static const unsigned GpMinimum = 0x10008000;
+static const unsigned HeapGap = 0x10000;    // room between globals and heap
+
+static const int RegV0 = 2, RegA0 = 4, RegA1 = 5, RegA2 = 6, RegGp = 28, RegSp = 29, RegRa = 31;
+
+
+Simulator::Simulator(MipsProgram *program)
+  : prog(program), executed(0), exited(false), timing(NULL), translator(NULL),
+    translated(0)
+{
+  code = prog->code;
+  Insn end = { NumMipsOps, 0, 0, 0, 0 };      // running off the end of text
+  code.push_back(end);
+  nextAddress.resize(code.size());
+  for (size_t i = 0; i < prog->code.size(); i++)
+    nextAddress[i] = prog->address[i] + 4 * prog->size[i];
+
+    // Reserve the whole data-to-stack range up front; pages that are
+    // never touched are never backed.
+  void *m = mmap(NULL, MemorySize, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (m == MAP_FAILED) {
+    fprintf(stderr, "dsim: cannot reserve simulated memory\n");
+    exit(1);
+  }
+  memory = (unsigned char *)m;
+  if (!prog->data.empty())
+    memcpy(memory, &prog->data[0], prog->data.size());
+
+  memset(regs, 0, sizeof(regs));
+  hi = lo = 0;
+  unsigned staticEnd = (DataBase + prog->data.size() + 7) & ~7;
+  regs[RegGp] = staticEnd > GpMinimum ? staticEnd : GpMinimum;
+  regs[RegSp] = InitialSp;
+  brk = regs[RegGp] + HeapGap;
+  heapBytes = brk - DataBase;
+  stackLow = StackTop - StackLimit;
+}
+
+Simulator::~Simulator()
+{
+  delete translator;
+  munmap(memory, MemorySize);
+}
+
+void Simulator::EnableTranslation()
+{
+  if (!translator) translator = new Translator(this);
+}
+
+void Simulator::Exception(int index, const char *fmt, ...)
+{
+  va_list args;
+  fflush(stdout);
+  if (index >= 0 && index < (int)prog->code.size())
+    fprintf(stderr, "dsim: exception at 0x%08x (line %d, in %s): ",
+            prog->address[index], prog->line[index], prog->FunctionForIndex(index));
+  else
+    fprintf(stderr, "dsim: exception: ");
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+  fprintf(stderr, "\n");
+}
+
+  // Reports an access outside the data/heap and stack segments or one
+  // that is not aligned. Running past the stack limit gets SPIM's
+  // message so that deep recursion fails the same way under both. The
+  // stack is grown by whole pages, so the message does not depend on
+  // how far below the limit the faulting access was, and so on the
+  // layout of the frames.
+void Simulator::BadAccess(int index, unsigned addr, unsigned bytes)
+{
+  if (addr & (bytes - 1)) {
+    Exception(index, "unaligned %d byte access at 0x%08x", bytes, addr);
+  } else if (addr < stackLow && addr >= brk) {
+    fflush(stdout);
+    unsigned grow = (stackLow - addr + StackPage - 1) & ~(StackPage - 1);
+    fprintf(stderr, "Can't expand stack segment by %d bytes to %d bytes\n",
+            grow, StackLimit);
+    fprintf(stderr, "Use -lstack # with # > %d\n", StackLimit);
+  } else {
+    Exception(index, "bad address 0x%08x", addr);
+  }
+}
+
+  // Host address of a simulated range, NULL if it is not all mapped.
+unsigned char *Simulator::Host(unsigned addr, unsigned bytes)
+{
+  unsigned off = addr - DataBase;
+  if (off + bytes < off) return NULL;
+  if (off + bytes > heapBytes && (addr < stackLow || StackTop - addr < bytes))
+    return NULL;
+  return memory + off;
+}
+
+  // Reads one line (keeping the newline) into at most size-1 bytes plus
+  // a terminator, as SPIM's read_string does. Returns the length.
+int Simulator::ReadLine(char *buf, int size)
+{
+  int n = 0, ch;
+  while (n < size - 1 && (ch = getchar()) != EOF) {
+    buf[n++] = ch;
+    if (ch == '\n') break;
+  }
+  if (size > 0) buf[n] = '\0';
+  return n;
+}
+
+/* Method: Syscall
+ * ---------------
+ * Carries out the system call selected by $v0. Returns false if the
+ * program is finished, either because it exited or on an exception.
+ */
+bool Simulator::Syscall(int index)
+{
+  unsigned a0 = regs[RegA0];
+  switch (regs[RegV0]) {
+    case 1:                                     // print_int
+      printf("%d", (int)a0);
+      return true;
+    case 4: {                                   // print_string
+      unsigned char *s = Host(a0, 1);
+      if (!s) break;
+      unsigned limit = (a0 < stackLow) ? brk : StackTop;
+      void *end = memchr(s, '\0', limit - a0);
+      if (!end) break;
+      fwrite(s, 1, (unsigned char *)end - s, stdout);
+      return true;
+    }
+    case 5: {                                   // read_int
+      char buf[256];
+      fflush(stdout);
+      ReadLine(buf, sizeof(buf));
+      regs[RegV0] = (unsigned)strtol(buf, NULL, 10);
+      return true;
+    }
+    case 8: {                                   // read_string
+      int size = (int)regs[RegA1];
+      unsigned char *buf = Host(a0, size > 0 ? size : 0);
+      if (!buf) break;
+      fflush(stdout);
+      ReadLine((char *)buf, size);
+      return true;
+    }
+    case 9: {                                   // sbrk
+      unsigned bytes = (a0 + 3) & ~3;
+      if ((int)a0 < 0 || stackLow - brk < bytes) {
+        Exception(index, "sbrk of %d bytes: out of memory", (int)a0);
+        return false;
+      }
+      regs[RegV0] = brk;
+      brk += bytes;
+      heapBytes = brk - DataBase;
+      return true;
+    }
+    case 10:                                    // exit
+      exited = true;
+      return false;
+    case 11:                                    // print_char
+      putchar(a0 & 0xff);
+      return true;
+    case 12: {                                  // read_char
+      fflush(stdout);
+      int ch = getchar();
+      regs[RegV0] = (ch == EOF) ? 0 : ch;
+      return true;
+    }
+    case 14: {                                  // read(fd, buf, len)
+      int size = (int)regs[RegA2];
+      unsigned char *buf = Host(regs[RegA1], size > 0 ? size : 0);
+      if (!buf) { a0 = regs[RegA1]; break; }
+      fflush(stdout);
+      regs[RegV0] = (unsigned)read(a0, buf, size > 0 ? size : 0);
+      return true;
+    }
+    case 15: {                                  // write(fd, buf, len)
+      int size = (int)regs[RegA2];
+      unsigned char *buf = Host(regs[RegA1], size > 0 ? size : 0);
+      if (!buf) { a0 = regs[RegA1]; break; }
+      FILE *out = a0 == 1 ? stdout : a0 == 2 ? stderr : NULL;
+      if (out) regs[RegV0] = fwrite(buf, 1, size, out);
+      else {
+        fflush(stdout);
+        regs[RegV0] = (unsigned)write(a0, buf, size);
+      }
+      return true;
+    }
+    case 17:                                    // exit2
+      exited = true;
+      return false;
+    default:
+      Exception(index, "unknown system call %d", (int)regs[RegV0]);
+      return false;
+  }
+  Exception(index, "bad address 0x%08x in system call %d", a0, (int)regs[RegV0]);
+  return false;
+}
+
+bool Simulator::Run()
+{
+  if (timing) return Execute<true, false>();
+  return translator ? Execute<false, true>() : Execute<false, false>();
+}
+
+/* Method: Execute
+ * ---------------
+ * The dispatch table must list a handler for every MipsOp in enum
+ * order, followed by the end-of-text sentinel. NEXT falls through to
+ * the following Insn and JUMP transfers to an Insn index; both count
+ * the instruction and go straight to the next handler. When timed,
+ * each Insn is issued to the timing model before it runs, and taken
+ * transfers and memory accesses are reported to it as well. When
+ * translating, every jump target is offered to the Translator, and
+ * translated code runs until it exits to an Insn that is not.
+ */
+template <bool timed, bool translate> bool Simulator::Execute()
+{
+  static const void *dispatch[NumMipsOps + 1] = {
+    &&nop,
+    &&add, &&addu, &&sub, &&subu, &&and_, &&or_, &&xor_, &&nor,
+    &&slt, &&sltu, &&sllv, &&srlv, &&srav,
+    &&mul, &&div3, &&divu3, &&rem, &&remu,
+    &&seq, &&sne, &&sle, &&sgt, &&sge,
+    &&addi, &&addiu, &&andi, &&ori, &&xori, &&slti, &&sltiu,
+    &&sll, &&srl, &&sra, &&li,
+    &&mult, &&multu, &&div, &&divu, &&mfhi, &&mflo, &&mthi, &&mtlo,
+    &&lw, &&lh, &&lhu, &&lb, &&lbu, &&sw, &&sh, &&sb,
+    &&beq, &&bne, &&blt, &&ble, &&bgt, &&bge, &&bltu, &&bgeu,
+    &&blez, &&bgtz, &&bltz, &&bgez,
+    &&j, &&jal, &&jr, &&jalr, &&syscall, &&break_,
+    &&end_of_text };
+
+  const Insn *base = &code[0], *ip = base;
+  unsigned *r = regs;
+  unsigned char *mem = memory;
+  long long count = 0;
+  unsigned addr;
+  int target;
+  bool ok = false;
+
+#define DISPATCH() do { if (timed) timing->Issue(ip - base); goto *dispatch[ip->op]; } while (0)
+#define NEXT do { ip++; count++; DISPATCH(); } while (0)
+#define TRANSLATED() do { \
+    void *block; \
+    int next = ip - base; \
+    while (next >= 0 && (block = translator->Lookup(next))) next = translator->Enter(block); \
+    ip = base + (next < 0 ? ~next : next); \
+  } while (0)
+#define JUMP(index) do { \
+    ip = base + (index); count++; \
+    if (timed) timing->Taken(); \
+    if (translate) TRANSLATED(); \
+    DISPATCH(); \
+  } while (0)
+#define RS r[ip->rs]
+#define RT r[ip->rt]
+#define RD r[ip->rd]
+#define SRS ((int)r[ip->rs])
+#define SRT ((int)r[ip->rt])
+#define FAULT(...) do { Exception(ip - base, __VA_ARGS__); goto done; } while (0)
+#define ADDRESS(bytes) do { \
+    addr = RS + ip->imm; \
+    if ((addr - stackLow > StackLimit - (bytes) && addr - DataBase > heapBytes - (bytes)) || \
+        (addr & ((bytes) - 1))) { \
+      BadAccess(ip - base, addr, bytes); \
+      goto done; \
+    } \
+    if (timed) timing->Data(addr); \
+  } while (0)
+#define HOST (mem + (addr - DataBase))
+
+  executed = translated = 0;
+  exited = false;
+  DISPATCH();
+
+nop:   NEXT;
+add:   { int s; if (__builtin_add_overflow(SRS, SRT, &s)) FAULT("arithmetic overflow");
+         RD = s; NEXT; }
+addu:  RD = RS + RT; NEXT;
+sub:   { int s; if (__builtin_sub_overflow(SRS, SRT, &s)) FAULT("arithmetic overflow");
+         RD = s; NEXT; }
+subu:  RD = RS - RT; NEXT;
+and_:  RD = RS & RT; NEXT;
+or_:   RD = RS | RT; NEXT;
+xor_:  RD = RS ^ RT; NEXT;
+nor:   RD = ~(RS | RT); NEXT;
+slt:   RD = SRS < SRT; NEXT;
+sltu:  RD = RS < RT; NEXT;
+sllv:  RD = RS << (RT & 31); NEXT;
+srlv:  RD = RS >> (RT & 31); NEXT;
+srav:  RD = SRS >> (RT & 31); NEXT;
+mul:   RD = RS * RT; NEXT;
+div3:  if (RT == 0) FAULT("division by zero");
+       RD = (SRT == -1) ? -RS : (unsigned)(SRS / SRT); NEXT;
+divu3: if (RT == 0) FAULT("division by zero");
+       RD = RS / RT; NEXT;
+rem:   if (RT == 0) FAULT("division by zero");
+       RD = (SRT == -1) ? 0 : (unsigned)(SRS % SRT); NEXT;
+remu:  if (RT == 0) FAULT("division by zero");
+       RD = RS % RT; NEXT;
+seq:   RD = RS == RT; NEXT;
+sne:   RD = RS != RT; NEXT;
+sle:   RD = SRS <= SRT; NEXT;
+sgt:   RD = SRS > SRT; NEXT;
+sge:   RD = SRS >= SRT; NEXT;
+addi:  { int s; if (__builtin_add_overflow(SRS, ip->imm, &s)) FAULT("arithmetic overflow");
+         RD = s; NEXT; }
+addiu: RD = RS + ip->imm; NEXT;
+andi:  RD = RS & ip->imm; NEXT;
+ori:   RD = RS | ip->imm; NEXT;
+xori:  RD = RS ^ ip->imm; NEXT;
+slti:  RD = SRS < ip->imm; NEXT;
+sltiu: RD = RS < (unsigned)ip->imm; NEXT;
+sll:   RD = RS << ip->imm; NEXT;
+srl:   RD = RS >> ip->imm; NEXT;
+sra:   RD = SRS >> ip->imm; NEXT;
+li:    RD = ip->imm; NEXT;
+mult:  { long long p = (long long)SRS * SRT; lo = p; hi = p >> 32; NEXT; }
+multu: { unsigned long long p = (unsigned long long)RS * RT; lo = p; hi = p >> 32; NEXT; }
+div:   if (RT != 0) {            // no trap; the result is undefined on MIPS
+         lo = (SRT == -1) ? -RS : (unsigned)(SRS / SRT);
+         hi = (SRT == -1) ? 0 : (unsigned)(SRS % SRT);
+       }
+       NEXT;
+divu:  if (RT != 0) { lo = RS / RT; hi = RS % RT; }
+       NEXT;
+mfhi:  RD = hi; NEXT;
+mflo:  RD = lo; NEXT;
+mthi:  hi = RS; NEXT;
+mtlo:  lo = RS; NEXT;
+lw:    ADDRESS(4); RD = *(unsigned *)HOST; NEXT;
+lh:    ADDRESS(2); RD = *(short *)HOST; NEXT;
+lhu:   ADDRESS(2); RD = *(unsigned short *)HOST; NEXT;
+lb:    ADDRESS(1); RD = *(signed char *)HOST; NEXT;
+lbu:   ADDRESS(1); RD = *HOST; NEXT;
+sw:    ADDRESS(4); *(unsigned *)HOST = RT; NEXT;
+sh:    ADDRESS(2); *(unsigned short *)HOST = RT; NEXT;
+sb:    ADDRESS(1); *HOST = RT; NEXT;
+beq:   if (RS == RT) JUMP(ip->imm); NEXT;
+bne:   if (RS != RT) JUMP(ip->imm); NEXT;
+blt:   if (SRS < SRT) JUMP(ip->imm); NEXT;
+ble:   if (SRS <= SRT) JUMP(ip->imm); NEXT;
+bgt:   if (SRS > SRT) JUMP(ip->imm); NEXT;
+bge:   if (SRS >= SRT) JUMP(ip->imm); NEXT;
+bltu:  if (RS < RT) JUMP(ip->imm); NEXT;
+bgeu:  if (RS >= RT) JUMP(ip->imm); NEXT;
+blez:  if (SRS <= 0) JUMP(ip->imm); NEXT;
+bgtz:  if (SRS > 0) JUMP(ip->imm); NEXT;
+bltz:  if (SRS < 0) JUMP(ip->imm); NEXT;
+bgez:  if (SRS >= 0) JUMP(ip->imm); NEXT;
+j:     JUMP(ip->imm);
+jal:   r[RegRa] = nextAddress[ip - base]; JUMP(ip->imm);
+jr:    target = prog->IndexForAddress(RS);
+       if (target < 0) FAULT("jump to bad address 0x%08x", RS);
+       JUMP(target);
+jalr:  target = prog->IndexForAddress(RS);
+       if (target < 0) FAULT("jump to bad address 0x%08x", RS);
+       RD = nextAddress[ip - base];
+       JUMP(target);
+syscall:
+       if (!Syscall(ip - base)) { ok = exited; goto done; }
+       NEXT;
+break_:
+       FAULT("break instruction");
+end_of_text:
+       Exception(-1, "ran off the end of the text segment");
+done:
+  executed = count + 1 + translated;
+  fflush(stdout);
+  return ok;
+
+#undef DISPATCH
+#undef TRANSLATED
+#undef NEXT
+#undef JUMP
+#undef RS
+#undef RT
+#undef RD
+#undef SRS
+#undef SRT
+#undef FAULT
+#undef ADDRESS
+#undef HOST
+}
@@ -0,0 +1,86 @@
+/* File: mipssim.h
+ * ---------------
+ * The Simulator class runs a MipsProgram built by the Assembler. It
+ * replaces the prebuilt SPIM binary for running dcc output and
+ * supports the SPIM system calls the Decaf runtime uses: print_int
+ * (1), print_string (4), read_int (5), read_string (8), sbrk (9) and
+ * exit (10), plus print_char (11), read_char (12), read (14), write
+ * (15) and exit2 (17). read and write go to the host's file
+ * descriptors as in SPIM, except that writes to 1 and 2 share stdio's
+ * buffers with the print calls so the output stays in order.
+ *
+ * The memory map follows SPIM: text at 0x00400000, static data at
+ * 0x10000000 with $gp at 0x10008000, a heap grown by sbrk above the
+ * globals and the stack growing down from 0x7fffeffc, limited to
+ * 512K as in SPIM, so runaway recursion stops. There are no
+ * branch delay slots (SPIM's default). Like SPIM, add/addi/sub trap
+ * on signed overflow and the div/rem pseudo-ops trap on a zero divisor.
+ *
+ * Speed: the data and stack segments are one contiguous reservation,
+ * so a memory access is a single bounds check plus an add. The
+ * predecoded instructions are executed by a threaded interpreter: each
+ * handler ends by jumping straight to the handler of the next Insn
+ * through a table of label addresses (GCC's computed goto), so there
+ * is no central switch and every dispatch gets its own branch history.
+ * The loop is a template instantiated with and without the timing
+ * model and translation hooks, so the plain run pays nothing for them.
+ */
+
+#ifndef _H_mipssim
+#define _H_mipssim
+
+#include "mipsasm.h"
+#include "mipstiming.h"
+#include "mipsdbt.h"
+
+class Simulator {
+  public:
+    static const unsigned StackTop = 0x80000000;
+    static const unsigned InitialSp = 0x7fffeffc;
+    static const unsigned StackLimit = 0x80000;   // SPIM's default -lstack
+    static const unsigned StackPage = 0x1000;     // the stack grows by these
+
+    Simulator(MipsProgram *program);
+    ~Simulator();
+
+      // Runs the program from the startup stub until it exits. Returns
+      // false if it was stopped by an exception (bad address, overflow,
+      // division by zero, ...), which has been reported on stderr.
+    bool Run();
+
+      // Number of Insns executed by the last Run.
+    long long InstructionsExecuted() const { return executed; }
+
+      // Runs under the given timing model from now on (NULL for none).
+    void SetTiming(TimingModel *model) { timing = model; }
+
+      // Translates hot code to x86-64 from now on (see mipsdbt.h). Not
+      // used together with a timing model.
+    void EnableTranslation();
+    Translator *GetTranslator() const { return translator; }
+
+  protected:
+    friend class Translator;
+    MipsProgram *prog;
+    vector<Insn> code;             // program code plus an end sentinel
+    vector<unsigned> nextAddress;  // return address for a call at each Insn
+    unsigned regs[32], hi, lo;
+    unsigned char *memory;         // host address of DataBase
+    unsigned brk;                  // end of the heap (grown by sbrk)
+    unsigned heapBytes;            // brk - DataBase
+    unsigned stackLow;             // lowest address the stack may use
+    long long executed;
+    bool exited;
+    TimingModel *timing;
+    Translator *translator;
+    long long translated;          // Insns executed by translated code
+
+    template <bool timed, bool translate> bool Execute();
+    unsigned char *Host(unsigned addr, unsigned bytes);
+    void Exception(int index, const char *fmt, ...);
+    void BadAccess(int index, unsigned addr, unsigned bytes);
+    bool Syscall(int index);
+    int ReadLine(char *buf, int size);
+};
+
+#endif
@@ -0,0 +1,225 @@
+/* File: mipstiming.cc
+ * -------------------
+ * Implementation of the Cache, TimingConfig and TimingModel classes.
+ * The per-instruction hooks are inline in mipstiming.h; this file
+ * predecodes the operand usage of each Insn and prints the report.
+ */
+
+#include "mipstiming.h"
+#include <stdlib.h>
+#include <algorithm>
+
+
+static bool IsPowerOfTwo(int n)
+{
+  return n > 0 && (n & (n - 1)) == 0;
+}
+
+Cache::Cache(int sz, int as, int line)
+  : size(sz), assoc(as), lineSize(line), accesses(0), misses(0), clock(0)
+{
+  lineShift = 0;
+  while ((1 << lineShift) < lineSize) lineShift++;
+  setMask = size / (assoc * lineSize) - 1;
+  tags.assign(size / lineSize, ~0u);
+  lastUse.assign(size / lineSize, 0);
+}
+
+bool Cache::Access(unsigned addr)
+{
+  unsigned tag = addr >> lineShift;
+  int first = (tag & setMask) * assoc, victim = first;
+  accesses++;
+  clock++;
+  for (int way = first; way < first + assoc; way++) {
+    if (tags[way] == tag) {
+      lastUse[way] = clock;
+      return true;
+    }
+    if (lastUse[way] < lastUse[victim]) victim = way;
+  }
+  misses++;
+  tags[victim] = tag;
+  lastUse[victim] = clock;
+  return false;
+}
+
+
+  // An 8K 2-way I-cache and D-cache with 32 byte lines, a 10 cycle miss
+  // penalty, one bubble after a load or a taken branch, R3000-like
+  // multiply and divide latencies, and 100 cycles for a syscall.
+TimingConfig::TimingConfig()
+  : icacheSize(8192), icacheAssoc(2), icacheLine(32),
+    dcacheSize(8192), dcacheAssoc(2), dcacheLine(32),
+    missPenalty(10), branchPenalty(1), syscallPenalty(100),
+    loadLatency(2), mulLatency(12), divLatency(35) {}
+
+bool TimingConfig::ParseCache(const char *spec, int &size, int &assoc, int &line)
+{
+  char *end;
+  int s = strtol(spec, &end, 10);
+  if (*end == 'k' || *end == 'K') { s *= 1024; end++; }
+  if (*end != ':') return false;
+  int a = strtol(end + 1, &end, 10);
+  if (*end != ':') return false;
+  int l = strtol(end + 1, &end, 10);
+  if (*end != '\0' || !IsPowerOfTwo(s) || !IsPowerOfTwo(a) || !IsPowerOfTwo(l) ||
+      l < 4 || a * l > s)
+    return false;
+  size = s;
+  assoc = a;
+  line = l;
+  return true;
+}
+
+
+TimingModel::TimingModel(const TimingConfig &c, MipsProgram *program)
+  : config(c), prog(program),
+    icache(c.icacheSize, c.icacheAssoc, c.icacheLine),
+    dcache(c.dcacheSize, c.dcacheAssoc, c.dcacheLine),
+    cycle(0), interlockStalls(0), branchStalls(0), icacheStalls(0), dcacheStalls(0),
+    syscallStalls(0),
+    instructions(0), taken(0), issued(0), current(NULL), last(0)
+{
+  int n = prog->code.size();
+  const char *previous = NULL;
+
+  stages.resize(n + 1);                 // plus the simulator's end sentinel
+  runs.assign(n + 1, 0);
+  takenRuns.assign(n + 1, 0);
+  for (int i = 0; i <= n; i++) {
+    const char *name = (i < n) ? prog->FunctionForIndex(i) : "(end of text)";
+    if (name != previous) {             // functions are contiguous
+      FunctionStats fs = { name, 0, 0, 0, 0, 0, 0 };
+      functions.push_back(fs);
+      previous = name;
+    }
+    stages[i].function = functions.size() - 1;
+    if (i < n) {
+      Describe(i, prog->code[i], stages[i]);
+    } else {
+      stages[i].address = prog->textEnd;
+      stages[i].src1 = stages[i].src2 = stages[i].dst = NoReg;
+      stages[i].size = stages[i].latency = 1;
+    }
+  }
+  for (int r = 0; r <= NoReg; r++) ready[r] = 0;
+}
+
+/* Method: Describe
+ * ----------------
+ * Works out which registers an Insn reads and writes and how long its
+ * result takes. Register zero is never waited on.
+ */
+void TimingModel::Describe(int index, const Insn &insn, Stage &s)
+{
+  int op = insn.op;
+  int src1 = NoReg, src2 = NoReg, dst = NoReg, latency = 1;
+
+  if ((op >= OpAdd && op <= OpSge)) {
+    src1 = insn.rs; src2 = insn.rt; dst = insn.rd;
+    if (op == OpMul) latency = config.mulLatency;
+    else if (op >= OpDiv3 && op <= OpRemu) latency = config.divLatency;
+  } else if (op >= OpAddi && op <= OpSra) {
+    src1 = insn.rs; dst = insn.rd;
+  } else if (op == OpLi) {
+    dst = insn.rd;
+  } else if (op >= OpMult && op <= OpDivu) {
+    src1 = insn.rs; src2 = insn.rt; dst = RegHiLo;
+    latency = (op == OpMult || op == OpMultu) ? config.mulLatency : config.divLatency;
+  } else if (op == OpMfhi || op == OpMflo) {
+    src1 = RegHiLo; dst = insn.rd;
+  } else if (op == OpMthi || op == OpMtlo) {
+    src1 = insn.rs; dst = RegHiLo;
+  } else if (op >= OpLw && op <= OpLbu) {
+    src1 = insn.rs; dst = insn.rd; latency = config.loadLatency;
+  } else if (op >= OpSw && op <= OpSb) {
+    src1 = insn.rs; src2 = insn.rt;
+  } else if (op >= OpBeq && op <= OpBgeu) {
+    src1 = insn.rs; src2 = insn.rt;
+  } else if (op >= OpBlez && op <= OpBgez) {
+    src1 = insn.rs;
+  } else if (op == OpJal) {
+    dst = 31;
+  } else if (op == OpJr) {
+    src1 = insn.rs;
+  } else if (op == OpJalr) {
+    src1 = insn.rs; dst = insn.rd;
+  } else if (op == OpSyscall) {
+    src1 = 2; src2 = 4;                 // $v0 and $a0
+  }
+  s.address = prog->address[index];
+  s.src1 = (src1 == 0) ? NoReg : src1;
+  s.src2 = (src2 == 0) ? NoReg : src2;
+  s.dst = (dst == 0) ? NoReg : dst;
+  s.size = prog->size[index];
+  s.latency = latency;
+  s.stall = op == OpSyscall ? config.syscallPenalty : 0;
+}
+
+static double Percent(long long part, long long whole)
+{
+  return whole ? 100.0 * part / whole : 0.0;
+}
+
+static bool ByCycles(const pair<long long, int> &a, const pair<long long, int> &b)
+{
+  return a.first > b.first;
+}
+
+void TimingModel::Report(FILE *fp)
+{
+  long long total = cycle + 4;          // drain the last instruction
+  fprintf(fp, "*** Timing: %lld cycles, %lld instructions (%lld before pseudo-ops "
+          "expand), CPI %.3f\n", total, instructions, issued,
+          instructions ? (double)total / instructions : 0.0);
+  fprintf(fp, "    stalls: %lld interlock, %lld branch (%lld taken), "
+          "%lld I-cache, %lld D-cache, %lld syscall\n",
+          interlockStalls, branchStalls, taken, icacheStalls, dcacheStalls, syscallStalls);
+  fprintf(fp, "    I-cache %dK %d-way %dB lines: %lld accesses, %lld misses (%.2f%%)\n",
+          icache.size / 1024, icache.assoc, icache.lineSize, icache.accesses,
+          icache.misses, Percent(icache.misses, icache.accesses));
+  fprintf(fp, "    D-cache %dK %d-way %dB lines: %lld accesses, %lld misses (%.2f%%)\n",
+          dcache.size / 1024, dcache.assoc, dcache.lineSize, dcache.accesses,
+          dcache.misses, Percent(dcache.misses, dcache.accesses));
+
+  vector<pair<long long, int> > order;
+  for (size_t i = 0; i < functions.size(); i++)
+    if (functions[i].instructions) order.push_back(make_pair(functions[i].cycles, i));
+  sort(order.begin(), order.end(), ByCycles);
+
+  fprintf(fp, "\n%-28s %12s %12s %6s %7s %7s %7s\n", "function", "cycles",
+          "instrs", "CPI", "%time", "I-miss%", "D-miss%");
+  for (size_t i = 0; i < order.size(); i++) {
+    FunctionStats &f = functions[order[i].second];
+    fprintf(fp, "%-28s %12lld %12lld %6.3f %6.2f%% %6.2f%% %6.2f%%\n", f.name,
+            f.cycles, f.instructions, (double)f.cycles / f.instructions,
+            Percent(f.cycles, total), Percent(f.imisses, f.ifetches),
+            Percent(f.dmisses, f.daccesses));
+  }
+}
+
+/* Method: WriteProfile
+ * --------------------
+ * The taken counts of the conditional branches are added up by target,
+ * so that the profile only names labels, which dcc can match to its
+ * own blocks. b is a beq that always branches, and does not count.
+ */
+void TimingModel::WriteProfile(FILE *fp)
+{
+  int n = prog->code.size();
+  vector<long long> takenTo(n + 1, 0);
+  for (int i = 0; i < n; i++) {
+    const Insn &insn = prog->code[i];
+    bool always = insn.op == OpBeq && insn.rs == insn.rt;
+    if (((insn.op >= OpBeq && insn.op <= OpBgeu) || (insn.op >= OpBlez && insn.op <= OpBgez)) &&
+        !always)
+      takenTo[insn.imm] += takenRuns[i];
+  }
+  fprintf(fp, "# dsim edge profile: label, times reached, times branched to\n");
+  for (map<string, unsigned>::iterator s = prog->symbols.begin(); s != prog->symbols.end(); s++) {
+    int index = prog->IndexForAddress(s->second);
+    if (index >= 0)
+      fprintf(fp, "%s %lld %lld\n", s->first.c_str(), runs[index], takenTo[index]);
+  }
+}
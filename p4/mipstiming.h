@@ -0,0 +1,180 @@
+/* File: mipstiming.h
+ * ------------------
+ * The TimingModel class estimates how long a program run by the
+ * Simulator would take on a simple in-order MIPS: a classic 5-stage
+ * pipeline with full forwarding, an L1 instruction cache and an L1
+ * data cache. It is enabled with dsim -timing and costs nothing when
+ * it is off (see Simulator::Execute).
+ *
+ * Pipeline: every machine instruction issues in one cycle, so an Insn
+ * standing for a pseudo-op of n instructions takes n. An instruction
+ * stalls until its source registers are ready; with forwarding that
+ * only happens after loads (the load-use bubble) and after mul/div,
+ * which have longer latencies. Taken branches and jumps are resolved
+ * in ID and cost a fixed penalty (predict not-taken). A syscall
+ * costs a fixed penalty as well, for the trap into the system and
+ * back, so that the cost of making many of them shows.
+ *
+ * Caches: both are set-associative with LRU replacement. Every
+ * instruction word fetched goes through the I-cache and every load
+ * and store through the D-cache (write-allocate); each miss stalls the
+ * pipeline for a fixed miss penalty.
+ *
+ * Everything is attributed to the function containing the instruction,
+ * and Report prints cycles, CPI and miss rates per function. Counts
+ * are of machine instructions, so they exceed the count dsim -stats
+ * gives, which is of Insns, by what the pseudo-ops expand to; Report
+ * prints both.
+ *
+ * The model also counts how often each instruction runs and how often
+ * each conditional branch is taken, which WriteProfile turns into the
+ * edge profile dcc -profile reads (dsim -profile).
+ */
+
+#ifndef _H_mipstiming
+#define _H_mipstiming
+
+#include "mipsasm.h"
+
+class Cache {
+  public:
+      // Sizes are in bytes; all three must be powers of two.
+    Cache(int size, int assoc, int lineSize);
+
+      // Looks up the line holding addr, filling it on a miss. Returns
+      // true on a hit.
+    bool Access(unsigned addr);
+
+    int size, assoc, lineSize;
+    long long accesses, misses;
+
+  private:
+    int lineShift, setMask;
+    long long clock;
+    vector<unsigned> tags;        // assoc ways per set, ~0 if empty
+    vector<long long> lastUse;    // for LRU
+};
+
+struct TimingConfig {
+    int icacheSize, icacheAssoc, icacheLine;
+    int dcacheSize, dcacheAssoc, dcacheLine;
+    int missPenalty;              // cycles per cache miss
+    int branchPenalty;            // cycles per taken branch or jump
+    int syscallPenalty;           // cycles per syscall
+    int loadLatency, mulLatency, divLatency;
+
+    TimingConfig();
+
+      // Parses a cache description "size:assoc:line" (size may end in
+      // k). Returns false if it is malformed.
+    static bool ParseCache(const char *spec, int &size, int &assoc, int &line);
+};
+
+class TimingModel {
+  public:
+    TimingModel(const TimingConfig &config, MipsProgram *program);
+
+      // Called before the Insn at index executes: fetches it and waits
+      // for its operands.
+    inline void Issue(int index);
+
+      // Called for every load and store the current Insn makes.
+    inline void Data(unsigned addr);
+
+      // Called when the current Insn transfers control.
+    inline void Taken();
+
+      // Writes the summary and per-function table to fp.
+    void Report(FILE *fp);
+
+      // Writes a line "label reached taken" for each text label: how
+      // many times the instruction at the label ran, and how many times
+      // a conditional branch to it was taken.
+    void WriteProfile(FILE *fp);
+
+  private:
+    enum { RegHiLo = 32, NoReg = 33 };     // HI and LO are tracked together
+
+      // What the pipeline needs to know about each Insn, precomputed.
+    struct Stage {
+        unsigned address;
+        unsigned char src1, src2, dst, size;
+        int latency;
+        int stall;                // cycles on top of size (a syscall's trap)
+        int function;
+    };
+
+    struct FunctionStats {
+        const char *name;
+        long long instructions, cycles, ifetches, imisses, daccesses, dmisses;
+    };
+
+    TimingConfig config;
+    MipsProgram *prog;
+    Cache icache, dcache;
+    vector<Stage> stages;
+    vector<FunctionStats> functions;
+    long long cycle, ready[NoReg + 1];
+    long long interlockStalls, branchStalls, icacheStalls, dcacheStalls, syscallStalls;
+    long long instructions, taken;
+    long long issued;               // Insns, as dsim -stats counts them
+    FunctionStats *current;
+    int last;                       // index of the Insn issued last
+    vector<long long> runs, takenRuns;   // per Insn
+
+    void Describe(int index, const Insn &insn, Stage &s);
+};
+
+
+inline void TimingModel::Issue(int index)
+{
+  const Stage &s = stages[index];
+  long long before = cycle, start = cycle;
+  current = &functions[s.function];
+  last = index;
+  runs[index]++;
+  issued++;
+
+  for (int i = 0; i < s.size; i++) {
+    current->ifetches++;
+    if (!icache.Access(s.address + 4 * i)) {
+      current->imisses++;
+      icacheStalls += config.missPenalty;
+      start += config.missPenalty;
+    }
+  }
+  long long operands = ready[s.src1] > ready[s.src2] ? ready[s.src1] : ready[s.src2];
+  if (operands > start) {
+    interlockStalls += operands - start;
+    start = operands;
+  }
+  cycle = start + s.size + s.stall;
+  syscallStalls += s.stall;
+  ready[s.dst] = cycle - 1 + s.latency;
+  ready[NoReg] = 0;
+  instructions += s.size;
+  current->instructions += s.size;
+  current->cycles += cycle - before;
+}
+
+inline void TimingModel::Data(unsigned addr)
+{
+  current->daccesses++;
+  if (!dcache.Access(addr)) {
+    current->dmisses++;
+    dcacheStalls += config.missPenalty;
+    cycle += config.missPenalty;
+    current->cycles += config.missPenalty;
+  }
+}
+
+inline void TimingModel::Taken()
+{
+  taken++;
+  takenRuns[last]++;
+  branchStalls += config.branchPenalty;
+  cycle += config.branchPenalty;
+  current->cycles += config.branchPenalty;
+}
+
+#endif
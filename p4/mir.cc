@@ -0,0 +1,206 @@
+/* File: mir.cc
+ * ------------
+ * The machine IR containers, the pass pipeline and the peephole pass.
+ */
+
+#include "mir.h"
+#include "regalloc.h"
+#include "listsched.h"
+#include "blocklayout.h"
+#include "utility.h"
+#include <string.h>
+
+
+const char *MInstr::BranchTarget() const
+{
+  for (size_t i = 0; i < ops.size(); i++)
+    if (ops[i].kind == MOpLabel) return ops[i].label;
+  return NULL;
+}
+
+
+MFunction::MFunction(const char *name) : name(name), numVRegs(0), frameSize(0) {}
+
+MFunction::~MFunction()
+{
+  for (size_t b = 0; b < blocks.size(); b++) {
+    for (size_t i = 0; i < blocks[b]->code.size(); i++)
+      delete blocks[b]->code[i];
+    delete blocks[b];
+  }
+}
+
+int MFunction::NewFrameObject()
+{
+  FrameObject o = { 0, false };
+  frame.push_back(o);
+  return frame.size() - 1;
+}
+
+int MFunction::NewFixedObject(int offset)
+{
+  FrameObject o = { offset, true };
+  frame.push_back(o);
+  return frame.size() - 1;
+}
+
+MBlock *MFunction::NewBlock(const char *label)
+{
+  blocks.push_back(new MBlock(label));
+  return blocks.back();
+}
+
+/* Method: ComputeSuccessors
+ * -------------------------
+ * A block ends at its first terminator (the selector starts a new
+ * block after each one). A return has no successors, a jump only its
+ * target, anything else also falls through to the next block.
+ */
+void MFunction::ComputeSuccessors()
+{
+  map<const char *, int, bool (*)(const char *, const char *)> index(
+    [](const char *a, const char *b) { return strcmp(a, b) < 0; });
+  for (size_t b = 0; b < blocks.size(); b++)
+    if (blocks[b]->label) index[blocks[b]->label] = b;
+
+  for (size_t b = 0; b < blocks.size(); b++) {
+    MBlock *block = blocks[b];
+    block->succs.clear();
+    MInstr *last = block->code.empty() ? NULL : block->code.back();
+    if (last && last->Is(MIsReturn)) continue;
+    if (last && last->Is(MIsBranch | MIsJump)) {
+      const char *target = last->BranchTarget();
+      Assert(index.count(target));
+      block->succs.push_back(index[target]);
+      if (last->Is(MIsJump)) continue;
+    }
+    if (b + 1 < blocks.size()) block->succs.push_back(b + 1);
+  }
+}
+
+void MFunction::Print(FILE *out, MTarget *target)
+{
+  fprintf(out, "# machine code for %s (%d virtual registers)\n", name, numVRegs);
+  for (size_t b = 0; b < blocks.size(); b++) {
+    fprintf(out, "#  B%d %s:", (int)b, blocks[b]->label ? blocks[b]->label : "");
+    for (size_t s = 0; s < blocks[b]->succs.size(); s++)
+      fprintf(out, " -> B%d", blocks[b]->succs[s]);
+    fprintf(out, "\n");
+    for (size_t i = 0; i < blocks[b]->code.size(); i++) {
+      fprintf(out, "#\t");
+      target->PrintInstr(out, this, blocks[b]->code[i]);
+    }
+  }
+}
+
+
+/* Function: ComputeLiveness
+ * -------------------------
+ * The usual backward dataflow over the blocks (whose successors must
+ * be computed): a register is live into a block if the block reads it
+ * before writing it, or if it is live out of the block and the block
+ * does not write it.
+ */
+void ComputeLiveness(MFunction *fn, vector<RegSet> &liveIn, vector<RegSet> &liveOut)
+{
+  int n = fn->numVRegs, numBlocks = fn->blocks.size();
+  vector<RegSet> use(numBlocks, RegSet(n)), def(numBlocks, RegSet(n));
+  liveIn.assign(numBlocks, RegSet(n));
+  liveOut.assign(numBlocks, RegSet(n));
+
+  for (int b = 0; b < numBlocks; b++) {
+    vector<MInstr *> &code = fn->blocks[b]->code;
+    for (size_t i = 0; i < code.size(); i++) {
+      MInstr *in = code[i];
+      for (size_t o = in->numDefs; o < in->ops.size(); o++)
+        if (in->ops[o].IsVirtual() && !def[b].Has(in->ops[o].value - FirstVirtualReg))
+          use[b].Add(in->ops[o].value - FirstVirtualReg);
+      for (int o = 0; o < in->numDefs; o++)
+        if (in->ops[o].IsVirtual()) def[b].Add(in->ops[o].value - FirstVirtualReg);
+    }
+  }
+
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (int b = numBlocks - 1; b >= 0; b--) {
+      for (size_t s = 0; s < fn->blocks[b]->succs.size(); s++)
+        liveOut[b].Union(liveIn[fn->blocks[b]->succs[s]]);
+      RegSet in = liveOut[b];            // use + (out - def)
+      for (size_t w = 0; w < in.bits.size(); w++)
+        in.bits[w] = use[b].bits[w] | (in.bits[w] & ~def[b].bits[w]);
+      changed |= liveIn[b].Union(in);
+    }
+  }
+}
+
+  // True if two memory instructions access the same frame slot.
+static bool SameSlot(MInstr *a, MInstr *b)
+{
+  return a->ops.size() == 3 && b->ops.size() == 3 &&
+         a->ops[1].kind == MOpFrame && a->ops[1] == b->ops[1] && a->ops[2] == b->ops[2];
+}
+
+/* Function: Peephole
+ * ------------------
+ * Runs after register allocation and removes
+ *   - copies of a register to itself (mostly coalesced temps),
+ *   - a store to a frame slot right after a load of the same register
+ *     from it, and a load right after a store of the same register,
+ *   - branches and jumps to the block that follows anyway,
+ *   - blocks without a label that follow a jump or a return, which
+ *     nothing can reach.
+ */
+void Peephole(MFunction *fn)
+{
+  for (size_t b = 0; b < fn->blocks.size(); b++) {
+    vector<MInstr *> &code = fn->blocks[b]->code;
+    vector<MInstr *> kept;
+    if (b > 0 && !fn->blocks[b]->label && !fn->blocks[b - 1]->code.empty() &&
+        fn->blocks[b - 1]->code.back()->Is(MIsJump | MIsReturn)) {
+      for (size_t i = 0; i < code.size(); i++) delete code[i];
+      code.clear();
+      continue;
+    }
+    for (size_t i = 0; i < code.size(); i++) {
+      MInstr *in = code[i], *prev = kept.empty() ? NULL : kept.back();
+      bool redundant = false;
+      if (in->Is(MIsCopy) && in->ops[0] == in->ops[1])
+        redundant = true;
+      else if (prev && in->Is(MMayStore) && prev->Is(MMayLoad) && SameSlot(in, prev) &&
+               in->ops[0] == prev->ops[0])
+        redundant = true;
+      else if (prev && in->Is(MMayLoad) && prev->Is(MMayStore) && SameSlot(in, prev) &&
+               in->ops[0] == prev->ops[0])
+        redundant = true;
+      else if (in->Is(MIsBranch | MIsJump) && i + 1 == code.size() && b + 1 < fn->blocks.size()) {
+        const char *next = fn->blocks[b + 1]->label;
+        redundant = next && !strcmp(next, in->BranchTarget());
+      }
+      if (redundant) delete in;
+      else kept.push_back(in);
+    }
+    code = kept;
+  }
+}
+
+
+/* Function: RunMachinePasses
+ * --------------------------
+ * The pipeline every target's code goes through. With -d mir, the code
+ * is dumped (as assembly comments) before and after allocation; with
+ * -d nosched, it is left in the order it was selected.
+ */
+void RunMachinePasses(MFunction *fn, MTarget *target)
+{
+  fn->ComputeSuccessors();
+  if (EdgeProfile::Get()) LayoutBlocks(fn, target, EdgeProfile::Get());
+  if (IsDebugOn("mir")) fn->Print(stdout, target);
+  ListScheduler scheduler(fn, target);
+  if (!IsDebugOn("nosched")) scheduler.Run(true);
+  LinearScan allocator(fn, target);
+  allocator.Run();
+  target->LayoutFrame(fn);
+  Peephole(fn);
+  if (!IsDebugOn("nosched")) scheduler.Run(false);
+  if (IsDebugOn("mir")) fn->Print(stdout, target);
+}
@@ -0,0 +1,195 @@
+/* File: mir.h
+ * -----------
+ * The machine IR sits between Tac and assembly. A target's instruction
+ * selector (a Backend, see mipsmir.h) turns the Tac of one function into
+ * an MFunction: target instructions in basic blocks, operating on an
+ * unbounded supply of virtual registers. The target-independent passes
+ * then run on that, the same for every target:
+ *
+ *   - with a profile (dcc -profile), block layout (blocklayout.h)
+ *     puts the hot path in a straight line and the cold blocks last;
+ *   - list scheduling (listsched.h) reorders each block to hide the
+ *     latency of loads, multiplies and divides;
+ *   - register allocation (regalloc.h) maps virtual registers to the
+ *     target's allocatable registers, spilling to frame objects, with
+ *     values live across a call in registers the call keeps;
+ *   - the peephole pass removes copies to self, reloads of a value just
+ *     stored and jumps to the next block;
+ *   - the blocks are scheduled again, spill code included.
+ *
+ * after which the target prints the function (with its prologue and
+ * epilogue, now that the frame size is known).
+ *
+ * An instruction is an opcode (numbered by the target), a list of
+ * operands whose first numDefs are the registers it writes, and flags
+ * that tell the passes what they need to know about it without
+ * knowing the opcode: whether it is a copy, a memory access, a call,
+ * a branch or a return. Memory operands are always laid out as
+ * (data register, base, offset) where the base is a register or a
+ * frame object, which is resolved to an offset from the frame pointer
+ * only when the frame is laid out.
+ *
+ * Registers below FirstVirtualReg are the target's physical registers;
+ * these appear where the calling convention fixes them (the stack and
+ * frame pointer, the return value register).
+ */
+
+#ifndef _H_mir
+#define _H_mir
+
+#include <stdio.h>
+#include <map>
+#include <vector>
+using std::map;
+using std::vector;
+
+static const int FirstVirtualReg = 64;
+
+typedef enum { MOpReg, MOpImm, MOpLabel, MOpFrame } MOperandKind;
+
+struct MOperand {
+    MOperandKind kind;
+    int value;                 // register, immediate or frame object
+    const char *label;
+
+    static MOperand Reg(int r)    { MOperand o = { MOpReg, r, NULL }; return o; }
+    static MOperand Imm(int v)    { MOperand o = { MOpImm, v, NULL }; return o; }
+    static MOperand Label(const char *l) { MOperand o = { MOpLabel, 0, l }; return o; }
+    static MOperand Frame(int fi) { MOperand o = { MOpFrame, fi, NULL }; return o; }
+
+    bool IsReg() const     { return kind == MOpReg; }
+    bool IsVirtual() const { return kind == MOpReg && value >= FirstVirtualReg; }
+    bool operator==(const MOperand &o) const
+      { return kind == o.kind && value == o.value && label == o.label; }
+};
+
+typedef enum {
+    MIsCopy = 1,          // ops[0] = ops[1]
+    MMayLoad = 2,         // (data, base, offset) memory operand
+    MMayStore = 4,
+    MIsCall = 8,          // clobbers the registers in MTarget::CallClobbers...
+    MIsBranch = 16,       // conditional; the label operand is the target
+    MIsJump = 32,         // unconditional
+    MIsReturn = 64,
+    MKeepsRegs = 128      // ...unless it is a runtime routine that keeps them
+} MInstrFlag;
+
+struct MInstr {
+    int opcode, flags, numDefs;
+    vector<MOperand> ops;
+
+    MInstr(int opcode, int flags, int numDefs) : opcode(opcode), flags(flags), numDefs(numDefs) {}
+    MInstr *Add(const MOperand &o) { ops.push_back(o); return this; }
+
+    bool Is(int flag) const { return (flags & flag) != 0; }
+    bool IsTerminator() const { return Is(MIsBranch | MIsJump | MIsReturn); }
+    const char *BranchTarget() const;
+};
+
+struct MBlock {
+    const char *label;        // NULL for a block only reached by falling through
+    vector<MInstr *> code;
+    vector<int> succs;
+
+    MBlock(const char *label) : label(label) {}
+};
+
+  // A stack slot: an incoming parameter (fixed, at a known offset from
+  // the frame pointer) or a slot the function allocates for itself.
+struct FrameObject {
+    int offset;
+    bool fixed;
+};
+
+class MFunction {
+  public:
+    const char *name;
+    vector<MBlock *> blocks;
+    vector<FrameObject> frame;
+    int numVRegs;
+    int frameSize;             // bytes of saved registers and non-fixed objects
+    vector<int> saved;         // callee-saved registers it uses, saved at entry
+    map<int, int> home;        // vreg -> fixed object it is loaded from at entry
+
+    MFunction(const char *name);
+    ~MFunction();
+
+    int NewVReg() { return FirstVirtualReg + numVRegs++; }
+    int NewFrameObject();
+    int NewFixedObject(int offset);
+    MBlock *NewBlock(const char *label);
+
+    void ComputeSuccessors();
+    void Print(FILE *out, class MTarget *target);
+};
+
+  // A set of physical registers, one bit each.
+typedef unsigned long long RegMask;
+
+  // A set of virtual registers, one bit each (vreg - FirstVirtualReg).
+class RegSet {
+  public:
+    vector<unsigned> bits;
+
+    RegSet(int n = 0) : bits((n + 31) / 32, 0) {}
+    bool Has(int i) const { return bits[i / 32] & (1u << (i % 32)); }
+    void Add(int i)       { bits[i / 32] |= 1u << (i % 32); }
+    bool Union(const RegSet &o) {      // true if this set grew
+      bool grew = false;
+      for (size_t w = 0; w < bits.size(); w++) {
+        unsigned merged = bits[w] | o.bits[w];
+        grew |= merged != bits[w];
+        bits[w] = merged;
+      }
+      return grew;
+    }
+};
+
+/* Class: MTarget
+ * --------------
+ * What the passes need from a target: its registers, how to spill and
+ * reload, how long its instructions take, how to jump and branch, how
+ * to lay out the frame, and how to print the result.
+ */
+class MTarget {
+  public:
+    virtual ~MTarget() {}
+
+    virtual const vector<int> &AllocatableRegs() = 0;
+    virtual const vector<int> &ScratchRegs() = 0;   // for spill code, never allocated
+    virtual const vector<int> &CalleeSavedRegs() = 0;  // allocatable, kept by calls
+      // The allocatable registers call may change: those that are not
+      // callee-saved, or fewer when the target knows the callee.
+    virtual RegMask CallClobbers(MInstr *call) = 0;
+    virtual const char *RegName(int reg) = 0;
+
+    virtual MInstr *CreateCopy(int dst, int src) = 0;
+    virtual MInstr *CreateLoad(int reg, int frameObject) = 0;
+    virtual MInstr *CreateStore(int reg, int frameObject) = 0;
+
+      // Cycles from issuing instr until an instruction reading its
+      // result can issue without stalling (1 if it never stalls).
+    virtual int Latency(MInstr *instr) = 0;
+
+      // A jump to label, and turning a branch around so that it goes
+      // to label when it used to fall through (false if it cannot be).
+    virtual MInstr *CreateJump(const char *label) = 0;
+    virtual bool ReverseBranch(MInstr *branch, const char *label) = 0;
+
+      // Assigns offsets to the non-fixed frame objects, and room to
+      // save the callee-saved registers the function uses.
+    virtual void LayoutFrame(MFunction *fn) = 0;
+    virtual void PrintInstr(FILE *out, MFunction *fn, MInstr *instr) = 0;
+    virtual void EmitFunction(MFunction *fn) = 0;
+};
+
+  // Runs the target-independent passes on fn.
+void RunMachinePasses(MFunction *fn, MTarget *target);
+
+  // The virtual registers live into and out of each block.
+void ComputeLiveness(MFunction *fn, vector<RegSet> &liveIn, vector<RegSet> &liveOut);
+
+  // The peephole pass (after register allocation).
+void Peephole(MFunction *fn);
+
+#endif
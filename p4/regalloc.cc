@@ -0,0 +1,310 @@
+/* File: regalloc.cc
+ * -----------------
+ * Linear scan register allocation on the machine IR.
+ */
+
+#include "regalloc.h"
+#include "utility.h"
+#include <algorithm>
+#include <limits.h>
+
+
+LinearScan::LinearScan(MFunction *f, MTarget *t) : fn(f), target(t) {}
+
+static RegMask Mask(const vector<int> &regs)
+{
+  RegMask mask = 0;
+  for (size_t r = 0; r < regs.size(); r++) mask |= (RegMask)1 << regs[r];
+  return mask;
+}
+
+static bool Reads(MInstr *in, int reg)
+{
+  for (size_t o = in->numDefs; o < in->ops.size(); o++)
+    if (in->ops[o] == MOperand::Reg(reg)) return true;
+  return false;
+}
+
+static bool Writes(MInstr *in, int reg)
+{
+  for (int o = 0; o < in->numDefs; o++)
+    if (in->ops[o] == MOperand::Reg(reg)) return true;
+  return false;
+}
+
+void LinearScan::Run()
+{
+  ComputeIntervals();
+  Allocate();
+  Rewrite();
+}
+
+
+/* Method: ComputeIntervals
+ * ------------------------
+ * Instruction k of the function (counting across blocks in layout
+ * order) reads its operands at position 2k and writes its results at
+ * 2k+1. A register live into or out of a block (see ComputeLiveness)
+ * has its interval stretched to the block's first or last position.
+ * A copy to or from another register gives a hint: the source's
+ * register for the destination, an allocatable register it is copied
+ * to (an argument) for the source.
+ */
+void LinearScan::ComputeIntervals()
+{
+  int n = fn->numVRegs, numBlocks = fn->blocks.size();
+  vector<RegSet> liveIn, liveOut;
+  ComputeLiveness(fn, liveIn, liveOut);
+  RegMask allocatable = Mask(target->AllocatableRegs());
+  hint.assign(n, -1);
+  regHint.assign(n, -1);
+  for (int b = 0; b < numBlocks; b++)
+    for (size_t i = 0; i < fn->blocks[b]->code.size(); i++) {
+      MInstr *in = fn->blocks[b]->code[i];
+      if (!in->Is(MIsCopy) || !in->ops[1].IsVirtual()) continue;
+      int src = in->ops[1].value - FirstVirtualReg, dst = in->ops[0].value;
+      if (in->ops[0].IsVirtual()) hint[dst - FirstVirtualReg] = src;
+      else if (allocatable >> dst & 1) regHint[src] = dst;
+    }
+
+  intervals.resize(n);
+  for (int v = 0; v < n; v++) {
+    intervals[v].vreg = v;
+    intervals[v].start = INT_MAX;
+    intervals[v].end = -1;
+  }
+  calls.clear();
+  clobbers.clear();
+  busy.clear();
+  int k = 0;
+  for (int b = 0; b < numBlocks; b++) {
+    vector<MInstr *> &code = fn->blocks[b]->code;
+    int first = 2 * k, last = 2 * (k + (int)code.size()) - 1;
+    ComputeBusy(code, k);
+    for (int v = 0; v < n; v++) {
+      if (liveIn[b].Has(v)) intervals[v].start = std::min(intervals[v].start, first);
+      if (liveOut[b].Has(v)) intervals[v].end = std::max(intervals[v].end, last);
+    }
+    for (size_t i = 0; i < code.size(); i++, k++) {
+      MInstr *in = code[i];
+      RegMask clobbered = in->Is(MIsCall) ? target->CallClobbers(in) : 0;
+      if (clobbered) {
+        calls.push_back(k);
+        clobbers.push_back(clobbered);
+      }
+      for (size_t o = 0; o < in->ops.size(); o++) {
+        if (!in->ops[o].IsVirtual()) continue;
+        Interval &iv = intervals[in->ops[o].value - FirstVirtualReg];
+        int pos = (int)o < in->numDefs ? 2 * k + 1 : 2 * k;
+        iv.start = std::min(iv.start, pos);
+        iv.end = std::max(iv.end, pos);
+      }
+    }
+  }
+}
+
+  // True if the interval is live across the call at linear index
+  // call, i.e. is both written before it and read after it.
+bool LinearScan::LiveAcross(const Interval &i, int call)
+{
+  return i.start / 2 < call && 2 * call + 1 < i.end;
+}
+
+  // The registers clobbered by the calls the interval is live across.
+RegMask LinearScan::ClobberedAcross(const Interval &i)
+{
+  RegMask clobbered = 0;
+  vector<int>::iterator c = std::upper_bound(calls.begin(), calls.end(), i.start / 2);
+  for (; c != calls.end() && LiveAcross(i, *c); c++)
+    clobbered |= clobbers[c - calls.begin()];
+  return clobbered;
+}
+
+  // The allocatable registers a block sets itself are busy from their
+  // definition to their last read before the next call, or to the
+  // call (which reads its arguments). first is the linear index of the
+  // block's first instruction.
+void LinearScan::ComputeBusy(vector<MInstr *> &code, int first)
+{
+  RegMask allocatable = Mask(target->AllocatableRegs());
+  for (size_t i = 0; i < code.size(); i++)
+    for (int o = 0; o < code[i]->numDefs; o++) {
+      int r = code[i]->ops[o].value;
+      if (!code[i]->ops[o].IsReg() || r >= FirstVirtualReg || !(allocatable >> r & 1)) continue;
+      Interval range = { r, 2 * (first + (int)i) + 1, 2 * (first + (int)i) + 1 };
+      for (size_t j = i + 1; j < code.size(); j++) {
+        if (Reads(code[j], r) || code[j]->Is(MIsCall)) range.end = 2 * (first + (int)j);
+        if (code[j]->Is(MIsCall) || Writes(code[j], r)) break;
+      }
+      busy.push_back(range);
+    }
+}
+
+  // False if reg is busy somewhere in the interval.
+bool LinearScan::Usable(int reg, const Interval &i)
+{
+  for (size_t b = 0; b < busy.size(); b++)
+    if (busy[b].vreg == reg && busy[b].start <= i.end && i.start <= busy[b].end)
+      return false;
+  return true;
+}
+
+  // A frame object for vreg: a parameter's own slot, else a new one.
+int LinearScan::Slot(int v)
+{
+  map<int, int>::iterator h = fn->home.find(v + FirstVirtualReg);
+  return h != fn->home.end() ? h->second : fn->NewFrameObject();
+}
+
+void LinearScan::Spill(int v)
+{
+  assigned[v] = -1;
+  saveSlot[v] = -1;
+  spillSlot[v] = Slot(v);
+}
+
+/* Method: Allocate
+ * ----------------
+ * The scan proper. active holds the intervals currently in registers,
+ * as (end, vreg) pairs; a register goes back to the free list once its
+ * interval has ended. A copy's destination gets the source's register
+ * when it is free, and a value copied to an argument register that
+ * register, so the copy disappears in the peephole pass (unless the
+ * calls the interval spans clobber the register). Then the
+ * callee-saved registers used are noted for the prologue.
+ */
+void LinearScan::Allocate()
+{
+  int n = fn->numVRegs;
+  assigned.assign(n, -1);
+  spillSlot.assign(n, -1);
+  saveSlot.assign(n, -1);
+  vector<std::pair<int, int> > order;
+  for (int v = 0; v < n; v++)
+    if (intervals[v].end >= 0) order.push_back(std::make_pair(intervals[v].start, v));
+  std::sort(order.begin(), order.end());
+
+  const vector<int> &regs = target->AllocatableRegs();
+  const vector<int> &kept = target->CalleeSavedRegs();
+  vector<bool> isFree(FirstVirtualReg, false);
+  for (size_t r = 0; r < regs.size(); r++) isFree[regs[r]] = true;
+  vector<std::pair<int, int> > active;
+
+  for (size_t i = 0; i < order.size(); i++) {
+    Interval &cur = intervals[order[i].second];
+    int v = cur.vreg;
+    for (size_t a = 0; a < active.size(); )
+      if (active[a].first < cur.start) {
+        isFree[assigned[active[a].second]] = true;
+        active.erase(active.begin() + a);
+      } else a++;
+
+    RegMask clobbered = ClobberedAcross(cur);
+    int hinted[] = { hint[v] >= 0 ? assigned[hint[v]] : -1, regHint[v] }, reg = -1;
+    for (int h = 0; reg < 0 && h < 2; h++)
+      if (hinted[h] >= 0 && isFree[hinted[h]] && !(clobbered >> hinted[h] & 1) &&
+          Usable(hinted[h], cur))
+        reg = hinted[h];
+    for (size_t r = 0; reg < 0 && r < regs.size(); r++)
+      if (isFree[regs[r]] && !(clobbered >> regs[r] & 1) && Usable(regs[r], cur))
+        reg = regs[r];
+    for (size_t r = 0; reg < 0 && r < regs.size(); r++)
+      if (isFree[regs[r]] && Usable(regs[r], cur)) reg = regs[r];
+
+    if (reg < 0) {
+      int victim = -1;
+      for (size_t a = 0; a < active.size(); a++)
+        if (Usable(assigned[active[a].second], cur) &&
+            (victim < 0 || active[a].first > active[victim].first))
+          victim = a;
+      if (victim < 0 || active[victim].first <= cur.end) {
+        Spill(v);
+        continue;
+      }
+      reg = assigned[active[victim].second];
+      Spill(active[victim].second);
+      active.erase(active.begin() + victim);
+    }
+    assigned[v] = reg;
+    if (clobbered >> reg & 1) saveSlot[v] = Slot(v);
+    isFree[reg] = false;
+    active.push_back(std::make_pair(cur.end, v));
+  }
+
+  fn->saved.clear();
+  for (size_t r = 0; r < kept.size(); r++)
+    if (std::find(assigned.begin(), assigned.end(), kept[r]) != assigned.end())
+      fn->saved.push_back(kept[r]);
+}
+
+
+/* Method: Rewrite
+ * ---------------
+ * Replaces the virtual registers by the ones allocated, adding spill
+ * code around the instructions that touch a spilled register, and
+ * around each call the stores and reloads of the registers live
+ * across it that it clobbers. The entry load of a parameter spilled to
+ * its own slot is dropped.
+ */
+void LinearScan::Rewrite()
+{
+  const vector<int> &scratch = target->ScratchRegs();
+  vector<int> aroundCalls;
+  for (size_t v = 0; v < saveSlot.size(); v++)
+    if (saveSlot[v] >= 0) aroundCalls.push_back(v);
+  int k = 0;
+  for (size_t b = 0; b < fn->blocks.size(); b++) {
+    vector<MInstr *> &code = fn->blocks[b]->code, out;
+    for (size_t i = 0; i < code.size(); i++, k++) {
+      MInstr *in = code[i];
+      vector<int> restore;
+      RegMask clobbered = in->Is(MIsCall) ? target->CallClobbers(in) : 0;
+      for (size_t s = 0; clobbered && s < aroundCalls.size(); s++) {
+        int v = aroundCalls[s];
+        if (clobbered >> assigned[v] & 1 && LiveAcross(intervals[v], k)) {
+          out.push_back(target->CreateStore(assigned[v], saveSlot[v]));
+          restore.push_back(v);
+        }
+      }
+
+      if (in->numDefs == 1 && in->ops[0].IsVirtual() && in->Is(MMayLoad)) {
+        int v = in->ops[0].value - FirstVirtualReg;
+        if (spillSlot[v] >= 0 && in->ops[1] == MOperand::Frame(spillSlot[v])) {
+          delete in;
+          continue;
+        }
+      }
+
+      vector<int> loaded;                // vregs reloaded, by scratch index
+      for (size_t o = in->numDefs; o < in->ops.size(); o++) {
+        if (!in->ops[o].IsVirtual()) continue;
+        int v = in->ops[o].value - FirstVirtualReg;
+        if (spillSlot[v] < 0) {
+          in->ops[o].value = assigned[v];
+          continue;
+        }
+        size_t s = std::find(loaded.begin(), loaded.end(), v) - loaded.begin();
+        if (s == loaded.size()) {
+          Assert(s < scratch.size());
+          out.push_back(target->CreateLoad(scratch[s], spillSlot[v]));
+          loaded.push_back(v);
+        }
+        in->ops[o].value = scratch[s];
+      }
+      out.push_back(in);
+      for (int o = 0; o < in->numDefs; o++) {
+        if (!in->ops[o].IsVirtual()) continue;
+        int v = in->ops[o].value - FirstVirtualReg;
+        if (spillSlot[v] < 0) {
+          in->ops[o].value = assigned[v];
+          continue;
+        }
+        in->ops[o].value = scratch[o];
+        out.push_back(target->CreateStore(scratch[o], spillSlot[v]));
+      }
+      for (size_t s = 0; s < restore.size(); s++)
+        out.push_back(target->CreateLoad(assigned[restore[s]], saveSlot[restore[s]]));
+    }
+    code = out;
+  }
+}
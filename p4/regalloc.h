@@ -0,0 +1,73 @@
+/* File: regalloc.h
+ * ----------------
+ * The register allocator of the machine IR (see mir.h): linear scan
+ * over live intervals, the same for every target.
+ *
+ * Liveness of the virtual registers is computed per block, then each
+ * register gets one interval over the linear order of the instructions
+ * (from its first definition or live-in block to its last use or
+ * live-out block). Intervals are handed the target's allocatable
+ * registers in order of their start; when none is free, the interval
+ * that ends last is spilled.
+ *
+ * Each call clobbers the registers MTarget::CallClobbers says: every
+ * allocatable register but the callee-saved ones, unless the target
+ * knows better (a runtime routine marked MKeepsRegs clobbers none,
+ * and a function already compiled only those it changes). An
+ * interval is given a free register none of the calls it spans
+ * clobbers if there is one, caller-saved first: a callee-saved
+ * register the function then saves at entry and restores on return
+ * (see MTarget::LayoutFrame), once rather than at every call. Failing
+ * that it gets any free register, stored to a frame object just
+ * before each call it is live across that clobbers it, and reloaded
+ * just after.
+ *
+ * A physical allocatable register set before a call (an argument in
+ * a register of the callee's choosing) is busy from there to the
+ * call, and an interval overlapping that is not given it.
+ *
+ * A spilled register lives in a frame object (a parameter in the slot
+ * it was passed in) and the rewrite reloads it into one of the
+ * target's scratch registers before each use and stores it back after
+ * each definition.
+ */
+
+#ifndef _H_regalloc
+#define _H_regalloc
+
+#include "mir.h"
+
+class LinearScan {
+  public:
+    LinearScan(MFunction *fn, MTarget *target);
+    void Run();
+
+  private:
+    struct Interval {
+        int vreg, start, end;
+    };
+
+    MFunction *fn;
+    MTarget *target;
+    vector<Interval> intervals;      // indexed by vreg - FirstVirtualReg
+    vector<int> assigned;            // physical register, or -1
+    vector<int> spillSlot;           // frame object, or -1
+    vector<int> saveSlot;            // where it is kept during calls, or -1
+    vector<int> hint;                // vreg copied from, or -1
+    vector<int> regHint;             // allocatable register copied to, or -1
+    vector<int> calls;               // linear index of each call that clobbers any
+    vector<RegMask> clobbers;        // and what it clobbers
+    vector<Interval> busy;           // of allocatable registers, vreg being the register
+
+    void ComputeIntervals();
+    void ComputeBusy(vector<MInstr *> &code, int first);
+    RegMask ClobberedAcross(const Interval &i);
+    bool LiveAcross(const Interval &i, int call);
+    bool Usable(int reg, const Interval &i);
+    int Slot(int vreg);
+    void Spill(int vreg);
+    void Allocate();
+    void Rewrite();
+};
+
+#endif
@@ -13,6 +13,7 @@
 #define MaxIdentLen 31    // Maximum length for identifiers
 
 extern char *yytext;      // Text of lexeme just scanned
+extern FILE *yyin;        // Stream the scanner reads the source from
 
 
 int yylex();              // Defined in the generated lex.yy.c file
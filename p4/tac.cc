@@ -5,6 +5,7 @@
   
 #include "tac.h"
 #include "mips.h"
+#include "backend.h"
 #include <string.h>
 
 Location::Location(Segment s, int o, const char *name) :
@@ -26,8 +27,8 @@ LoadConstant::LoadConstant(Location *d, int v)
   Assert(dst != NULL);
   sprintf(printed, "%s = %d", dst->GetName(), val);
 }
-void LoadConstant::EmitSpecific(Mips *mips) {
-  mips->EmitLoadConstant(dst, val);
+void LoadConstant::EmitSpecific(Backend *backend) {
+  backend->EmitLoadConstant(dst, val);
 }
 
 
@@ -40,8 +41,8 @@ LoadStringConstant::LoadStringConstant(Location *d, const char *s)
   quote = (strlen(str) > 50) ? "...\"" : "";
   sprintf(printed, "%s = %.50s%s", dst->GetName(), str, quote);
 }
-void LoadStringConstant::EmitSpecific(Mips *mips) {
-  mips->EmitLoadStringConstant(dst, str);
+void LoadStringConstant::EmitSpecific(Backend *backend) {
+  backend->EmitLoadStringConstant(dst, str);
 }
      
 
@@ -50,8 +51,8 @@ LoadLabel::LoadLabel(Location *d, const char *l)
   Assert(dst != NULL && label != NULL);
   sprintf(printed, "%s = %s", dst->GetName(), label);
 }
-void LoadLabel::EmitSpecific(Mips *mips) {
-  mips->EmitLoadLabel(dst, label);
+void LoadLabel::EmitSpecific(Backend *backend) {
+  backend->EmitLoadLabel(dst, label);
 }
 
 
@@ -60,8 +61,8 @@ Assign::Assign(Location *d, Location *s)
   Assert(dst != NULL && src != NULL);
   sprintf(printed, "%s = %s", dst->GetName(), src->GetName());
 }
-void Assign::EmitSpecific(Mips *mips) {
-  mips->EmitCopy(dst, src);
+void Assign::EmitSpecific(Backend *backend) {
+  backend->EmitCopy(dst, src);
 }
 
 
@@ -73,8 +74,8 @@ Load::Load(Location *d, Location *s, int off)
   else
     sprintf(printed, "%s = *(%s)", dst->GetName(), src->GetName());
 }
-void Load::EmitSpecific(Mips *mips) {
-  mips->EmitLoad(dst, src, offset);
+void Load::EmitSpecific(Backend *backend) {
+  backend->EmitLoad(dst, src, offset);
 }
 
 Store::Store(Location *d, Location *s, int off)
@@ -86,11 +87,11 @@ Store::Store(Location *d, Location *s, int off)
   else
     sprintf(printed, "*(%s) = %s", dst->GetName(), src->GetName());
 }
-void Store::EmitSpecific(Mips *mips) {
-  mips->EmitStore(dst, src, offset);
+void Store::EmitSpecific(Backend *backend) {
+  backend->EmitStore(dst, src, offset);
 }
  
-const char * const BinaryOp::opName[BinaryOp::NumOps] = {"+", "-", "*", "/", "%", "==", "<", "&&", "||"};
+const char * const BinaryOp::opName[BinaryOp::NumOps] = {"+", "-", "*", "/", "%", "==", "<", "&&", "||", "<u"};
 
 BinaryOp::OpCode BinaryOp::OpCodeForName(const char *name) {
   for (int i = 0; i < NumOps; i++) 
@@ -106,8 +107,8 @@ BinaryOp::BinaryOp(OpCode c, Location *d, Location *o1, Location *o2)
   Assert(code >= 0 && code < NumOps);
   sprintf(printed, "%s = %s %s %s", dst->GetName(), op1->GetName(), opName[code], op2->GetName());
 }
-void BinaryOp::EmitSpecific(Mips *mips) {	  
-  mips->EmitBinaryOp(code, dst, op1, op2);
+void BinaryOp::EmitSpecific(Backend *backend) {	  
+  backend->EmitBinaryOp(code, dst, op1, op2);
 }
 
 
@@ -118,8 +119,8 @@ Label::Label(const char *l) : label(strdup(l)) {
 void Label::Print() {
   printf("%s:\n", label);
 }
-void Label::EmitSpecific(Mips *mips) {
-  mips->EmitLabel(label);
+void Label::EmitSpecific(Backend *backend) {
+  backend->EmitLabel(label);
 }
 
  
@@ -127,8 +128,8 @@ Goto::Goto(const char *l) : label(strdup(l)) {
   Assert(label != NULL);
   sprintf(printed, "Goto %s", label);
 }
-void Goto::EmitSpecific(Mips *mips) {	  
-  mips->EmitGoto(label);
+void Goto::EmitSpecific(Backend *backend) {	  
+  backend->EmitGoto(label);
 }
 
 IfZ::IfZ(Location *te, const char *l)
@@ -136,8 +137,8 @@ IfZ::IfZ(Location *te, const char *l)
   Assert(test != NULL && label != NULL);
   sprintf(printed, "IfZ %s Goto %s", test->GetName(), label);
 }
-void IfZ::EmitSpecific(Mips *mips) {	  
-  mips->EmitIfZ(test, label);
+void IfZ::EmitSpecific(Backend *backend) {	  
+  backend->EmitIfZ(test, label);
 }
 
 
@@ -149,23 +150,23 @@ void BeginFunc::SetFrameSize(int numBytesForAllLocalsAndTemps) {
   frameSize = numBytesForAllLocalsAndTemps; 
   sprintf(printed,"BeginFunc %d", frameSize);
 }
-void BeginFunc::EmitSpecific(Mips *mips) {
-  mips->EmitBeginFunction(frameSize);
+void BeginFunc::EmitSpecific(Backend *backend) {
+  backend->EmitBeginFunction(frameSize);
 }
 
 EndFunc::EndFunc() : Instruction() {
   sprintf(printed, "EndFunc");
 }
-void EndFunc::EmitSpecific(Mips *mips) {
-  mips->EmitEndFunction();
+void EndFunc::EmitSpecific(Backend *backend) {
+  backend->EmitEndFunction();
 }
 
  
 Return::Return(Location *v) : val(v) {
   sprintf(printed, "Return %s", val? val->GetName() : "");
 }
-void Return::EmitSpecific(Mips *mips) {	  
-  mips->EmitReturn(val);
+void Return::EmitSpecific(Backend *backend) {	  
+  backend->EmitReturn(val);
 }
 
 
@@ -174,16 +175,16 @@ PushParam::PushParam(Location *p)
   Assert(param != NULL);
   sprintf(printed, "PushParam %s", param->GetName());
 }
-void PushParam::EmitSpecific(Mips *mips) {
-  mips->EmitParam(param);
+void PushParam::EmitSpecific(Backend *backend) {
+  backend->EmitParam(param);
 } 
 
 PopParams::PopParams(int nb)
   :  numBytes(nb) {
   sprintf(printed, "PopParams %d", numBytes);
 }
-void PopParams::EmitSpecific(Mips *mips) {
-  mips->EmitPopParams(numBytes);
+void PopParams::EmitSpecific(Backend *backend) {
+  backend->EmitPopParams(numBytes);
 } 
 
 
@@ -192,8 +193,8 @@ LCall::LCall(const char *l, Location *d)
   :  label(strdup(l)), dst(d) {
   sprintf(printed, "%s%sLCall %s", dst? dst->GetName(): "", dst?" = ":"", label);
 }
-void LCall::EmitSpecific(Mips *mips) {
-  mips->EmitLCall(dst, label);
+void LCall::EmitSpecific(Backend *backend) {
+  backend->EmitLCall(dst, label);
 }
 
 ACall::ACall(Location *ma, Location *d)
@@ -202,8 +203,8 @@ ACall::ACall(Location *ma, Location *d)
   sprintf(printed, "%s%sACall %s", dst? dst->GetName(): "", dst?" = ":"",
 	    methodAddr->GetName());
 }
-void ACall::EmitSpecific(Mips *mips) {
-  mips->EmitACall(dst, methodAddr);
+void ACall::EmitSpecific(Backend *backend) {
+  backend->EmitACall(dst, methodAddr);
 } 
 
 
@@ -219,7 +220,7 @@ void VTable::Print() {
     printf("\t%s,\n", methodLabels->Nth(i));
   printf("; \n"); 
 }
-void VTable::EmitSpecific(Mips *mips) {
-  mips->EmitVTable(label, methodLabels);
+void VTable::EmitSpecific(Backend *backend) {
+  backend->EmitVTable(label, methodLabels);
 }
 
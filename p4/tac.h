@@ -8,7 +8,9 @@
  * few fields, but each responds polymorphically to the methods
  * Print and Emit, the first is used to print out the TAC form of
  * the instruction (helpful when debugging) and the second to
- * convert to the appropriate MIPS assembly.
+ * convert to the appropriate MIPS assembly. EmitSpecific hands the
+ * operands to any Backend (see backend.h), so the same instruction
+ * list can also be fed to consumers other than Mips.
  *
  * The operands to each instruction are of Location class.
  * A Location object is a simple representation of where a variable
@@ -24,6 +26,7 @@
 
 #include "list.h" // for VTable
 class Mips;
+class Backend;
 
 
     // A Location object is used to identify the operands to the
@@ -63,8 +66,9 @@ class Instruction {
     public:
         virtual ~Instruction() {}
 	virtual void Print();
-	virtual void EmitSpecific(Mips *mips) = 0;
+	virtual void EmitSpecific(Backend *backend) = 0;
 	virtual void Emit(Mips *mips);
+	const char *GetPrinted() { return printed; }
 };
 
   
@@ -99,7 +103,7 @@ class LoadConstant: public Instruction {
     int val;
   public:
     LoadConstant(Location *dst, int val);
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 };
 
 class LoadStringConstant: public Instruction {
@@ -107,7 +111,7 @@ class LoadStringConstant: public Instruction {
     char *str;
   public:
     LoadStringConstant(Location *dst, const char *s);
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 };
     
 class LoadLabel: public Instruction {
@@ -115,14 +119,14 @@ class LoadLabel: public Instruction {
     const char *label;
   public:
     LoadLabel(Location *dst, const char *label);
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 };
 
 class Assign: public Instruction {
     Location *dst, *src;
   public:
     Assign(Location *dst, Location *src);
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 };
 
 class Load: public Instruction {
@@ -130,7 +134,7 @@ class Load: public Instruction {
     int offset;
   public:
     Load(Location *dst, Location *src, int offset = 0);
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 };
 
 class Store: public Instruction {
@@ -138,13 +142,15 @@ class Store: public Instruction {
     int offset;
   public:
     Store(Location *d, Location *s, int offset = 0);
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 };
 
 class BinaryOp: public Instruction {
 
   public:
-    typedef enum {Add, Sub, Mul, Div, Mod, Eq, Less, And, Or, NumOps} OpCode;
+      // ULess compares as unsigned; the compiler uses it for checks
+      // (a negative index is a huge unsigned one), not for Decaf's <.
+    typedef enum {Add, Sub, Mul, Div, Mod, Eq, Less, And, Or, ULess, NumOps} OpCode;
     static const char * const opName[NumOps];
     static OpCode OpCodeForName(const char *name);
     
@@ -153,7 +159,7 @@ class BinaryOp: public Instruction {
     Location *dst, *op1, *op2;
   public:
     BinaryOp(OpCode c, Location *dst, Location *op1, Location *op2);
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 };
 
 class Label: public Instruction {
@@ -161,14 +167,14 @@ class Label: public Instruction {
   public:
     Label(const char *label);
     void Print();
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 };
 
 class Goto: public Instruction {
     const char *label;
   public:
     Goto(const char *label);
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 };
 
 class IfZ: public Instruction {
@@ -176,7 +182,7 @@ class IfZ: public Instruction {
     const char *label;
   public:
     IfZ(Location *test, const char *label);
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 };
 
 class BeginFunc: public Instruction {
@@ -185,34 +191,34 @@ class BeginFunc: public Instruction {
     BeginFunc();
     // used to backpatch the instruction with frame size once known
     void SetFrameSize(int numBytesForAllLocalsAndTemps);
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 };
 
 class EndFunc: public Instruction {
   public:
     EndFunc();
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 };
 
 class Return: public Instruction {
     Location *val;
   public:
     Return(Location *val);
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 };   
 
 class PushParam: public Instruction {
     Location *param;
   public:
     PushParam(Location *param);
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 }; 
 
 class PopParams: public Instruction {
     int numBytes;
   public:
     PopParams(int numBytesOfParamsToRemove);
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 }; 
 
 class LCall: public Instruction {
@@ -220,14 +226,14 @@ class LCall: public Instruction {
     Location *dst;
   public:
     LCall(const char *labe, Location *result);
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 };
 
 class ACall: public Instruction {
     Location *dst, *methodAddr;
   public:
     ACall(Location *meth, Location *result);
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 };
 
 class VTable: public Instruction {
@@ -236,7 +242,7 @@ class VTable: public Instruction {
  public:
     VTable(const char *labelForTable, List<const char *> *methodLabels);
     void Print();
-    void EmitSpecific(Mips *mips);
+    void EmitSpecific(Backend *backend);
 };
 
 
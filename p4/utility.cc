@@ -11,6 +11,9 @@
 using std::vector;
 
 static vector<const char*> debugKeys;
+static const char *target = "mips";
+static const char *profile = NULL;
+static const char *targets[] = { "mips", "x86", "c", "run" };
 static const int BufferSize = 2048;
 
 void Failure(const char *format, ...) {
@@ -58,19 +61,45 @@ void PrintDebug(const char *key, const char *format, ...) {
   printf("+++ (%s): %s%s", key, buf, buf[strlen(buf)-1] != '\n'? "\n" : "");
 }
 
-void ParseCommandLine(int argc, char *argv[]) {
-  if (argc == 1)
-    return;
+const char *ParseCommandLine(int argc, char *argv[]) {
+  const char *source = NULL;
+  int first = 1;
+  if (argc > 1 && argv[1][0] != '-') // optional source file name
+    source = argv[first++];
+  if (first + 1 < argc && !strcmp(argv[first], "-target")) {
+    target = argv[first + 1];
+    first += 2;
+  } else if (first < argc && !strcmp(argv[first], "--run")) {
+    target = "run";
+    first++;
+  }
+  if (first + 1 < argc && !strcmp(argv[first], "-profile")) {
+    profile = argv[first + 1];
+    first += 2;
+  }
+  bool known = false;
+  for (unsigned int i = 0; i < sizeof(targets) / sizeof(targets[0]); i++)
+    if (!strcmp(target, targets[i])) known = true;
+  if (argc == first && known)
+    return source;
   
-  if (strcmp(argv[1], "-d") != 0) { // first arg is not -d
+  if (!known || strcmp(argv[first], "-d") != 0) { // next arg is not -d
     printf("Incorrect Use:   ");
     for (int i = 1; i < argc; i++) printf("%s ", argv[i]);
     printf("\n");
-    printf("Correct Usage:   -d <debug-key-1> <debug-key-2> ... \n");
+    printf("Correct Usage:   [source-file] [-target mips|x86|c | --run] [-profile file] -d <debug-key-1> <debug-key-2> ... \n");
     exit(2);
   }
 
-  for (int i = 2; i < argc; i++)
+  for (int i = first + 1; i < argc; i++)
     SetDebugForKey(argv[i], true);
+  return source;
 }
 
+const char *GetTarget() {
+  return target;
+}
+
+const char *GetProfile() {
+  return profile;
+}
@@ -78,9 +78,34 @@ bool IsDebugOn(const char *key);
  * --------------------------
  * Turn on the debugging flags from the command line.  Verifies that
  * first argument is -d, and then interpret all the arguments that follow
- * as being flags to turn on.
+ * as being flags to turn on. The source may also be named as the very
+ * first argument (dcc prog.decaf -d interp), which leaves stdin free
+ * for a program run by the interpreter. Returns that file name, or
+ * NULL if the source is to be read from stdin. A target other than
+ * MIPS can be chosen with -target <name> ahead of any -d, or --run to
+ * compile the program in memory and run it right away. After that,
+ * -profile <file> names an edge profile written by dsim -profile.
  */
 
-void ParseCommandLine(int argc, char *argv[]);
+const char *ParseCommandLine(int argc, char *argv[]);
+
+/**
+ * Function: GetTarget()
+ * Usage: if (!strcmp(GetTarget(), "x86")) ...
+ * -------------------------------------------
+ * Return the name of the target selected on the command line, "mips"
+ * unless another was given with -target, or "run" for --run.
+ */
+
+const char *GetTarget();
+
+/**
+ * Function: GetProfile()
+ * Usage: if (GetProfile()) ...
+ * ----------------------------
+ * Return the name of the profile given with -profile, or NULL.
+ */
+
+const char *GetProfile();
      
 #endif
@@ -0,0 +1,329 @@
+/* File: x86.cc
+ * ------------
+ * Implementation of the X86 class, which translates Tac to x86-64
+ * assembly. See x86.h for the data and frame layout.
+ *
+ * Calls between Decaf functions keep the Tac convention: arguments
+ * are pushed on the stack and popped by the caller, the result comes
+ * back in %eax. Calls to the built-ins go to the C runtime instead, so
+ * at those the pushed arguments are moved into %edi/%esi and the stack
+ * is aligned as the System V ABI wants. Every prologue aligns %rsp to
+ * 16 bytes, which makes the alignment at a call site depend only on
+ * the number of params on the stack.
+ */
+
+#include "x86.h"
+#include "codegen.h"
+#include <stdarg.h>
+#include <string.h>
+
+  // Names used in the output that no Decaf identifier can produce.
+static const char *GlobalsLabel = "__decaf_globals";
+static const char *MainLabel = "__decaf_main";
+
+
+X86::X86() : paramsPushed(0), globalBytes(0) {}
+
+/* Method: Emit
+ * ------------
+ * Same as Mips::Emit: printf-style, tabs in everything but labels and
+ * ends each line with a newline.
+ */
+void X86::Emit(const char *fmt, ...)
+{
+  va_list args;
+  char buf[1024];
+
+  va_start(args, fmt);
+  vsprintf(buf, fmt, args);
+  va_end(args);
+
+  char last = buf[strlen(buf) - 1];
+  if (last != ':') printf("\t");
+  printf("%s", buf);
+  if (last != '\n') printf("\n");
+}
+
+/* Method: EmitInstruction
+ * -----------------------
+ * Lowers one Tac instruction through the Backend interface, after its
+ * Tac form as a comment, which is what Instruction::Emit does for Mips.
+ */
+void X86::EmitInstruction(Instruction *instr)
+{
+  if (*instr->GetPrinted())
+    Emit("# %s", instr->GetPrinted());
+  instr->EmitSpecific(this);
+}
+
+
+/* Method: Slot
+ * ------------
+ * Formats the memory operand for a variable into buf: an offset from
+ * %rbp for locals, temps and parameters, or an offset into the globals
+ * area. Also keeps track of how big the globals area has to be.
+ */
+const char *X86::Slot(Location *var, char *buf)
+{
+  int offset = var->GetOffset();
+  Assert(offset % 4 == 0); // all variables are 4 bytes
+  if (var->GetSegment() == gpRelative) {
+    if (offset + 4 > globalBytes) globalBytes = offset + 4;
+    sprintf(buf, "%s+%d", GlobalsLabel, offset);
+  } else {
+    sprintf(buf, "%d(%%rbp)", offset > 0 ? 2 * offset + 8 : offset);
+  }
+  return buf;
+}
+
+  // Decaf's main is called by the runtime's C main, so it is renamed.
+const char *X86::Symbol(const char *label)
+{
+  return strcmp(label, "main") ? label : MainLabel;
+}
+
+void X86::Load(const char *reg, Location *var)
+{
+  char buf[64];
+  Emit("movl %s, %s\t# load %s", Slot(var, buf), reg, var->GetName());
+}
+
+void X86::Store(Location *var, const char *reg)
+{
+  char buf[64];
+  Emit("movl %s, %s\t# store %s", reg, Slot(var, buf), var->GetName());
+}
+
+
+void X86::EmitLoadConstant(Location *dst, int val)
+{
+  char buf[64];
+  Emit("movl $%d, %s\t# load constant into %s", val, Slot(dst, buf), dst->GetName());
+}
+
+void X86::EmitLoadStringConstant(Location *dst, const char *str)
+{
+  int &n = stringIndex[str];             // identical literals share one copy
+  if (!n) {
+    strings.push_back(str);
+    n = strings.size();
+  }
+  char label[16];
+  sprintf(label, ".Lstring%d", n);
+  EmitLoadLabel(dst, label);
+}
+
+void X86::EmitLoadLabel(Location *dst, const char *label)
+{
+  char buf[64];
+  Emit("movl $%s, %s\t# load label", Symbol(label), Slot(dst, buf));
+}
+
+void X86::EmitCopy(Location *dst, Location *src)
+{
+  Load("%eax", src);
+  Store(dst, "%eax");
+}
+
+  // Pointers are 32-bit values; the movl into %eax zero-extends them
+  // so %rax can be used as the base register.
+void X86::EmitLoad(Location *dst, Location *reference, int offset)
+{
+  Load("%eax", reference);
+  Emit("movl %d(%%rax), %%eax\t# load with offset", offset);
+  Store(dst, "%eax");
+}
+
+void X86::EmitStore(Location *reference, Location *value, int offset)
+{
+  Load("%eax", reference);
+  Load("%ecx", value);
+  Emit("movl %%ecx, %d(%%rax)\t# store with offset", offset);
+}
+
+
+/* Method: EmitBinaryOp
+ * --------------------
+ * Computes op1 <code> op2 in %eax. Division and remainder go through
+ * idivl, which faults on INT_MIN / -1; a divisor of -1 is handled
+ * separately so the result wraps the way it does on MIPS.
+ */
+void X86::EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+                       Location *op1, Location *op2)
+{
+  char buf[64];
+  Load("%eax", op1);
+  const char *right = Slot(op2, buf);
+  switch (code) {
+    case BinaryOp::Add: Emit("addl %s, %%eax", right); break;
+    case BinaryOp::Sub: Emit("subl %s, %%eax", right); break;
+    case BinaryOp::Mul: Emit("imull %s, %%eax", right); break;
+    case BinaryOp::And: Emit("andl %s, %%eax", right); break;
+    case BinaryOp::Or:  Emit("orl %s, %%eax", right); break;
+    case BinaryOp::Eq:
+    case BinaryOp::Less:
+    case BinaryOp::ULess:
+      Emit("cmpl %s, %%eax", right);
+      Emit("%s %%al", code == BinaryOp::Eq ? "sete" : code == BinaryOp::Less ? "setl" : "setb");
+      Emit("movzbl %%al, %%eax");
+      break;
+    case BinaryOp::Div:
+    case BinaryOp::Mod:
+      Emit("movl %s, %%ecx", right);
+      Emit("cmpl $-1, %%ecx");
+      Emit("jne 1f");
+      Emit(code == BinaryOp::Div ? "negl %%eax" : "xorl %%eax, %%eax");
+      Emit("jmp 2f");
+      Emit("1:");
+      Emit("cltd");
+      Emit("idivl %%ecx");
+      if (code == BinaryOp::Mod) Emit("movl %%edx, %%eax");
+      Emit("2:");
+      break;
+    default:
+      Assert(0);
+  }
+  Store(dst, "%eax");
+}
+
+
+void X86::EmitLabel(const char *label)
+{
+  Emit("%s:", Symbol(label));
+}
+
+void X86::EmitGoto(const char *label)
+{
+  Emit("jmp %s\t\t# unconditional branch", label);
+}
+
+void X86::EmitIfZ(Location *test, const char *label)
+{
+  char buf[64];
+  Emit("cmpl $0, %s", Slot(test, buf));
+  Emit("je %s\t\t# branch if %s is zero", label, test->GetName());
+}
+
+
+/* Method: EmitParam
+ * -----------------
+ * Pushes one argument. pushq needs a 64-bit register; the upper half
+ * of the slot is never read.
+ */
+void X86::EmitParam(Location *arg)
+{
+  Load("%eax", arg);
+  Emit("pushq %%rax\t\t# push param");
+  paramsPushed++;
+}
+
+/* Method: EmitLCall
+ * -----------------
+ * A call to a Decaf function is a plain call. A call to a built-in
+ * passes its (at most two) arguments, the last pushed, in registers
+ * and pads the stack by 8 bytes when an odd number of params is on it
+ * (the arguments of an enclosing call may already have been pushed)
+ * so that %rsp is 16-byte aligned at the call.
+ */
+void X86::EmitLCall(Location *result, const char *label)
+{
+  BuiltIn b = CodeGenerator::BuiltInForLabel(label);
+  if (b != NumBuiltIns) {
+    const char *argRegs[] = { "%edi", "%esi" };
+    for (int i = 0; i < CodeGenerator::NumArgsForBuiltIn(b); i++)
+      Emit("movl %d(%%rsp), %s\t# pass arg %d in register", 8 * i, argRegs[i], i + 1);
+    bool pad = (paramsPushed % 2 != 0);
+    if (pad) Emit("subq $8, %%rsp\t\t# align stack for C call");
+    Emit("call %s", label);
+    if (pad) Emit("addq $8, %%rsp");
+  } else {
+    Emit("call %s", Symbol(label));
+  }
+  if (result) Store(result, "%eax");
+}
+
+void X86::EmitACall(Location *result, Location *fnAddr)
+{
+  Load("%eax", fnAddr);
+  Emit("call *%%rax");
+  if (result) Store(result, "%eax");
+}
+
+void X86::EmitPopParams(int bytes)
+{
+  if (bytes != 0)
+    Emit("addq $%d, %%rsp\t# pop params off stack", 2 * bytes);
+  paramsPushed -= bytes / 4;
+}
+
+
+void X86::EmitReturn(Location *returnVal)
+{
+  if (returnVal) Load("%eax", returnVal);
+  Emit("movq %%rbp, %%rsp\t# pop callee frame off stack");
+  Emit("popq %%rbp\t\t# restore saved rbp");
+  Emit("ret");
+}
+
+/* Method: EmitBeginFunction
+ * -------------------------
+ * Saves %rbp and makes room for locals and temps, which start at
+ * -8(%rbp) as in the MIPS frame, then aligns %rsp (see above).
+ */
+void X86::EmitBeginFunction(int stackFrameSize)
+{
+  Assert(stackFrameSize >= 0);
+  Emit("pushq %%rbp\t\t# save rbp");
+  Emit("movq %%rsp, %%rbp\t# set up new rbp");
+  int bytes = (stackFrameSize + 4 + 15) & ~15;
+  if (bytes != 0)
+    Emit("subq $%d, %%rsp\t# make space for locals/temps", bytes);
+  Emit("andq $-16, %%rsp");
+  paramsPushed = 0;
+}
+
+void X86::EmitEndFunction()
+{
+  Emit("# (below handles reaching end of fn body with no explicit return)");
+  EmitReturn(NULL);
+}
+
+
+void X86::EmitVTable(const char *label, List<const char*> *methodLabels)
+{
+  Emit(".data");
+  Emit(".align 4");
+  Emit("%s:\t\t# label for class %s vtable", label, label);
+  for (int i = 0; i < methodLabels->NumElements(); i++)
+    Emit(".long %s", Symbol(methodLabels->Nth(i)));
+  Emit(".text");
+}
+
+
+void X86::EmitPreamble()
+{
+  Emit("# standard Decaf preamble (x86-64, link with x86rt.c)");
+  Emit(".text");
+  Emit(".globl %s", MainLabel);
+  Emit("");
+}
+
+/* Method: EmitGlobals
+ * -------------------
+ * Called after all code is emitted: lays out the pooled string literals
+ * and reserves the zero-filled area that plays the role of the MIPS gp
+ * segment.
+ */
+void X86::EmitGlobals()
+{
+  if (!strings.empty()) Emit(".section .rodata");
+  for (size_t i = 0; i < strings.size(); i++) {
+    Emit(".Lstring%d:", (int)i + 1);
+    Emit(".asciz %s", strings[i].c_str());
+  }
+  Emit(".bss");
+  Emit(".align 4");
+  Emit("%s:", GlobalsLabel);
+  Emit(".zero %d", globalBytes > 0 ? globalBytes : 4);
+  Emit(".section .note.GNU-stack,\"\",@progbits");
+}
@@ -0,0 +1,86 @@
+/* File: x86.h
+ * -----------
+ * The X86 class is the second target of the final code generator. It
+ * lowers the same Tac instructions the Mips class handles to x86-64
+ * assembly (GNU as, AT&T syntax) for the System V ABI, and is chosen
+ * with dcc -target x86. The output is linked with the small C runtime
+ * in x86rt.c by the host gcc into a native executable:
+ *
+ *     dcc -target x86 < prog.decaf > prog.s
+ *     gcc -no-pie -o prog prog.s x86rt.c
+ *
+ * Decaf values keep their MIPS size: every variable is a 4-byte slot
+ * and pointers are 32-bit. That works because the program is linked at
+ * a fixed low address (-no-pie) and the runtime hands out heap memory
+ * below 4G, so strings, vtables, globals and objects all have 32-bit
+ * addresses. The frame layout mirrors the MIPS one: locals and temps
+ * keep their negative offsets from %rbp, and since each pushed
+ * parameter takes an 8-byte stack slot, the parameter at MIPS offset
+ * fp+n is found at 2n+8(%rbp).
+ *
+ * Like the original Mips class this does no register allocation: each
+ * instruction loads its operands into %eax/%ecx, computes and stores
+ * the result back to its slot.
+ */
+
+#ifndef _H_x86
+#define _H_x86
+
+#include "tac.h"
+#include "list.h"
+#include "backend.h"
+#include <map>
+#include <string>
+#include <vector>
+class Location;
+
+
+class X86 : public Backend {
+  private:
+    int paramsPushed;      // pushed and not yet popped, for stack alignment
+    int globalBytes;       // extent of the gp-relative area seen so far
+    std::map<std::string, int> stringIndex;  // literal -> .LstringN
+    std::vector<std::string> strings;        // emitted by EmitGlobals
+
+    const char *Slot(Location *var, char *buf);
+    const char *Symbol(const char *label);
+    void Load(const char *reg, Location *var);
+    void Store(Location *var, const char *reg);
+
+ public:
+
+    X86();
+
+    static void Emit(const char *fmt, ...);
+    void EmitInstruction(Instruction *instr);
+
+    void EmitLoadConstant(Location *dst, int val);
+    void EmitLoadStringConstant(Location *dst, const char *str);
+    void EmitLoadLabel(Location *dst, const char *label);
+
+    void EmitLoad(Location *dst, Location *reference, int offset);
+    void EmitStore(Location *reference, Location *value, int offset);
+    void EmitCopy(Location *dst, Location *src);
+
+    void EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
+			    Location *op1, Location *op2);
+
+    void EmitLabel(const char *label);
+    void EmitGoto(const char *label);
+    void EmitIfZ(Location *test, const char*label);
+    void EmitReturn(Location *returnVal);
+
+    void EmitBeginFunction(int frameSize);
+    void EmitEndFunction();
+
+    void EmitParam(Location *arg);
+    void EmitLCall(Location *result, const char* label);
+    void EmitACall(Location *result, Location *fnAddr);
+    void EmitPopParams(int bytes);
+
+    void EmitVTable(const char *label, List<const char*> *methodLabels);
+
+    void EmitPreamble();
+    void EmitGlobals();
+};
+#endif
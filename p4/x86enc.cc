@@ -0,0 +1,238 @@
+/* File: x86enc.cc
+ * ---------------
+ * Implementation of the X86Encoder class. Opcodes above 0xff are the
+ * two-byte 0x0f forms; REX prefixes are added only when an operand
+ * needs them.
+ */
+
+#include "x86enc.h"
+#include <string.h>
+
+
+X86Encoder::X86Encoder(unsigned char *buffer, size_t capacity)
+  : buf(buffer), cap(capacity), pos(0), full(false) {}
+
+void X86Encoder::Byte(int b)
+{
+  if (pos < cap) buf[pos++] = b;
+  else full = true;
+}
+
+void X86Encoder::Int32(int v)
+{
+  for (int i = 0; i < 4; i++) Byte((v >> (8 * i)) & 0xff);
+}
+
+void X86Encoder::Rex(bool w, int reg, int index, int base, bool force)
+{
+  int rex = 0x40 | (w << 3) | ((reg >> 3) & 1) << 2 |
+            (index != NoIndex ? ((index >> 3) & 1) << 1 : 0) | ((base >> 3) & 1);
+  if (rex != 0x40 || force) Byte(rex);
+}
+
+void X86Encoder::ModRM(int reg, const X86Mem &m)
+{
+  int mod = (m.disp >= -128 && m.disp <= 127) ? 1 : 2;
+  if (m.index == NoIndex && (m.base & 7) != RSP) {
+    Byte((mod << 6) | ((reg & 7) << 3) | (m.base & 7));
+  } else {
+    int ss = (m.scale == 8) ? 3 : (m.scale == 4) ? 2 : (m.scale == 2) ? 1 : 0;
+    int index = (m.index == NoIndex) ? RSP : m.index;
+    Byte((mod << 6) | ((reg & 7) << 3) | RSP);
+    Byte((ss << 6) | ((index & 7) << 3) | (m.base & 7));
+  }
+  if (mod == 1) Byte(m.disp & 0xff);
+  else Int32(m.disp);
+}
+
+void X86Encoder::ModRMReg(int reg, int rm)
+{
+  Byte(0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+void X86Encoder::Op(int opcode, int reg, const X86Mem &m, bool w, bool force)
+{
+  Rex(w, reg, m.index, m.base, force);
+  if (opcode > 0xff) Byte(opcode >> 8);
+  Byte(opcode & 0xff);
+  ModRM(reg, m);
+}
+
+void X86Encoder::OpReg(int opcode, int reg, int rm, bool w, bool force)
+{
+  Rex(w, reg, NoIndex, rm, force);
+  if (opcode > 0xff) Byte(opcode >> 8);
+  Byte(opcode & 0xff);
+  ModRMReg(reg, rm);
+}
+
+size_t X86Encoder::Rel32(long target)
+{
+  size_t at = pos;
+  Int32(0);
+  if (target >= 0) Patch(at, target);
+  return at;
+}
+
+void X86Encoder::Patch(size_t at, size_t target)
+{
+  int disp = (int)(target - (at + 4));
+  if (at + 4 <= pos) memcpy(buf + at, &disp, 4);
+}
+
+void X86Encoder::PatchAbsolute(unsigned char *field, const void *target)
+{
+  int disp = (int)((const unsigned char *)target - (field + 4));
+  memcpy(field, &disp, 4);
+}
+
+
+void X86Encoder::Mov(X86Reg dst, X86Reg src, bool w)         { OpReg(0x89, src, dst, w); }
+void X86Encoder::Mov(X86Reg dst, const X86Mem &src, bool w)  { Op(0x8b, dst, src, w); }
+void X86Encoder::Mov(const X86Mem &dst, X86Reg src, bool w)  { Op(0x89, src, dst, w); }
+
+void X86Encoder::MovImm(X86Reg dst, int imm)
+{
+  Rex(false, 0, NoIndex, dst);
+  Byte(0xb8 + (dst & 7));
+  Int32(imm);
+}
+
+void X86Encoder::MovImm(const X86Mem &dst, int imm)
+{
+  Op(0xc7, 0, dst, false);
+  Int32(imm);
+}
+
+void X86Encoder::MovImm64(X86Reg dst, long long imm)
+{
+  Rex(true, 0, NoIndex, dst);
+  Byte(0xb8 + (dst & 7));
+  Int32((int)imm);
+  Int32((int)(imm >> 32));
+}
+
+void X86Encoder::Store16(const X86Mem &dst, X86Reg src)
+{
+  Byte(0x66);
+  Op(0x89, src, dst, false);
+}
+
+void X86Encoder::Store8(const X86Mem &dst, X86Reg src)
+{
+  Op(0x88, src, dst, false, src >= RSP && src <= RDI);
+}
+
+void X86Encoder::Load16(X86Reg dst, const X86Mem &src, bool signExtend)
+{
+  Op(signExtend ? 0x0fbf : 0x0fb7, dst, src, false);
+}
+
+void X86Encoder::Load8(X86Reg dst, const X86Mem &src, bool signExtend)
+{
+  Op(signExtend ? 0x0fbe : 0x0fb6, dst, src, false);
+}
+
+void X86Encoder::Movzx8(X86Reg dst, X86Reg src)
+{
+  OpReg(0x0fb6, dst, src, false, src >= RSP && src <= RDI);
+}
+
+void X86Encoder::Lea(X86Reg dst, const X86Mem &src, bool w) { Op(0x8d, dst, src, w); }
+
+
+void X86Encoder::Alu(X86Alu op, X86Reg dst, X86Reg src, bool w)
+{
+  OpReg(0x01 + 8 * op, src, dst, w);
+}
+
+void X86Encoder::Alu(X86Alu op, X86Reg dst, const X86Mem &src, bool w)
+{
+  Op(0x03 + 8 * op, dst, src, w);
+}
+
+void X86Encoder::Alu(X86Alu op, const X86Mem &dst, X86Reg src, bool w)
+{
+  Op(0x01 + 8 * op, src, dst, w);
+}
+
+void X86Encoder::AluImm(X86Alu op, X86Reg dst, int imm, bool w)
+{
+  bool small = (imm >= -128 && imm <= 127);
+  OpReg(small ? 0x83 : 0x81, op, dst, w);
+  if (small) Byte(imm & 0xff);
+  else Int32(imm);
+}
+
+void X86Encoder::AluImm(X86Alu op, const X86Mem &dst, int imm, bool w)
+{
+  bool small = (imm >= -128 && imm <= 127);
+  Op(small ? 0x83 : 0x81, op, dst, w);
+  if (small) Byte(imm & 0xff);
+  else Int32(imm);
+}
+
+void X86Encoder::Test(X86Reg a, X86Reg b, bool w) { OpReg(0x85, b, a, w); }
+
+void X86Encoder::TestImm(X86Reg a, int imm)
+{
+  OpReg(0xf7, 0, a, false);
+  Int32(imm);
+}
+
+void X86Encoder::Shift(X86Shift op, X86Reg dst, int amount)
+{
+  OpReg(0xc1, op, dst, false);
+  Byte(amount & 31);
+}
+
+void X86Encoder::ShiftCl(X86Shift op, X86Reg dst) { OpReg(0xd3, op, dst, false); }
+void X86Encoder::Imul(X86Reg dst, X86Reg src)     { OpReg(0x0faf, dst, src, false); }
+void X86Encoder::Imul(X86Reg dst, const X86Mem &src) { Op(0x0faf, dst, src, false); }
+void X86Encoder::Mul64(const X86Mem &src, bool isSigned) { Op(0xf7, isSigned ? 5 : 4, src, false); }
+void X86Encoder::Div(X86Reg divisor, bool isSigned) { OpReg(0xf7, isSigned ? 7 : 6, divisor, false); }
+void X86Encoder::Cdq()                            { Byte(0x99); }
+void X86Encoder::Neg(X86Reg dst)                  { OpReg(0xf7, 3, dst, false); }
+void X86Encoder::Not(X86Reg dst)                  { OpReg(0xf7, 2, dst, false); }
+
+void X86Encoder::Setcc(X86Cond cond, X86Reg dst)
+{
+  OpReg(0x0f90 + cond, 0, dst, false, dst >= RSP && dst <= RDI);
+}
+
+
+size_t X86Encoder::Jcc(X86Cond cond, long target)
+{
+  Byte(0x0f);
+  Byte(0x80 + cond);
+  return Rel32(target);
+}
+
+size_t X86Encoder::Jmp(long target)
+{
+  Byte(0xe9);
+  return Rel32(target);
+}
+
+size_t X86Encoder::Call(long target)
+{
+  Byte(0xe8);
+  return Rel32(target);
+}
+
+void X86Encoder::JmpReg(X86Reg target)  { OpReg(0xff, 4, target, false); }
+void X86Encoder::CallReg(X86Reg target) { OpReg(0xff, 2, target, false); }
+
+void X86Encoder::Push(X86Reg r)
+{
+  Rex(false, 0, NoIndex, r);
+  Byte(0x50 + (r & 7));
+}
+
+void X86Encoder::Pop(X86Reg r)
+{
+  Rex(false, 0, NoIndex, r);
+  Byte(0x58 + (r & 7));
+}
+
+void X86Encoder::Ret() { Byte(0xc3); }
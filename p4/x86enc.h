@@ -0,0 +1,126 @@
+/* File: x86enc.h
+ * --------------
+ * The X86Encoder class writes x86-64 machine code into a byte buffer.
+ * It covers the small set of integer instructions the code generators
+ * that run on the host need (the simulator's translator, see
+ * mipsdbt.h, and dcc --run, see jit.h): 32 and 64-bit moves and ALU operations on registers,
+ * memory and immediates, shifts, multiply/divide, setcc/movzx, and
+ * jumps with rel32 displacements that can be patched later.
+ *
+ * Memory operands are [base + index*scale + disp]; displacements are
+ * always emitted (as disp8 when they fit), which keeps the rbp/r13 and
+ * rsp/r12 special cases in one place.
+ */
+
+#ifndef _H_x86enc
+#define _H_x86enc
+
+#include <stddef.h>
+
+typedef enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+               R8, R9, R10, R11, R12, R13, R14, R15, NoIndex = -1 } X86Reg;
+
+  // Condition codes, numbered as in the jcc/setcc opcodes.
+typedef enum { CondO = 0, CondNO = 1, CondB = 2, CondAE = 3, CondE = 4,
+               CondNE = 5, CondBE = 6, CondA = 7, CondS = 8, CondNS = 9,
+               CondL = 12, CondGE = 13, CondLE = 14, CondG = 15 } X86Cond;
+
+  // The eight classic ALU operations, numbered as their /digit.
+typedef enum { AluAdd = 0, AluOr = 1, AluAnd = 4, AluSub = 5, AluXor = 6,
+               AluCmp = 7 } X86Alu;
+
+typedef enum { ShiftShl = 4, ShiftShr = 5, ShiftSar = 7 } X86Shift;
+
+struct X86Mem {
+    X86Reg base, index;
+    int scale, disp;
+};
+
+inline X86Mem Mem(X86Reg base, int disp)
+{
+  X86Mem m = { base, NoIndex, 1, disp };
+  return m;
+}
+
+inline X86Mem Mem(X86Reg base, X86Reg index, int scale, int disp)
+{
+  X86Mem m = { base, index, scale, disp };
+  return m;
+}
+
+class X86Encoder {
+  public:
+    X86Encoder(unsigned char *buffer, size_t capacity);
+
+      // Offset of the next byte and whether the buffer ran out. Once
+      // full, further output is dropped; callers check Full() at the end.
+    size_t Here() const { return pos; }
+    bool Full() const { return full; }
+    unsigned char *Start() const { return buf; }
+
+      // Sets the rel32 field at offset `at` (as returned by Jcc/Jmp/Call)
+      // to reach target, which is a buffer offset or, with the absolute
+      // form, a host address.
+    void Patch(size_t at, size_t target);
+    static void PatchAbsolute(unsigned char *field, const void *target);
+
+      // w selects the 64-bit form; the default is 32-bit, which clears
+      // the upper half of the destination register.
+    void Mov(X86Reg dst, X86Reg src, bool w = false);
+    void Mov(X86Reg dst, const X86Mem &src, bool w = false);
+    void Mov(const X86Mem &dst, X86Reg src, bool w = false);
+    void MovImm(X86Reg dst, int imm);
+    void MovImm(const X86Mem &dst, int imm);
+    void MovImm64(X86Reg dst, long long imm);
+    void Store16(const X86Mem &dst, X86Reg src);
+    void Store8(const X86Mem &dst, X86Reg src);
+    void Load16(X86Reg dst, const X86Mem &src, bool signExtend);
+    void Load8(X86Reg dst, const X86Mem &src, bool signExtend);
+    void Movzx8(X86Reg dst, X86Reg src);
+    void Lea(X86Reg dst, const X86Mem &src, bool w = false);
+
+    void Alu(X86Alu op, X86Reg dst, X86Reg src, bool w = false);
+    void Alu(X86Alu op, X86Reg dst, const X86Mem &src, bool w = false);
+    void Alu(X86Alu op, const X86Mem &dst, X86Reg src, bool w = false);
+    void AluImm(X86Alu op, X86Reg dst, int imm, bool w = false);
+    void AluImm(X86Alu op, const X86Mem &dst, int imm, bool w = false);
+    void Test(X86Reg a, X86Reg b, bool w = false);
+    void TestImm(X86Reg a, int imm);
+    void Shift(X86Shift op, X86Reg dst, int amount);
+    void ShiftCl(X86Shift op, X86Reg dst);
+    void Imul(X86Reg dst, X86Reg src);
+    void Imul(X86Reg dst, const X86Mem &src);
+    void Mul64(const X86Mem &src, bool isSigned);   // edx:eax = eax * [src]
+    void Div(X86Reg divisor, bool isSigned);        // eax, edx = edx:eax / divisor
+    void Cdq();
+    void Neg(X86Reg dst);
+    void Not(X86Reg dst);
+    void Setcc(X86Cond cond, X86Reg dst);
+
+      // Jumps and calls return the offset of their rel32 field for Patch.
+      // A negative target leaves it to be patched.
+    size_t Jcc(X86Cond cond, long target = -1);
+    size_t Jmp(long target = -1);
+    size_t Call(long target = -1);
+    void JmpReg(X86Reg target);
+    void CallReg(X86Reg target);
+    void Push(X86Reg r);
+    void Pop(X86Reg r);
+    void Ret();
+
+  private:
+    unsigned char *buf;
+    size_t cap, pos;
+    bool full;
+
+    void Byte(int b);
+    void Int32(int v);
+    void Rex(bool w, int reg, int index, int base, bool force = false);
+    void ModRM(int reg, const X86Mem &m);
+    void ModRMReg(int reg, int rm);
+    void Op(int opcode, int reg, const X86Mem &m, bool w, bool force = false);
+    void OpReg(int opcode, int reg, int rm, bool w, bool force = false);
+    size_t Rel32(long target);
+};
+
+#endif
@@ -0,0 +1,110 @@
+/* File: x86rt.c
+ * -------------
+ * The runtime linked into programs compiled with dcc -target x86 (see
+ * x86.h). It provides the built-in functions the generated code calls
+ * and the C main, which runs the Decaf main.
+ *
+ * The built-ins behave as the MIPS versions in mips.cc do, including
+ * their quirks: _PrintBool prints "false" for anything <= 0, and
+ * _ReadLine returns the line without its newline, however long, so
+ * both targets produce the same output for the same input.
+ *
+ * Decaf pointers are 32 bits wide, so all memory handed to the program
+ * has to lie below 4G: the heap is carved out of chunks mapped with
+ * MAP_32BIT, and like sbrk memory it starts out zeroed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#define HEAP_CHUNK (1 << 20)
+
+static char *heapNext, *heapEnd;
+
+extern void __decaf_main(void);
+
+void _Halt(void)
+{
+  fflush(stdout);
+  exit(0);
+}
+
+static void Fatal(const char *message)
+{
+  fflush(stdout);
+  fprintf(stderr, "Decaf runtime error: %s\n", message);
+  exit(1);
+}
+
+void *_Alloc(int size)
+{
+  size = (size + 3) & ~3;
+  if (size < 0) Fatal("negative allocation");
+  if (size > heapEnd - heapNext) {
+    size_t chunk = size > HEAP_CHUNK ? (size_t)size : HEAP_CHUNK;
+    void *p = mmap(NULL, chunk, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (p == MAP_FAILED) Fatal("out of memory");
+    heapNext = p;
+    heapEnd = heapNext + chunk;
+  }
+  char *result = heapNext;
+  heapNext += size;
+  return result;
+}
+
+void _PrintInt(int value)
+{
+  printf("%d", value);
+}
+
+void _PrintString(const char *s)
+{
+  fputs(s, stdout);
+}
+
+void _PrintBool(int value)
+{
+  fputs(value > 0 ? "true" : "false", stdout);
+}
+
+int _StringEqual(const char *a, const char *b)
+{
+  return strcmp(a, b) == 0;
+}
+
+int _ReadInteger(void)
+{
+  char line[256];
+  fflush(stdout);
+  return fgets(line, sizeof(line), stdin) ? (int)strtol(line, NULL, 10) : 0;
+}
+
+  // The line, without its newline, in a block that doubles when the
+  // line outgrows it.
+char *_ReadLine(void)
+{
+  int size = 32, len = 0, c;
+  char *buf = _Alloc(size);
+  fflush(stdout);
+  while ((c = getchar()) != EOF && c != '\n') {
+    if (len + 1 == size) {
+      char *bigger = _Alloc(size *= 2);
+      memcpy(bigger, buf, len);
+      buf = bigger;
+    }
+    buf[len++] = c;
+  }
+  buf[len] = '\0';
+  return buf;
+}
+
+int main(void)
+{
+  __decaf_main();
+  fflush(stdout);
+  return 0;
+}